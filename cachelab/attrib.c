@@ -0,0 +1,253 @@
+/*
+ * attrib.c - 3C miss attribution, see attrib.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "attrib.h"
+
+static unsigned long int hashBlock(unsigned long int block){
+	return (unsigned long int)((unsigned long long int)block * 0x9E3779B97F4A7C15ull >> 17);
+}
+
+/*
+ * Blocks seen so far, open addressing with linear probing, doubled at
+ * half load. Returns 1 if the block was already there.
+ */
+static int seenInsert(BlockSet* set, unsigned long int block);
+
+static int seenGrow(BlockSet* set){
+	BlockSet old = *set;
+
+	set->size = old.size ? 2 * old.size : 1024;
+	set->used = 0;
+	if ((set->block = calloc(set->size, sizeof(unsigned long int))) == NULL) {
+		*set = old;
+		return -1;
+	}
+	for (unsigned long int i = 0; i < old.size; i++)
+		if (old.block[i])
+			seenInsert(set, old.block[i] - 1);
+	free(old.block);
+	return 0;
+}
+
+static int seenInsert(BlockSet* set, unsigned long int block){
+	unsigned long int i;
+
+	if (2 * (set->used + 1) > set->size && seenGrow(set) != 0)
+		return 1;	// out of memory: call it seen
+	for (i = hashBlock(block) & (set->size - 1); set->block[i]; i = (i + 1) & (set->size - 1))
+		if (set->block[i] == block + 1)
+			return 1;
+	set->block[i] = block + 1;
+	set->used++;
+	return 0;
+}
+
+/*
+ * Shadow fully associative LRU cache: lines in a doubly linked list in
+ * recency order, found through a linear probing table
+ */
+static int shadowInit(ShadowCache* c, int lines){
+	int slots = 1;
+
+	while (slots < 2 * lines)
+		slots <<= 1;
+	c->lines = lines;
+	c->used = 0;
+	c->head = c->tail = -1;
+	c->slotMask = slots - 1;
+	c->block = malloc(lines * sizeof(unsigned long int));
+	c->prev = malloc(lines * sizeof(int));
+	c->next = malloc(lines * sizeof(int));
+	c->slot = malloc(slots * sizeof(int));
+	if (c->block == NULL || c->prev == NULL || c->next == NULL || c->slot == NULL)
+		return -1;
+	memset(c->slot, -1, slots * sizeof(int));
+	return 0;
+}
+
+static void shadowFree(ShadowCache* c){
+	free(c->block);
+	free(c->prev);
+	free(c->next);
+	free(c->slot);
+}
+
+static int shadowSlot(ShadowCache* c, unsigned long int block){
+	int i;
+
+	for (i = hashBlock(block) & c->slotMask; c->slot[i] >= 0; i = (i + 1) & c->slotMask)
+		if (c->block[c->slot[i]] == block)
+			return i;
+	return i;
+}
+
+/* Remove the slot of block, shifting later entries of its probe run back */
+static void shadowErase(ShadowCache* c, unsigned long int block){
+	int i = shadowSlot(c, block), j = i, k;
+
+	c->slot[i] = -1;
+	for (;;) {
+		j = (j + 1) & c->slotMask;
+		if (c->slot[j] < 0)
+			return;
+		k = hashBlock(c->block[c->slot[j]]) & c->slotMask;
+		if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+			c->slot[i] = c->slot[j];
+			c->slot[j] = -1;
+			i = j;
+		}
+	}
+}
+
+static void shadowUnlink(ShadowCache* c, int n){
+	if (c->prev[n] >= 0)
+		c->next[c->prev[n]] = c->next[n];
+	else
+		c->head = c->next[n];
+	if (c->next[n] >= 0)
+		c->prev[c->next[n]] = c->prev[n];
+	else
+		c->tail = c->prev[n];
+}
+
+static void shadowPush(ShadowCache* c, int n){
+	c->prev[n] = -1;
+	c->next[n] = c->head;
+	if (c->head >= 0)
+		c->prev[c->head] = n;
+	c->head = n;
+	if (c->tail < 0)
+		c->tail = n;
+}
+
+/* Reference block, return 1 on a hit */
+static int shadowAccess(ShadowCache* c, unsigned long int block){
+	int i = shadowSlot(c, block), n = c->slot[i];
+
+	if (n >= 0) {
+		shadowUnlink(c, n);
+		shadowPush(c, n);
+		return 1;
+	}
+	if (c->used < c->lines)
+		n = c->used++;
+	else {
+		n = c->tail;
+		shadowUnlink(c, n);
+		shadowErase(c, c->block[n]);
+	}
+	c->block[n] = block;
+	c->slot[shadowSlot(c, block)] = n;
+	shadowPush(c, n);
+	return 0;
+}
+
+Attribution* attribCreate(int s, int E, int b){
+	Attribution* a;
+
+	if (s < 0 || E <= 0 || b < 0 || s + b >= 64 || (long)E << s > 1 << 26)
+		return NULL;
+	if ((a = calloc(1, sizeof(Attribution))) == NULL)
+		return NULL;
+	a->s = s;
+	a->b = b;
+	strcpy(a->range[0].name, "other");
+	if ((a->set = calloc(1UL << s, sizeof(MissStats))) == NULL ||
+		seenGrow(&a->seen) != 0 || shadowInit(&a->shadow, E << s) != 0) {
+		attribFree(a);
+		return NULL;
+	}
+	return a;
+}
+
+void attribFree(Attribution* a){
+	if (a == NULL)
+		return;
+	free(a->set);
+	free(a->seen.block);
+	shadowFree(&a->shadow);
+	free(a);
+}
+
+int attribAddRange(Attribution* a, const char* name, unsigned long int start, unsigned long int end){
+	if (a->ranges == MAX_RANGES || end <= start)
+		return -1;
+	a->range[a->ranges + 1] = a->range[a->ranges];	// keep "other" last
+	snprintf(a->range[a->ranges].name, RANGE_NAME, "%s", name);
+	a->range[a->ranges].start = start;
+	a->range[a->ranges].end = end;
+	memset(&a->range[a->ranges].stats, 0, sizeof(MissStats));
+	a->ranges++;
+	return 0;
+}
+
+int attribParseRange(Attribution* a, const char* spec){
+	char name[RANGE_NAME];
+	unsigned long int start, end;
+
+	if (sscanf(spec, "%31[^:]:%lx:%lx", name, &start, &end) != 3)
+		return -1;
+	return attribAddRange(a, name, start, end);
+}
+
+int attribLoadRanges(Attribution* a, const char* path){
+	char line[256], name[RANGE_NAME];
+	unsigned long int start, end;
+	FILE* fp = fopen(path, "r");
+
+	if (fp == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), fp) != NULL)
+		if (sscanf(line, "%31s %lx %lx", name, &start, &end) == 3 &&
+			attribAddRange(a, name, start, end) != 0) {
+			fclose(fp);
+			return -1;
+		}
+	fclose(fp);
+	return 0;
+}
+
+int attribRange(Attribution* a, unsigned long int address){
+	int i;
+
+	for (i = 0; i < a->ranges; i++)
+		if (address >= a->range[i].start && address < a->range[i].end)
+			break;
+	return i;
+}
+
+static void count(MissStats* st, int kind){
+	st->accesses++;
+	if (kind == 0)
+		st->hits++;
+	else if (kind == 1)
+		st->compulsory++;
+	else if (kind == 2)
+		st->capacity++;
+	else
+		st->conflict++;
+}
+
+void attribAccess(Attribution* a, unsigned long int address, int hit, int evicted, unsigned long int victimBlock){
+	unsigned long int block = address >> a->b;
+	int first = !seenInsert(&a->seen, block);
+	int shadowHit = shadowAccess(&a->shadow, block);
+	int kind, r = attribRange(a, address);
+
+	if (hit)
+		kind = 0;
+	else if (first)
+		kind = 1;
+	else if (!shadowHit)
+		kind = 2;
+	else
+		kind = 3;
+	count(&a->total, kind);
+	count(&a->set[block & ((1UL << a->s) - 1)], kind);
+	count(&a->range[r].stats, kind);
+	if (kind == 3 && evicted)
+		a->evicted[r][attribRange(a, victimBlock << a->b)]++;
+}
@@ -0,0 +1,77 @@
+/*
+ * attrib.h - 3C miss attribution for csim -a.
+ *
+ * Every L1 miss is classified with the 3C model: compulsory if the
+ * block was never referenced before, capacity if a fully associative
+ * LRU cache with as many lines would also have missed, and conflict
+ * otherwise. Counts are kept per set and per user-supplied address
+ * range, plus, for conflict misses, which range the evicted line
+ * belonged to.
+ */
+
+#ifndef ATTRIB_H
+#define ATTRIB_H
+
+#define MAX_RANGES 16
+#define RANGE_NAME 32
+
+typedef struct {
+	unsigned long int accesses;
+	unsigned long int hits;
+	unsigned long int compulsory;
+	unsigned long int capacity;
+	unsigned long int conflict;
+	} MissStats;
+
+typedef struct {
+	char name[RANGE_NAME];
+	unsigned long int start, end;	// [start, end)
+	MissStats stats;
+	} AddrRange;
+
+typedef struct {
+	unsigned long int* block;	// block address + 1, 0 for an empty slot
+	unsigned long int size, used;	// slots, a power of two, and blocks held
+	} BlockSet;			// every block referenced so far
+
+typedef struct {
+	int lines, used, head, tail;	// head is the MRU line, tail the LRU one
+	unsigned long int* block;
+	int* prev;
+	int* next;
+	int* slot;			// hash of block to line, -1 empty
+	int slotMask;
+	} ShadowCache;			// fully associative LRU cache
+
+typedef struct {
+	int s, b;
+	MissStats total;
+	MissStats* set;			// 2^s entries
+	int ranges;
+	AddrRange range[MAX_RANGES + 1];	// range[ranges] is everything else
+	unsigned long int evicted[MAX_RANGES + 1][MAX_RANGES + 1]; // [miss range][victim range], conflict misses
+	BlockSet seen;
+	ShadowCache shadow;
+	} Attribution;
+
+/* Attribution for an L1 of 2^s sets of E lines of 2^b bytes; NULL on failure */
+Attribution* attribCreate(int s, int E, int b);
+void attribFree(Attribution* a);
+
+/* Add a range; -1 if there are MAX_RANGES already */
+int attribAddRange(Attribution* a, const char* name, unsigned long int start, unsigned long int end);
+/* Add "name:start:end" (hex, end exclusive); -1 if malformed */
+int attribParseRange(Attribution* a, const char* spec);
+/* Add one "name start end" range per line of path, as written by tracegen; -1 on error */
+int attribLoadRanges(Attribution* a, const char* path);
+/* Index of the range holding address, a->ranges if none */
+int attribRange(Attribution* a, unsigned long int address);
+
+/*
+ * attribAccess - Account one demand access that hit or missed in the
+ *     L1; evicted and victimBlock tell whether the fill replaced a line
+ *     and which block it held
+ */
+void attribAccess(Attribution* a, unsigned long int address, int hit, int evicted, unsigned long int victimBlock);
+
+#endif /* ATTRIB_H */
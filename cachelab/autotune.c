@@ -0,0 +1,215 @@
+/*
+ * autotune.c - Search the parameters of trans_blocked (tile height and
+ *     width, diagonal handling, tile and element order) against the
+ *     in-process cache simulator, for each requested shape and cache
+ *     geometry. The Pareto front over (misses, accesses) is printed and
+ *     the variant with the fewest misses is written as one row of the
+ *     lookup table trans_tuned reads (trans-tuned.h by default). A
+ *     configuration where no variant has fewer misses than
+ *     transpose_submit gets a row that sends trans_tuned to it instead.
+ *
+ * usage: ./autotune [-g s:E:b ...] [-o file] [MxN ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "cachelab.h"
+#include "cachesim.h"
+#include "tracesim.h"
+#include "transtune.h"
+
+#define MAXN 256
+#define MAX_CONFIGS 64
+#define MAX_VARIANTS 1024
+
+static int A[MAXN][MAXN];
+static int B[MAXN][MAXN];
+
+typedef struct variant {
+    trans_params_t params;
+    unsigned long misses;
+    unsigned long accesses;
+} variant_t;
+
+/* The tile sides tried, in elements */
+static const int sides[] = {1, 2, 4, 8, 12, 16, 24, 32, 64};
+
+/*
+ * run_variant - Simulate one variant, or transpose_submit if v->params.th
+ *     is 0; return 0 if it is not a transpose
+ */
+static int run_variant(int M, int N, const cache_geometry_t *g, variant_t *v)
+{
+    Hierarchy* h = hierCreate(INCLUSIVE);
+    hierAddLevel(h, cacheCreate(g->s, g->E, g->b));
+    initMatrix(M, N, A, B);
+    traceSimStart(h);
+    if (v->params.th == 0)
+        transpose_submit(M, N, A, B);
+    else
+        trans_blocked(M, N, A, B, &v->params);
+    traceSimStop();
+    v->misses = h->level[0]->stats.misses;
+    v->accesses = traceSimCount();
+    hierFree(h);
+    return validate(-1, M, N, A, B);
+}
+
+/*
+ * tune - Try every variant for one configuration, print the Pareto
+ *     front and set *best to the variant with the fewest misses (fewest
+ *     accesses on a tie), or to transpose_submit (th 0) if it has no
+ *     more misses than that; return -1 if neither is a transpose
+ */
+static int tune(int M, int N, const cache_geometry_t *g, variant_t *best)
+{
+    static variant_t v[MAX_VARIANTS];
+    int n = 0, i, j, th, tw, diag, tiles, inner, dominated;
+    int nsides = sizeof(sides) / sizeof(sides[0]);
+    char buf[128];
+    variant_t submit = {{0}};
+    int submitted = run_variant(M, N, g, &submit);
+
+    for (th = 0; th < nsides && sides[th] <= N; th++)
+        for (tw = 0; tw < nsides && sides[tw] <= M; tw++)
+            for (diag = DIAG_NONE; diag <= DIAG_BUFFER; diag++)
+                for (tiles = ORDER_ROWS; tiles <= ORDER_COLS; tiles++)
+                    for (inner = ORDER_ROWS; inner <= ORDER_COLS; inner++) {
+                        v[n].params.th = sides[th];
+                        v[n].params.tw = sides[tw];
+                        v[n].params.diag = diag;
+                        v[n].params.tile_order = tiles;
+                        v[n].params.inner_order = inner;
+                        if (run_variant(M, N, g, &v[n]) && n + 1 < MAX_VARIANTS)
+                            n++;
+                    }
+
+    printf("\n%dx%d (s=%d, E=%d, b=%d): %d variants, Pareto front:\n",
+           M, N, g->s, g->E, g->b, n);
+    if (n == 0 && !submitted) {
+        printf("  no variant, and not transpose_submit either, is a transpose\n");
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        dominated = 0;
+        for (j = 0; j < n && !dominated; j++)
+            dominated = v[j].misses <= v[i].misses && v[j].accesses <= v[i].accesses &&
+                        (v[j].misses < v[i].misses || v[j].accesses < v[i].accesses);
+        if (!dominated)
+            printf("  misses:%-7lu accesses:%-7lu %s\n", v[i].misses, v[i].accesses,
+                   trans_params_str(&v[i].params, buf));
+    }
+    if (submitted)
+        printf("  transpose_submit: misses:%-7lu accesses:%lu\n", submit.misses, submit.accesses);
+
+    for (i = 0; i < n; i++)
+        if (i == 0 || v[i].misses < best->misses ||
+            (v[i].misses == best->misses && v[i].accesses < best->accesses))
+            *best = v[i];
+    if (submitted && (n == 0 || submit.misses <= best->misses)) {
+        *best = submit;
+        printf("  best: transpose_submit, no variant has fewer misses\n");
+    }
+    else
+        printf("  best: %s\n", trans_params_str(&best->params, buf));
+    return 0;
+}
+
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-g <s:E:b> ...] [-o <file>] [MxN ...]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -g <s:E:b>  Cache geometry to tune for (default 5:1:5, repeatable).\n");
+    printf("  -o <file>   Table to write (default trans-tuned.h, - for stdout).\n");
+    printf("Shapes default to 32x32 64x64 61x67, at most %dx%d.\n", MAXN, MAXN);
+    printf("Example: %s -g 5:1:5 -g 6:2:5 32x32 64x64 100x37\n", argv[0]);
+}
+
+int main(int argc, char *argv[])
+{
+    cache_geometry_t geoms[MAX_CONFIGS];
+    int shapes[MAX_CONFIGS][2] = {{32, 32}, {64, 64}, {61, 67}};
+    int ngeoms = 0, nshapes = 3, i, k;
+    const char *out = "trans-tuned.h";
+    static variant_t best[MAX_CONFIGS][MAX_CONFIGS];
+    FILE *fp;
+    int c;
+
+    while ((c = getopt(argc, argv, "hg:o:")) != -1) {
+        switch (c) {
+        case 'g':
+            if (ngeoms == MAX_CONFIGS ||
+                sscanf(optarg, "%d:%d:%d", &geoms[ngeoms].s, &geoms[ngeoms].E, &geoms[ngeoms].b) != 3) {
+                printf("Error: bad geometry \"%s\"\n", optarg);
+                exit(1);
+            }
+            ngeoms++;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (ngeoms == 0) {
+        geoms[0].s = 5;
+        geoms[0].E = 1;
+        geoms[0].b = 5;
+        ngeoms = 1;
+    }
+    if (optind < argc)
+        nshapes = 0;
+    for (; optind < argc && nshapes < MAX_CONFIGS; optind++, nshapes++)
+        if (sscanf(argv[optind], "%dx%d", &shapes[nshapes][0], &shapes[nshapes][1]) != 2 ||
+            shapes[nshapes][0] < 1 || shapes[nshapes][1] < 1 ||
+            shapes[nshapes][0] > MAXN || shapes[nshapes][1] > MAXN) {
+            printf("Error: bad shape \"%s\"\n", argv[optind]);
+            exit(1);
+        }
+
+    /* Tune everything before writing, so a failure leaves the old table */
+    for (k = 0; k < ngeoms; k++)
+        for (i = 0; i < nshapes; i++)
+            if (tune(shapes[i][0], shapes[i][1], &geoms[k], &best[k][i]) < 0) {
+                printf("Error: nothing to tune for %dx%d\n", shapes[i][0], shapes[i][1]);
+                exit(1);
+            }
+
+    fp = strcmp(out, "-") == 0 ? stdout : fopen(out, "w");
+    if (fp == NULL) {
+        perror(out);
+        exit(1);
+    }
+    fprintf(fp, "/*\n * trans-tuned.h - Generated by ./autotune, do not edit. Best\n"
+                " *     trans_blocked parameters per shape and cache geometry,\n"
+                " *     looked up by trans_tuned.\n */\n");
+    fprintf(fp, "static const trans_tuned_entry_t trans_tuned_table[] = {\n");
+    fprintf(fp, "    /* M, N, s, E, b, {th, tw, diag, tile order, inner order}, th 0 for transpose_submit */\n");
+    for (k = 0; k < ngeoms; k++)
+        for (i = 0; i < nshapes; i++) {
+            variant_t *v = &best[k][i];
+            fprintf(fp, "    {%d, %d, %d, %d, %d, {%d, %d, %s, %s, %s}}, /* %lu misses, %lu accesses%s */\n",
+                    shapes[i][0], shapes[i][1], geoms[k].s, geoms[k].E, geoms[k].b,
+                    v->params.th, v->params.tw,
+                    v->params.diag == DIAG_NONE ? "DIAG_NONE" :
+                    v->params.diag == DIAG_DEFER ? "DIAG_DEFER" : "DIAG_BUFFER",
+                    v->params.tile_order == ORDER_ROWS ? "ORDER_ROWS" : "ORDER_COLS",
+                    v->params.inner_order == ORDER_ROWS ? "ORDER_ROWS" : "ORDER_COLS",
+                    v->misses, v->accesses, v->params.th == 0 ? ", transpose_submit" : "");
+        }
+    fprintf(fp, "};\n");
+    if (fp != stdout) {
+        fclose(fp);
+        printf("\nWrote %s\n", out);
+    }
+    return 0;
+}
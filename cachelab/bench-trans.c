@@ -0,0 +1,235 @@
+/*
+ * bench-trans.c - Wall-clock throughput of the native transpose kernels
+ *     against correctTrans, on matrices too large for any cache.
+ *
+ * Bandwidth counts each int read once and written once, so it is
+ * 2 * M * N * sizeof(int) bytes per transpose over the best of -r runs.
+ * trans_parallel is then run with 1, 2, 4, ... up to -t threads to show
+ * how bandwidth scales with cores, followed by trans_inplace.
+ *
+ * usage: ./bench-trans [-r reps] [-t threads] [MxN ...]
+ */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "cachelab.h"
+#include "trans-simd.h"
+#include "trans-par.h"
+
+#define MAX_SHAPES 64
+
+typedef struct bench_kernel {
+    const char *name;
+    void (*func)(int M, int N, int A[N][M], int B[M][N]);
+    simd_level_t level;     /* needed to run it */
+} bench_kernel_t;
+
+static const bench_kernel_t kernels[] = {
+    {"correctTrans", correctTrans, SIMD_SCALAR},
+    {"blocked scalar", trans_simd_scalar, SIMD_SCALAR},
+    {"blocked sse2", trans_simd_sse2, SIMD_SSE2},
+    {"blocked avx2", trans_simd_avx2, SIMD_AVX2},
+    {"trans_simd", trans_simd, SIMD_SCALAR},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * bench - Best time of reps runs of k, 0 if its result differs from ref
+ */
+static double bench(const bench_kernel_t *k, int M, int N, int *A, int *B,
+                    const int *ref, int reps)
+{
+    double best = 0, t;
+    int r;
+
+    for (r = 0; r < reps; r++) {
+        memset(B, 0, sizeof(int) * M * N);
+        t = now();
+        k->func(M, N, (int (*)[M])A, (int (*)[N])B);
+        t = now() - t;
+        if (r == 0 || t < best)
+            best = t;
+    }
+    if (memcmp(B, ref, sizeof(int) * M * N) != 0)
+        return 0;
+    return best;
+}
+
+/*
+ * bench_parallel - Best time of reps runs of trans_parallel on a pool of
+ *     threads into a B first touched by the pool, 0 if it is wrong
+ */
+static double bench_parallel(int threads, int M, int N, int *A, const int *ref, int reps)
+{
+    trans_pool_t *pool = trans_pool_create(threads);
+    double best = 0, t;
+    int *B = NULL;
+    int r;
+
+    if (pool == NULL || posix_memalign((void **)&B, 64, sizeof(int) * M * N) != 0) {
+        printf("Error: cannot start %d threads\n", threads);
+        exit(1);
+    }
+    trans_first_touch(pool, M, N, (int (*)[N])B);
+    for (r = 0; r < reps; r++) {
+        t = now();
+        trans_parallel(pool, M, N, (int (*)[M])A, (int (*)[N])B);
+        t = now() - t;
+        if (r == 0 || t < best)
+            best = t;
+    }
+    if (memcmp(B, ref, sizeof(int) * M * N) != 0)
+        best = 0;
+    free(B);
+    trans_pool_free(pool);
+    return best;
+}
+
+/*
+ * bench_inplace - Best time of reps runs of trans_inplace on a copy of A
+ *     held in B, 0 if it is wrong
+ */
+static double bench_inplace(trans_pool_t *pool, int M, int N, const int *A, int *B,
+                            const int *ref, int reps)
+{
+    double best = 0, t;
+    int r;
+
+    for (r = 0; r < reps; r++) {
+        memcpy(B, A, sizeof(int) * M * N);
+        t = now();
+        if (!trans_inplace(pool, M, N, B))
+            return 0;
+        t = now() - t;
+        if (r == 0 || t < best)
+            best = t;
+        if (memcmp(B, ref, sizeof(int) * M * N) != 0)
+            return 0;
+    }
+    return best;
+}
+
+static void report(const char *name, double t, double base, int M, int N)
+{
+    if (t == 0)
+        printf("  %-16s WRONG RESULT\n", name);
+    else
+        printf("  %-16s %8.3f ms %7.2f GB/s %6.2fx\n", name, t * 1e3,
+               2.0 * sizeof(int) * M * N / t / 1e9, base / t);
+}
+
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-r <reps>] [-t <n>] [MxN ...]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -r <reps>   Runs per kernel, the best is reported (default 5).\n");
+    printf("  -t <n>      Most threads for trans_parallel (default: online CPUs).\n");
+    printf("Shapes default to 1024x1024 2048x2048 4096x4096 3001x2999.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int shapes[MAX_SHAPES][2] = {{1024, 1024}, {2048, 2048}, {4096, 4096}, {3001, 2999}};
+    int nshapes = 4, reps = 5, threads = sysconf(_SC_NPROCESSORS_ONLN), i, k, n, M, N, c;
+    int nkernels = sizeof(kernels) / sizeof(kernels[0]);
+    simd_level_t level = simd_level();
+    double t, base, base1;
+    trans_pool_t *pool;
+    char name[32];
+    int *A, *B, *ref;
+
+    while ((c = getopt(argc, argv, "hr:t:")) != -1) {
+        switch (c) {
+        case 'r':
+            reps = atoi(optarg);
+            if (reps < 1) {
+                printf("Error: bad rep count \"%s\"\n", optarg);
+                exit(1);
+            }
+            break;
+        case 't':
+            threads = atoi(optarg);
+            if (threads < 1) {
+                printf("Error: bad thread count \"%s\"\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (optind < argc)
+        nshapes = 0;
+    for (; optind < argc && nshapes < MAX_SHAPES; optind++, nshapes++)
+        if (sscanf(argv[optind], "%dx%d", &shapes[nshapes][0], &shapes[nshapes][1]) != 2 ||
+            shapes[nshapes][0] < 1 || shapes[nshapes][1] < 1) {
+            printf("Error: bad shape \"%s\"\n", argv[optind]);
+            exit(1);
+        }
+
+    if (threads < 1)
+        threads = 1;
+    if ((pool = trans_pool_create(threads)) == NULL) {
+        printf("Error: cannot start %d threads\n", threads);
+        exit(1);
+    }
+    printf("CPU supports %s, trans_simd uses it; best of %d runs, up to %d threads\n",
+           simd_level_name(level), reps, threads);
+    for (i = 0; i < nshapes; i++) {
+        M = shapes[i][0];
+        N = shapes[i][1];
+        if (posix_memalign((void **)&A, 64, sizeof(int) * M * N) != 0 ||
+            posix_memalign((void **)&B, 64, sizeof(int) * M * N) != 0 ||
+            posix_memalign((void **)&ref, 64, sizeof(int) * M * N) != 0) {
+            printf("Error: out of memory for %dx%d\n", M, N);
+            exit(1);
+        }
+        initMatrix(M, N, (int (*)[M])A, (int (*)[N])ref);
+        correctTrans(M, N, (int (*)[M])A, (int (*)[N])ref);
+
+        printf("\n%dx%d (%.1f MB per matrix)\n", M, N, sizeof(int) * M * N / 1e6);
+        base = 0;
+        for (k = 0; k < nkernels; k++) {
+            if (kernels[k].level > level) {
+                printf("  %-16s not supported\n", kernels[k].name);
+                continue;
+            }
+            t = bench(&kernels[k], M, N, A, B, ref, reps);
+            if (k == 0)
+                base = t;
+            report(kernels[k].name, t, base, M, N);
+        }
+
+        /* Speedup of the parallel rows is over one thread, not correctTrans */
+        base1 = 0;
+        for (n = 1; n <= threads; n = n * 2 > threads && n < threads ? threads : n * 2) {
+            t = bench_parallel(n, M, N, A, ref, reps);
+            if (n == 1)
+                base1 = t;
+            sprintf(name, "parallel x%d", n);
+            report(name, t, base1, M, N);
+        }
+        report(M == N ? "in-place tiles" : "in-place cycles",
+               bench_inplace(pool, M, N, A, B, ref, reps), base, M, N);
+        free(A);
+        free(B);
+        free(ref);
+    }
+    trans_pool_free(pool);
+    return 0;
+}
@@ -0,0 +1,547 @@
+/*
+ * btrace.c - Text and binary trace reader, binary trace writer and the
+ *     block compressor. See btrace.h for the format.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "btrace.h"
+
+#define MAGIC "CLBT"
+#define VERSION 1
+#define HEADER_SIZE 32
+#define BLOCK_HEADER 12
+#define MAX_RECORD 32	// largest encoded record: op byte and three varints
+
+#define LZ_MIN 4	// shortest match
+#define LZ_HASH_BITS 12
+#define LZ_WINDOW 65535
+
+struct TraceReader {
+	FILE* fp;
+	int binary;
+	unsigned int flags;
+	unsigned int blockRecords;
+	unsigned long int records;
+	unsigned long int blocks;
+	unsigned long int* index;	// file offset of each block
+	unsigned long int block;	// next block to load
+	unsigned char* stored;		// block as read from the file
+	unsigned char* raw;		// block after decompression
+	int rawLen, pos, cap;
+	unsigned long int prevData, prevIp;
+	int core;
+	int failed;
+	};
+
+struct TraceWriter {
+	FILE* fp;
+	unsigned int flags;
+	unsigned int blockRecords;
+	unsigned long int records;
+	unsigned int inBlock;		// records in the block being encoded
+	unsigned char* raw;
+	unsigned char* packed;
+	int rawLen, cap;
+	unsigned long int* index;
+	unsigned long int blocks, indexCap;
+	unsigned long int prevData, prevIp;
+	int core;
+	int failed;
+	};
+
+/*
+ * Little-endian fields and varints
+ */
+static void put32(unsigned char* p, unsigned long int v){
+	for (int i = 0; i < 4; i++)
+		p[i] = v >> (8 * i);
+}
+
+static void put64(unsigned char* p, unsigned long int v){
+	for (int i = 0; i < 8; i++)
+		p[i] = (unsigned long long int)v >> (8 * i);
+}
+
+static unsigned long int get32(const unsigned char* p){
+	unsigned long int v = 0;
+	for (int i = 0; i < 4; i++)
+		v |= (unsigned long int)p[i] << (8 * i);
+	return v;
+}
+
+static unsigned long int get64(const unsigned char* p){
+	unsigned long long int v = 0;
+	for (int i = 0; i < 8; i++)
+		v |= (unsigned long long int)p[i] << (8 * i);
+	return v;
+}
+
+static int putVarint(unsigned char* p, unsigned long long int v){
+	int n = 0;
+	while (v >= 0x80) {
+		p[n++] = v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+/* -1 if the varint runs past end */
+static int getVarint(const unsigned char* p, const unsigned char* end, unsigned long long int* v){
+	int n = 0, shift = 0;
+	*v = 0;
+	while (p + n < end && shift < 64) {
+		*v |= (unsigned long long int)(p[n] & 0x7f) << shift;
+		if ((p[n++] & 0x80) == 0)
+			return n;
+		shift += 7;
+	}
+	return -1;
+}
+
+static unsigned long long int zigzag(long long int v){
+	return ((unsigned long long int)v << 1) ^ (unsigned long long int)(v >> 63);
+}
+
+static long long int unzigzag(unsigned long long int v){
+	return (long long int)(v >> 1) ^ -(long long int)(v & 1);
+}
+
+static const char opChar[] = "ILSM";
+
+static int opCode(char oper){
+	const char* p = strchr(opChar, oper);
+	return oper != '\0' && p != NULL ? p - opChar : -1;
+}
+
+/* Size code 1..5 for 1, 2, 4, 8 and 16 bytes, 0 for a size stored as a varint */
+static int sizeCode(int size){
+	for (int code = 1; code <= 5; code++)
+		if (size == 1 << (code - 1))
+			return code;
+	return 0;
+}
+
+/*
+ * LZ77 in the style of LZ4: each sequence is a token (literal length in
+ * the high nibble, match length - LZ_MIN in the low one, 15 meaning more
+ * length bytes follow), the literals, and a 2-byte match offset. The
+ * last sequence has literals only.
+ */
+static int lzLength(unsigned char* dst, int op, int len){
+	for (; len >= 255; len -= 255)
+		dst[op++] = 255;
+	dst[op++] = len;
+	return op;
+}
+
+static int lzEmit(unsigned char* dst, int op, int cap, const unsigned char* lit, int litLen, int offset, int matchLen){
+	int m = matchLen ? matchLen - LZ_MIN : 0;
+
+	if (op + 1 + litLen / 255 + 1 + litLen + 2 + m / 255 + 1 >= cap)
+		return -1;
+	dst[op++] = (litLen < 15 ? litLen : 15) << 4 | (m < 15 ? m : 15);
+	if (litLen >= 15)
+		op = lzLength(dst, op, litLen - 15);
+	memcpy(dst + op, lit, litLen);
+	op += litLen;
+	if (matchLen == 0)
+		return op;
+	dst[op++] = offset;
+	dst[op++] = offset >> 8;
+	if (m >= 15)
+		op = lzLength(dst, op, m - 15);
+	return op;
+}
+
+static unsigned int lzHash(const unsigned char* p){
+	unsigned int v = p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+int lzCompress(const unsigned char* src, int n, unsigned char* dst){
+	int table[1 << LZ_HASH_BITS];
+	int ip = 0, anchor = 0, op = 0, ref, len;
+	unsigned int h;
+
+	for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+		table[i] = -1;
+	while (ip + LZ_MIN <= n) {
+		h = lzHash(src + ip);
+		ref = table[h];
+		table[h] = ip;
+		if (ref < 0 || ip - ref > LZ_WINDOW || memcmp(src + ref, src + ip, LZ_MIN) != 0) {
+			ip++;
+			continue;
+		}
+		for (len = LZ_MIN; ip + len < n && src[ref + len] == src[ip + len]; len++)
+			;
+		if ((op = lzEmit(dst, op, n, src + anchor, ip - anchor, ip - ref, len)) < 0)
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if ((op = lzEmit(dst, op, n, src + anchor, n - anchor, 0, 0)) < 0)
+		return 0;
+	return op;
+}
+
+int lzDecompress(const unsigned char* src, int n, unsigned char* dst, int cap){
+	int ip = 0, op = 0, lit, len, offset, c;
+
+	while (ip < n) {
+		c = src[ip++];
+		lit = c >> 4;
+		len = (c & 15) + LZ_MIN;
+		if (lit == 15)
+			do {
+				if (ip >= n)
+					return -1;
+				lit += src[ip];
+			} while (src[ip++] == 255);
+		if (lit > n - ip || lit > cap - op)
+			return -1;
+		memcpy(dst + op, src + ip, lit);
+		ip += lit;
+		op += lit;
+		if (ip == n)	// the last sequence
+			break;
+		if (ip + 2 > n)
+			return -1;
+		offset = src[ip] | src[ip + 1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > op)
+			return -1;
+		if (len == 15 + LZ_MIN)
+			do {
+				if (ip >= n)
+					return -1;
+				len += src[ip];
+			} while (src[ip++] == 255);
+		if (len > cap - op)
+			return -1;
+		for (int i = 0; i < len; i++, op++)	// may overlap itself
+			dst[op] = dst[op - offset];
+	}
+	return op;
+}
+
+/*
+ * Reading
+ */
+TraceReader* traceOpen(const char* path){
+	unsigned char header[HEADER_SIZE], buf[8];
+	unsigned long int indexOffset;
+	TraceReader* r;
+
+	if ((r = calloc(1, sizeof(TraceReader))) == NULL)
+		return NULL;
+	if ((r->fp = fopen(path, "rb")) == NULL) {
+		free(r);
+		return NULL;
+	}
+	r->core = -1;
+	if (fread(header, 1, HEADER_SIZE, r->fp) != HEADER_SIZE || memcmp(header, MAGIC, 4) != 0) {
+		rewind(r->fp);	// text
+		return r;
+	}
+	r->binary = 1;
+	r->flags = get32(header + 8);
+	r->blockRecords = get32(header + 12);
+	r->records = get64(header + 16);
+	indexOffset = get64(header + 24);
+	if (get32(header + 4) != VERSION || r->blockRecords == 0) {
+		traceClose(r);
+		return NULL;
+	}
+	r->blocks = (r->records + r->blockRecords - 1) / r->blockRecords;
+	if ((r->index = malloc((r->blocks + 1) * sizeof(unsigned long int))) == NULL ||
+		fseek(r->fp, indexOffset, SEEK_SET) != 0) {
+		traceClose(r);
+		return NULL;
+	}
+	for (unsigned long int i = 0; i < r->blocks; i++) {
+		if (fread(buf, 1, 8, r->fp) != 8) {
+			traceClose(r);
+			return NULL;
+		}
+		r->index[i] = get64(buf);
+	}
+	if (traceSeek(r, 0) != 0 && r->records > 0) {
+		traceClose(r);
+		return NULL;
+	}
+	return r;
+}
+
+int traceIsBinary(TraceReader* r){
+	return r->binary;
+}
+
+int traceFailed(TraceReader* r){
+	return r->failed;
+}
+
+unsigned long int traceRecords(TraceReader* r){
+	return r->records;
+}
+
+/* Read and decompress block r->block, 0 if there is none or it is corrupt */
+static int loadBlock(TraceReader* r){
+	unsigned char header[BLOCK_HEADER];
+	int rawLen, storedLen;
+
+	if (r->block >= r->blocks)
+		return 0;
+	r->failed = 1;	// until the block is in
+	if (fseek(r->fp, r->index[r->block], SEEK_SET) != 0 ||
+		fread(header, 1, BLOCK_HEADER, r->fp) != BLOCK_HEADER)
+		return 0;
+	rawLen = get32(header);
+	storedLen = get32(header + 4);
+	if (rawLen <= 0 || storedLen <= 0 || storedLen > rawLen ||
+		rawLen > (int)r->blockRecords * MAX_RECORD)
+		return 0;
+	if (rawLen > r->cap) {
+		free(r->raw);
+		free(r->stored);
+		r->cap = rawLen;
+		r->raw = malloc(rawLen);
+		r->stored = malloc(rawLen);
+		if (r->raw == NULL || r->stored == NULL) {
+			r->cap = 0;
+			return 0;
+		}
+	}
+	if (storedLen == rawLen) {
+		if (fread(r->raw, 1, rawLen, r->fp) != (size_t)rawLen)
+			return 0;
+	}
+	else if (fread(r->stored, 1, storedLen, r->fp) != (size_t)storedLen ||
+		lzDecompress(r->stored, storedLen, r->raw, rawLen) != rawLen)
+		return 0;
+	r->failed = 0;
+	r->rawLen = rawLen;
+	r->pos = 0;
+	r->prevData = r->prevIp = 0;
+	r->core = -1;
+	r->block++;
+	return 1;
+}
+
+/* Decode the next record of the loaded block, loading the next block first if needed */
+static int nextBinary(TraceReader* r, TraceRecord* rec){
+	const unsigned char *p, *end;
+	unsigned long long int v;
+	int op, code, n;
+
+	if (r->pos >= r->rawLen && !loadBlock(r))
+		return 0;
+	p = r->raw + r->pos;
+	end = r->raw + r->rawLen;
+	op = *p & 3;
+	code = (*p >> 2) & 7;
+	if (code > 5 || (n = getVarint(p + 1, end, &v)) < 0)
+		return !(r->failed = 1);
+	rec->oper = opChar[op];
+	if (op == 0)
+		rec->address = r->prevIp = r->prevIp + unzigzag(v);
+	else
+		rec->address = r->prevData = r->prevData + unzigzag(v);
+	p += 1 + n;
+	if (code == 0) {
+		if ((n = getVarint(p, end, &v)) < 0)
+			return !(r->failed = 1);
+		p += n;
+		rec->size = v;
+	}
+	else
+		rec->size = 1 << (code - 1);
+	if (r->raw[r->pos] & 0x20) {
+		if ((n = getVarint(p, end, &v)) < 0)
+			return !(r->failed = 1);
+		p += n;
+		r->core = (int)v - 1;
+	}
+	rec->core = r->core;
+	r->pos = p - r->raw;
+	return 1;
+}
+
+static int nextText(TraceReader* r, TraceRecord* rec){
+	char buf[256];
+
+	while (fgets(buf, sizeof(buf), r->fp) != NULL) {
+		if (sscanf(buf, " %d %c %lx,%d", &rec->core, &rec->oper, &rec->address, &rec->size) != 4) {
+			rec->core = -1;
+			if (sscanf(buf, " %c %lx,%d", &rec->oper, &rec->address, &rec->size) != 3)
+				continue;
+		}
+		if (opCode(rec->oper) >= 0)
+			return 1;
+	}
+	return 0;
+}
+
+int traceNext(TraceReader* r, TraceRecord* rec){
+	return r->binary ? nextBinary(r, rec) : nextText(r, rec);
+}
+
+int traceSeek(TraceReader* r, unsigned long int n){
+	TraceRecord rec;
+
+	if (!r->binary || n > r->records)
+		return -1;
+	r->block = n / r->blockRecords;
+	r->rawLen = r->pos = 0;
+	if (n == r->records)
+		return 0;
+	if (!loadBlock(r))
+		return -1;
+	for (n %= r->blockRecords; n > 0; n--)
+		if (!nextBinary(r, &rec))
+			return -1;
+	return 0;
+}
+
+void traceClose(TraceReader* r){
+	if (r == NULL)
+		return;
+	fclose(r->fp);
+	free(r->index);
+	free(r->stored);
+	free(r->raw);
+	free(r);
+}
+
+char* traceFormat(const TraceRecord* rec, char* buf){
+	if (rec->core >= 0)
+		sprintf(buf, "%d %c %08lx,%d", rec->core, rec->oper, rec->address, rec->size);
+	else if (rec->oper == 'I')
+		sprintf(buf, "I  %08lx,%d", rec->address, rec->size);
+	else
+		sprintf(buf, " %c %08lx,%d", rec->oper, rec->address, rec->size);
+	return buf;
+}
+
+/*
+ * Writing
+ */
+static void writeHeader(TraceWriter* w, unsigned long int indexOffset){
+	unsigned char header[HEADER_SIZE];
+
+	memcpy(header, MAGIC, 4);
+	put32(header + 4, VERSION);
+	put32(header + 8, w->flags);
+	put32(header + 12, w->blockRecords);
+	put64(header + 16, w->records);
+	put64(header + 24, indexOffset);
+	if (fwrite(header, 1, HEADER_SIZE, w->fp) != HEADER_SIZE)
+		w->failed = 1;
+}
+
+TraceWriter* traceCreate(const char* path, int flags, int blockRecords){
+	TraceWriter* w;
+
+	if (blockRecords <= 0)
+		blockRecords = BTRACE_BLOCK;
+	if ((w = calloc(1, sizeof(TraceWriter))) == NULL)
+		return NULL;
+	w->flags = flags & BTRACE_LZ;
+	w->blockRecords = blockRecords;
+	w->cap = blockRecords * MAX_RECORD;
+	w->raw = malloc(w->cap);
+	w->packed = malloc(w->cap);
+	w->core = -1;
+	if (w->raw == NULL || w->packed == NULL || (w->fp = fopen(path, "wb")) == NULL) {
+		free(w->raw);
+		free(w->packed);
+		free(w);
+		return NULL;
+	}
+	writeHeader(w, 0);	// rewritten by traceFinish
+	return w;
+}
+
+static void flushBlock(TraceWriter* w){
+	unsigned char header[BLOCK_HEADER];
+	unsigned long int* index;
+	int storedLen = 0;
+
+	if (w->inBlock == 0)
+		return;
+	if (w->blocks == w->indexCap) {
+		w->indexCap = w->indexCap ? 2 * w->indexCap : 64;
+		if ((index = realloc(w->index, w->indexCap * sizeof(unsigned long int))) == NULL) {
+			w->failed = 1;
+			return;
+		}
+		w->index = index;
+	}
+	w->index[w->blocks++] = ftell(w->fp);
+	if (w->flags & BTRACE_LZ)
+		storedLen = lzCompress(w->raw, w->rawLen, w->packed);
+	put32(header, w->rawLen);
+	put32(header + 4, storedLen ? storedLen : w->rawLen);
+	put32(header + 8, w->inBlock);
+	if (fwrite(header, 1, BLOCK_HEADER, w->fp) != BLOCK_HEADER ||
+		fwrite(storedLen ? w->packed : w->raw, 1, storedLen ? storedLen : w->rawLen, w->fp) !=
+		(size_t)(storedLen ? storedLen : w->rawLen))
+		w->failed = 1;
+	w->inBlock = 0;
+	w->rawLen = 0;
+	w->prevData = w->prevIp = 0;
+	w->core = -1;
+}
+
+int traceWrite(TraceWriter* w, const TraceRecord* rec){
+	int op = opCode(rec->oper), code = sizeCode(rec->size);
+	unsigned char* p = w->raw + w->rawLen;
+	unsigned long int* prev;
+
+	if (op < 0 || rec->size < 0)
+		return -1;
+	prev = op == 0 ? &w->prevIp : &w->prevData;
+	*p = op | code << 2 | (rec->core != w->core) << 5;
+	p++;
+	p += putVarint(p, zigzag((long long int)(rec->address - *prev)));
+	*prev = rec->address;
+	if (code == 0)
+		p += putVarint(p, rec->size);
+	if (rec->core != w->core) {
+		p += putVarint(p, rec->core + 1);
+		w->core = rec->core;
+	}
+	if (rec->core >= 0)
+		w->flags |= BTRACE_CORES;
+	w->rawLen = p - w->raw;
+	w->records++;
+	if (++w->inBlock == w->blockRecords)
+		flushBlock(w);
+	return w->failed ? -1 : 0;
+}
+
+int traceFinish(TraceWriter* w){
+	unsigned char buf[8];
+	unsigned long int indexOffset;
+	int failed;
+
+	flushBlock(w);
+	indexOffset = ftell(w->fp);
+	for (unsigned long int i = 0; i < w->blocks; i++) {
+		put64(buf, w->index[i]);
+		if (fwrite(buf, 1, 8, w->fp) != 8)
+			w->failed = 1;
+	}
+	rewind(w->fp);
+	writeHeader(w, indexOffset);
+	if (fclose(w->fp) != 0)
+		w->failed = 1;
+	failed = w->failed;
+	free(w->index);
+	free(w->raw);
+	free(w->packed);
+	free(w);
+	return failed ? -1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * btrace.h - Reading and writing valgrind lackey traces, as text or in
+ *     a compact binary format.
+ *
+ * A binary trace is a header, a run of blocks and a block index:
+ *
+ *   header   "CLBT", u32 version, u32 flags, u32 records per block,
+ *            u64 records, u64 offset of the index (little endian)
+ *   block    u32 encoded length, u32 stored length, u32 records, then
+ *            the stored bytes; LZ compressed if stored < encoded
+ *   index    u64 file offset of each block
+ *
+ * Each record is one byte, (op | size code << 2 | core flag << 5), a
+ * zigzag varint address delta, then a varint size when the size code
+ * is 0 and a varint core when the core flag is set. Deltas are taken
+ * from the previous 'I' address for 'I' records and from the previous
+ * data address otherwise, and every block starts again from 0, so any
+ * block decodes on its own and traceSeek can jump through the index.
+ */
+
+#ifndef BTRACE_H
+#define BTRACE_H
+
+#define BTRACE_BLOCK 4096	// default records per block
+
+#define BTRACE_LZ	0x1	// blocks may be LZ compressed
+#define BTRACE_CORES	0x2	// records carry core tags
+
+typedef struct {
+	unsigned long int address;
+	int size;
+	int core;	// thread tag, -1 when untagged
+	char oper;	// 'I', 'L', 'S' or 'M'
+	} TraceRecord;
+
+typedef struct TraceReader TraceReader;
+typedef struct TraceWriter TraceWriter;
+
+/* Open a text or binary trace, told apart by the magic; NULL on failure */
+TraceReader* traceOpen(const char* path);
+int traceIsBinary(TraceReader* r);
+/* Next record, 0 at the end or on a corrupt binary trace */
+int traceNext(TraceReader* r, TraceRecord* rec);
+/* 1 if traceNext stopped on a corrupt block rather than at the end */
+int traceFailed(TraceReader* r);
+/* Records in a binary trace, 0 for text */
+unsigned long int traceRecords(TraceReader* r);
+/* Continue from record n of a binary trace, -1 if text or out of range */
+int traceSeek(TraceReader* r, unsigned long int n);
+void traceClose(TraceReader* r);
+
+/* Start a binary trace; flags is BTRACE_LZ or 0 */
+TraceWriter* traceCreate(const char* path, int flags, int blockRecords);
+int traceWrite(TraceWriter* w, const TraceRecord* rec);
+/* Flush the last block, write the index and header and close; -1 on error */
+int traceFinish(TraceWriter* w);
+
+/* Text form of rec, in the lackey layout, into buf */
+char* traceFormat(const TraceRecord* rec, char* buf);
+
+/*
+ * LZ77 byte compressor used for blocks: returns the compressed length,
+ * or 0 if the output would not be smaller than the input
+ */
+int lzCompress(const unsigned char* src, int n, unsigned char* dst);
+/* Returns the decompressed length, or -1 if src is corrupt or exceeds cap */
+int lzDecompress(const unsigned char* src, int n, unsigned char* dst, int cap);
+
+#endif /* BTRACE_H */
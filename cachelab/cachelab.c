@@ -4,12 +4,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 #include "cachelab.h"
 #include <time.h>
 
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0; 
 
+/* The 1KB direct mapped cache with 32 byte blocks the lab grades on */
+cache_geometry_t trans_geometry = {5, 1, 5};
+
 /* 
  * printSummary - Summarize the cache simulation statistics. Student
  *                cache simulators must call this function in order to
@@ -65,7 +69,25 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N])
     }    
 }
 
-
+/*
+ * validate - Return 1 if B is the transpose of A, else print the first
+ *     wrong element of function fn and return 0
+ */
+int validate(int fn, int M, int N, int A[N][M], int B[M][N])
+{
+    int C[M][N];
+    memset(C,0,sizeof(C));
+    correctTrans(M,N,A,C);
+    for(int i=0;i<M;i++) {
+        for(int j=0;j<N;j++) {
+            if(B[i][j]!=C[i][j]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
 
 /* 
  * registerTransFunction - Add the given trans function into your list
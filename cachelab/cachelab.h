@@ -16,6 +16,15 @@ typedef struct trans_func{
     unsigned int num_evictions;
 } trans_func_t;
 
+/* Geometry of the cache the transpose functions are evaluated on */
+typedef struct cache_geometry {
+    int s;  /* set index bits */
+    int E;  /* lines per set */
+    int b;  /* block offset bits */
+} cache_geometry_t;
+
+extern cache_geometry_t trans_geometry;
+
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
@@ -30,6 +39,9 @@ void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 /* The baseline trans function that produces correct results. */
 void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 
+/* Check B against correctTrans, report the first mismatch of function fn */
+int validate(int fn, int M, int N, int A[N][M], int B[M][N]);
+
 /* Add the given function to the function list */
 void registerTransFunction(void (*trans)(int M,int N,int[N][M],int[M][N]), 
                            char* desc);
@@ -0,0 +1,287 @@
+/*
+ * cachesim.c - Set-associative LRU cache and multi-level hierarchy
+ *     model. See cachesim.h for the write and inclusion semantics.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "cachesim.h"
+
+Cache* cacheCreate(int s, int E, int b){
+	Cache* cache;
+
+	if (s < 0 || E < 1 || b < 0 || s + b >= 64)
+		return NULL;
+	cache = (Cache *)calloc(1, sizeof(Cache));
+	cache->s = s;
+	cache->E = E;
+	cache->b = b;
+	cache->setMask = ~(-1UL << s);
+	cache->set = (Set *)malloc((1UL << s) * sizeof(Set));
+	for (unsigned long int i = 0; i < (1UL << s); i++)
+		cache->set[i].line = (Line *)calloc(E, sizeof(Line));
+	return cache;
+}
+
+void cacheFree(Cache* cache){
+	if (cache == NULL)
+		return;
+	for (unsigned long int i = 0; i < (1UL << cache->s); i++)
+		free(cache->set[i].line);
+	free(cache->set);
+	free(cache);
+}
+
+Line* cacheLookup(Cache* cache, unsigned long int blockAddr){ // return NULL on a miss, LRU is not updated
+	Set* set = &cache->set[blockAddr & cache->setMask];
+	unsigned long int flag = blockAddr >> cache->s;
+
+	for (int i = 0; i < cache->E; i++)
+		if (set->line[i].valid && set->line[i].flag == flag)
+			return &set->line[i];
+	return NULL;
+}
+
+void cacheTouch(Cache* cache, Line* line){ // make line the most recently used one of its set
+	line->lru = ++cache->clock;
+}
+
+Line* cacheFill(Cache* cache, unsigned long int blockAddr, int dirty, Victim* victim){
+	// the caller has checked that blockAddr is absent
+	unsigned long int setNumber = blockAddr & cache->setMask;
+	Set* set = &cache->set[setNumber];
+	Line* line = &set->line[0];
+
+	for (int i = 0; i < cache->E; i++) { // first invalid line, else the least recently used
+		if (!set->line[i].valid) {
+			line = &set->line[i];
+			break;
+		}
+		if (set->line[i].lru < line->lru)
+			line = &set->line[i];
+	}
+
+	victim->valid = line->valid;
+	victim->dirty = line->valid && line->dirty;
+	victim->prefetched = line->valid && line->prefetched;
+	victim->blockAddr = (line->flag << cache->s) | setNumber;
+	if (line->valid) {
+		cache->stats.evictions++;
+		if (line->dirty)
+			cache->stats.writebacks++;
+	}
+
+	line->valid = 1;
+	line->dirty = dirty;
+	line->prefetched = 0;
+	line->flag = blockAddr >> cache->s;
+	cacheTouch(cache, line);
+	return line;
+}
+
+int cacheInvalidate(Cache* cache, unsigned long int blockAddr){ // return -1 if absent, else the dirty bit
+	Line* line = cacheLookup(cache, blockAddr);
+
+	if (line == NULL)
+		return -1;
+	line->valid = 0;
+	return line->dirty;
+}
+
+Hierarchy* hierCreate(Policy policy){
+	Hierarchy* h = (Hierarchy *)calloc(1, sizeof(Hierarchy));
+	h->policy = policy;
+	return h;
+}
+
+int hierAddLevel(Hierarchy* h, Cache* cache){ // return 0 on success
+	if (h->levels == MAX_LEVELS || cache == NULL)
+		return -1;
+	if (h->levels > 0 && h->level[0]->b != cache->b)
+		return -1;
+	h->level[h->levels++] = cache;
+	return 0;
+}
+
+void hierFree(Hierarchy* h){
+	for (int i = 0; i < h->levels; i++)
+		cacheFree(h->level[i]);
+	if (h->prefetcher)
+		prefetchFree(h->prefetcher);
+	free(h);
+}
+
+static Line* fillLevel(Hierarchy* h, int i, unsigned long int blockAddr, int dirty, int prefetch);
+
+static void writeBack(Hierarchy* h, int from, unsigned long int blockAddr){ // a dirty block leaves level 'from'
+	Line* line;
+
+	if (from + 1 == h->levels) {
+		h->memWrites++;
+		return;
+	}
+	if ((line = cacheLookup(h->level[from + 1], blockAddr)) != NULL)
+		line->dirty = 1;
+	else
+		fillLevel(h, from + 1, blockAddr, 1, 0); // only reachable when the outer level is not inclusive
+}
+
+static Line* fillLevel(Hierarchy* h, int i, unsigned long int blockAddr, int dirty, int prefetch){
+	Victim victim;
+	Line* line = cacheFill(h->level[i], blockAddr, dirty, &victim);
+	Line* inner;
+	int upper;
+
+	if (!victim.valid)
+		return line;
+	if (i == 0 && !prefetch) {
+		h->demandEvictions++;
+		h->demandVictim = victim.blockAddr;
+	}
+	if (i == 0 && h->prefetcher) {
+		if (victim.prefetched)
+			h->prefetcher->stats.useless++;
+		else if (prefetch)
+			pollutionMark(h->prefetcher, victim.blockAddr);
+	}
+
+	switch (h->policy) {
+		case INCLUSIVE:
+			for (int j = 0; j < i; j++) { // back-invalidate copies held by inner levels
+				if (j == 0 && h->prefetcher && (inner = cacheLookup(h->level[0], victim.blockAddr)) != NULL &&
+					inner->prefetched)
+					h->prefetcher->stats.useless++; // removed before any demand use
+				if ((upper = cacheInvalidate(h->level[j], victim.blockAddr)) != -1) {
+					h->level[j]->stats.invalidations++;
+					if (upper == 1) { // the inner copy holds the newest data
+						h->level[j]->stats.writebacks++;
+						victim.dirty = 1;
+					}
+				}
+			}
+			if (victim.dirty)
+				writeBack(h, i, victim.blockAddr);
+			break;
+		case NINE:
+			if (victim.dirty)
+				writeBack(h, i, victim.blockAddr);
+			break;
+		case EXCLUSIVE:
+			if (i + 1 < h->levels)
+				fillLevel(h, i + 1, victim.blockAddr, victim.dirty, 0);
+			else if (victim.dirty)
+				h->memWrites++;
+			break;
+	}
+	return line;
+}
+
+static Line* bringIn(Hierarchy* h, unsigned long int blockAddr, int served, Line* line, int prefetch){
+	// move a block found in level 'served' (h->levels for memory) into the L1
+	int dirty = 0;
+
+	if (served == h->levels)
+		h->memReads++;
+	else if (h->policy == EXCLUSIVE) { // the block moves up to L1
+		dirty = line->dirty;
+		line->valid = 0;
+	}
+	else
+		cacheTouch(h->level[served], line);
+
+	if (h->policy == EXCLUSIVE)
+		return fillLevel(h, 0, blockAddr, dirty, prefetch);
+	for (int i = served - 1; i >= 0; i--) // fill outer levels first so their victims never back-invalidate the new block
+		line = fillLevel(h, i, blockAddr, 0, prefetch);
+	return line;
+}
+
+static void hierPrefetch(Hierarchy* h, unsigned long int blockAddr){
+	Line* line = NULL;
+	int served;
+
+	if (cacheLookup(h->level[0], blockAddr) != NULL) {
+		h->level[0]->stats.prefetchHits++;
+		return; // already cached, nothing is issued
+	}
+	h->level[0]->stats.prefetchMisses++;
+	for (served = 1; served < h->levels; served++) {
+		if ((line = cacheLookup(h->level[served], blockAddr)) != NULL) {
+			h->level[served]->stats.prefetchHits++;
+			break;
+		}
+		h->level[served]->stats.prefetchMisses++;
+	}
+	line = bringIn(h, blockAddr, served, line, 1);
+	line->prefetched = 1;
+	line->ready = h->now + h->prefetcher->latency;
+	h->prefetcher->stats.issued++;
+}
+
+/*
+ * hierAccess - Perform one load (isWrite == 0) or store on the hierarchy.
+ *     Return the index of the level that held the block, or h->levels
+ *     when it came from memory.
+ */
+int hierAccess(Hierarchy* h, unsigned long int address, int isWrite){
+	unsigned long int blockAddr = address >> h->level[0]->b;
+	unsigned long int candidate[MAX_DEGREE];
+	Prefetcher* pf = h->prefetcher;
+	Line* line = NULL;
+	int served, trigger = 0, n;
+
+	h->now++;
+	for (served = 0; served < h->levels; served++) {
+		if ((line = cacheLookup(h->level[served], blockAddr)) != NULL) {
+			h->level[served]->stats.hits++;
+			break;
+		}
+		h->level[served]->stats.misses++;
+	}
+
+	if (served == 0) {
+		cacheTouch(h->level[0], line);
+		if (line->prefetched) { // first demand use of a prefetched line
+			if (h->now >= line->ready)
+				pf->stats.useful++;
+			else
+				pf->stats.late++;
+			line->prefetched = 0;
+			trigger = 1;
+		}
+	}
+	else {
+		if (pf && pollutionTest(pf, blockAddr))
+			pf->stats.polluting++;
+		line = bringIn(h, blockAddr, served, line, 0);
+		trigger = 1;
+	}
+
+	if (isWrite)
+		line->dirty = 1;
+	if (pf) {
+		n = prefetchCandidates(pf, h->ip, address, h->level[0]->b, trigger, candidate);
+		for (int i = 0; i < n; i++)
+			hierPrefetch(h, candidate[i]);
+	}
+	return served;
+}
+
+int parsePolicy(const char* name, Policy* policy){ // return 0 on success
+	if (strcmp(name, "inclusive") == 0)
+		*policy = INCLUSIVE;
+	else if (strcmp(name, "exclusive") == 0)
+		*policy = EXCLUSIVE;
+	else if (strcmp(name, "nine") == 0 || strcmp(name, "non-inclusive") == 0)
+		*policy = NINE;
+	else
+		return -1;
+	return 0;
+}
+
+const char* policyName(Policy policy){
+	switch (policy) {
+		case INCLUSIVE: return "inclusive";
+		case EXCLUSIVE: return "exclusive";
+		default: return "non-inclusive";
+	}
+}
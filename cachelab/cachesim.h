@@ -0,0 +1,94 @@
+/*
+ * cachesim.h - Set-associative cache and multi-level cache hierarchy
+ *     model used by csim.
+ *
+ * All levels share one block size, so a block address (address >> b)
+ * names the same block in every level. Writes are write-back and
+ * write-allocate: a store that misses fills the block and marks it
+ * dirty, and dirty blocks are written to the next level only when
+ * they leave a level.
+ */
+
+#ifndef CACHESIM_H
+#define CACHESIM_H
+
+#include "prefetch.h"
+
+#define MAX_LEVELS 4
+
+typedef struct {
+	unsigned long int flag;	// tag bits of the cached block (block address >> s)
+	int valid;
+	int dirty;		// written since it was filled into this level
+	unsigned long int lru;	// time of last use, the smallest value is the LRU line
+	int prefetched;		// filled by a prefetch and not used by a demand access yet
+	unsigned long int ready; // time the prefetched data arrives, see prefetch.h
+	char state;		// MOESI state, only used by the coherence mode
+	unsigned long int touched; // byte mask of this core's accesses, coherence mode only
+	} Line;
+
+typedef struct {
+	Line* line;
+	} Set;			// a set with E lines
+
+typedef struct {
+	unsigned long int hits;
+	unsigned long int misses;
+	unsigned long int evictions;	// valid lines replaced by a fill
+	unsigned long int writebacks;	// dirty lines that left this level
+	unsigned long int invalidations; // lines removed to keep an outer level inclusive
+	unsigned long int prefetchHits;	// prefetch lookups, kept apart from the demand hits and misses
+	unsigned long int prefetchMisses;
+	} CacheStats;
+
+typedef struct {
+	int s, E, b;
+	unsigned long int setMask;
+	unsigned long int clock;	// advanced on every use, feeds Line.lru
+	Set* set;
+	CacheStats stats;
+	} Cache;
+
+typedef struct {
+	int valid;		// a valid line was replaced
+	int dirty;
+	int prefetched;		// it was prefetched and never used
+	unsigned long int blockAddr;
+	} Victim;
+
+typedef enum {
+	INCLUSIVE,		// every block in level i is also in level i + 1
+	EXCLUSIVE,		// a block lives in exactly one level, victims move down
+	NINE			// non-inclusive non-exclusive, no back-invalidation
+	} Policy;
+
+typedef struct {
+	int levels;
+	Policy policy;
+	Cache* level[MAX_LEVELS];	// level[0] is the L1 closest to the core
+	unsigned long int memReads;
+	unsigned long int memWrites;
+	Prefetcher* prefetcher;	// optional, trains on and fills the L1
+	unsigned long int ip;	// instruction address of the current access, set by the caller
+	unsigned long int now;	// demand accesses so far
+	unsigned long int demandEvictions;	// L1 evictions by demand fills, prefetch fills left out
+	unsigned long int demandVictim;	// block address of the last of them
+	} Hierarchy;
+
+/* Single cache */
+Cache* cacheCreate(int s, int E, int b);
+void cacheFree(Cache* cache);
+Line* cacheLookup(Cache* cache, unsigned long int blockAddr);
+void cacheTouch(Cache* cache, Line* line);
+Line* cacheFill(Cache* cache, unsigned long int blockAddr, int dirty, Victim* victim);
+int cacheInvalidate(Cache* cache, unsigned long int blockAddr);
+
+/* Hierarchy, levels and the prefetcher are owned by the hierarchy once added */
+Hierarchy* hierCreate(Policy policy);
+int hierAddLevel(Hierarchy* h, Cache* cache);
+void hierFree(Hierarchy* h);
+int hierAccess(Hierarchy* h, unsigned long int address, int isWrite);
+int parsePolicy(const char* name, Policy* policy);
+const char* policyName(Policy policy);
+
+#endif /* CACHESIM_H */
@@ -0,0 +1,191 @@
+/*
+ * coherence.c - Snooping MESI/MOESI simulation over private caches.
+ *     See coherence.h for the state encoding and the false-sharing test.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "coherence.h"
+
+Coherence* coherenceCreate(int cores, int s, int E, int b, int moesi){
+	Coherence* c;
+
+	if (cores < 1 || cores > MAX_CORES)
+		return NULL;
+	c = (Coherence *)calloc(1, sizeof(Coherence));
+	c->cores = cores;
+	c->moesi = moesi;
+	for (int i = 0; i < cores; i++)
+		if ((c->cache[i] = cacheCreate(s, E, b)) == NULL) {
+			coherenceFree(c);
+			return NULL;
+		}
+	c->lineCapacity = 1024;
+	c->lines = (LineStat *)calloc(c->lineCapacity, sizeof(LineStat));
+	return c;
+}
+
+void coherenceFree(Coherence* c){
+	for (int i = 0; i < c->cores; i++)
+		cacheFree(c->cache[i]);
+	free(c->lines);
+	free(c);
+}
+
+static LineStat* lineStat(Coherence* c, unsigned long int blockAddr){ // find or add the entry of a block
+	unsigned long int i, mask;
+	LineStat* old;
+
+	if (2 * (c->lineCount + 1) > c->lineCapacity) { // keep the table at most half full
+		old = c->lines;
+		c->lineCapacity *= 2;
+		c->lines = (LineStat *)calloc(c->lineCapacity, sizeof(LineStat));
+		c->lineCount = 0;
+		for (i = 0; i < c->lineCapacity / 2; i++)
+			if (old[i].used)
+				*lineStat(c, old[i].blockAddr) = old[i];
+		free(old);
+	}
+
+	mask = c->lineCapacity - 1;
+	for (i = (blockAddr * 0x9E3779B97F4A7C15UL) >> 32 & mask; c->lines[i].used; i = (i + 1) & mask)
+		if (c->lines[i].blockAddr == blockAddr)
+			return &c->lines[i];
+	c->lines[i].used = 1;
+	c->lines[i].blockAddr = blockAddr;
+	c->lineCount++;
+	return &c->lines[i];
+}
+
+static unsigned long int byteMask(int b, unsigned long int address, int size){ // bytes of the block covered by an access
+	int shift = b > 6 ? b - 6 : 0; // blocks above 64 bytes are tracked in 64 chunks
+	unsigned long int offset = address & ((1UL << b) - 1);
+	unsigned long int first = offset >> shift;
+	unsigned long int last = (offset + (size > 0 ? size : 1) - 1) >> shift;
+	unsigned long int limit = (b > 6 ? 64 : 1UL << b) - 1;
+
+	if (last > limit)
+		last = limit; // accesses crossing a block boundary are clipped
+	if (last - first == 63)
+		return ~0UL;
+	return ((1UL << (last - first + 1)) - 1) << first;
+}
+
+static void invalidateOthers(Coherence* c, int core, unsigned long int blockAddr, unsigned long int bytes){
+	LineStat* ls;
+	Line* other;
+
+	for (int i = 0; i < c->cores; i++) {
+		if (i == core || (other = cacheLookup(c->cache[i], blockAddr)) == NULL)
+			continue;
+		ls = lineStat(c, blockAddr);
+		ls->invalidations++;
+		if ((other->touched & bytes) == 0) {
+			ls->falseSharing++;
+			c->core[core].falseSharing++;
+		}
+		c->cache[i]->stats.invalidations++;
+		c->core[core].invalidationsSent++;
+		other->valid = 0; // dirty data is handed to the writer, not to memory
+		other->dirty = 0;
+	}
+}
+
+/*
+ * coherenceAccess - One load or store by a core. Return 1 if it hit in
+ *     the core's own cache.
+ */
+int coherenceAccess(Coherence* c, int core, unsigned long int address, int size, int isWrite){
+	Cache* own = c->cache[core];
+	unsigned long int blockAddr = address >> own->b;
+	unsigned long int bytes = byteMask(own->b, address, size);
+	Line* line = cacheLookup(own, blockAddr);
+	Line* other;
+	Victim victim;
+	LineStat* ls;
+	int supplier = -1, shared = 0, hit = line != NULL;
+
+	if (hit) {
+		own->stats.hits++;
+		cacheTouch(own, line);
+		if (isWrite && (line->state == 'S' || line->state == 'O')) {
+			c->core[core].upgrades++;
+			invalidateOthers(c, core, blockAddr, bytes);
+		}
+	}
+	else {
+		own->stats.misses++;
+		for (int i = 0; i < c->cores; i++) {
+			if (i == core || (other = cacheLookup(c->cache[i], blockAddr)) == NULL)
+				continue;
+			if (other->state != 'S')
+				supplier = i; // M, O and E holders answer the snoop
+			if (!isWrite && other->state == 'M') {
+				ls = lineStat(c, blockAddr);
+				if ((other->touched & bytes) == 0) {
+					ls->falseSharing++;
+					c->core[core].falseSharing++;
+				}
+				if (c->moesi)
+					other->state = 'O';
+				else {
+					other->state = 'S';
+					other->dirty = 0;
+					c->cache[i]->stats.writebacks++;
+					c->memWrites++;
+				}
+			}
+			else if (!isWrite && other->state == 'E')
+				other->state = 'S';
+			shared = 1;
+		}
+		if (supplier >= 0) {
+			c->core[supplier].transfersOut++;
+			c->core[core].transfersIn++;
+			lineStat(c, blockAddr)->transfers++;
+		}
+		else
+			c->memReads++;
+		if (isWrite)
+			invalidateOthers(c, core, blockAddr, bytes);
+
+		line = cacheFill(own, blockAddr, 0, &victim);
+		if (victim.dirty)
+			c->memWrites++;
+		line->state = shared && !isWrite ? 'S' : 'E';
+		line->touched = 0;
+	}
+
+	if (isWrite) {
+		line->state = 'M';
+		line->dirty = 1;
+	}
+	line->touched |= bytes;
+	return hit;
+}
+
+static int compareLines(const void* x, const void* y){ // most false sharing first, then most invalidations
+	const LineStat* p = x;
+	const LineStat* q = y;
+
+	if (p->falseSharing != q->falseSharing)
+		return p->falseSharing < q->falseSharing ? 1 : -1;
+	if (p->invalidations != q->invalidations)
+		return p->invalidations < q->invalidations ? 1 : -1;
+	return p->blockAddr < q->blockAddr ? -1 : p->blockAddr > q->blockAddr;
+}
+
+/*
+ * coherenceSortedLines - Return a malloc'd copy of the per-line counters,
+ *     worst false sharing first.
+ */
+LineStat* coherenceSortedLines(Coherence* c, unsigned long int* count){
+	LineStat* out = (LineStat *)malloc((c->lineCount + 1) * sizeof(LineStat));
+	unsigned long int n = 0;
+
+	for (unsigned long int i = 0; i < c->lineCapacity; i++)
+		if (c->lines[i].used)
+			out[n++] = c->lines[i];
+	qsort(out, n, sizeof(LineStat), compareLines);
+	*count = n;
+	return out;
+}
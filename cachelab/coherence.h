@@ -0,0 +1,52 @@
+/*
+ * coherence.h - Private per-core caches kept coherent by a snooping
+ *     MESI or MOESI protocol.
+ *
+ * Every core owns one cache with the same geometry. Line.state holds
+ * the protocol state ('M', 'O', 'E', 'S'; invalid lines have valid == 0)
+ * and Line.touched records which bytes of the block the core accessed
+ * since the fill, at byte granularity for blocks up to 64 bytes. An
+ * invalidation or dirty transfer is a false-sharing event when the
+ * requesting access does not overlap the bytes the other core touched.
+ */
+
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include "cachesim.h"
+
+#define MAX_CORES 64
+
+typedef struct {
+	unsigned long int upgrades;	// writes that hit a shared or owned line
+	unsigned long int invalidationsSent;
+	unsigned long int transfersIn;	// misses served by another core's cache
+	unsigned long int transfersOut;
+	unsigned long int falseSharing;	// events this core caused
+	} CoreStats;
+
+typedef struct {
+	unsigned long int blockAddr;
+	unsigned long int invalidations;
+	unsigned long int falseSharing;
+	unsigned long int transfers;
+	int used;
+	} LineStat;		// coherence traffic of one cache line
+
+typedef struct {
+	int cores;
+	int moesi;		// 0 for MESI
+	Cache* cache[MAX_CORES];
+	CoreStats core[MAX_CORES];
+	unsigned long int memReads;
+	unsigned long int memWrites;
+	LineStat* lines;	// open addressing table keyed by block address
+	unsigned long int lineCount, lineCapacity;
+	} Coherence;
+
+Coherence* coherenceCreate(int cores, int s, int E, int b, int moesi);
+void coherenceFree(Coherence* c);
+int coherenceAccess(Coherence* c, int core, unsigned long int address, int size, int isWrite);
+LineStat* coherenceSortedLines(Coherence* c, unsigned long int* count);
+
+#endif /* COHERENCE_H */
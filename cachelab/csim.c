@@ -4,132 +4,350 @@
  */
 
 #include "cachelab.h"
+#include "libcsim.h"
+#include "coherence.h"
+#include "btrace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <getopt.h>
 #include <unistd.h>
-
-typedef struct {
-	unsigned long int flag; // 64-bit address with given s + b <= 10, so Flag would be longer than 32 bits  
-	int valid;
-	int lru;
-	} Line;		 // a line in the sets
-
-typedef struct {
-	Line* line;
-	int setStatus;	// count # of lines used in this set
-	} Set;		 	// a set with E lines
+#include <string.h>
 
 typedef struct Trace {
-	unsigned long int rawAddress;
 	unsigned long int address;
-	unsigned long int flag; 
-	// Address stores the address read from traceFile, address contains the bits without offset and flag is only flagbits
-	int setNumber;
+	unsigned long int ip;	// address of the last 'I' record, 0 if the trace has none
 	int size;
+	int core;	// thread tag of an interleaved multicore trace, -1 when untagged
 	char oper;
 	} Trace;// Use this type of struct to process each line in trace file
 
-FILE *traceFile = NULL;
-int s, b, E;
-int missCount = 0, hitCount = 0, evictionCount = 0;
-int setMask;
-unsigned long int flagMask;
+#define BATCH 4096	// records handed to cachesim_access_many at a time
 
+int nextRecord(TraceReader* r, Trace* trace){ // read the next L, S or M record, return 0 at the end of the file
+	TraceRecord rec;
 
-void updateLRU(int lineNumber, int setNumber, Set* cache){ // update the line has number as lineNumber to the most recently used line and increase others' LRU value
-    // LRU has a value range from 1 to E
-	int LRUflag = cache[setNumber].line[lineNumber].lru; // use LRU flag to control the count of LRU. LRU value smaller than flag will ++.
-	for (int i = 0; i < E; i++)
-			if (cache[setNumber].line[i].lru < LRUflag) cache[setNumber].line[i].lru++;
-	cache[setNumber].line[lineNumber].lru = 1;
+	while (traceNext(r, &rec)) {
+		if (rec.oper == 'I') { // instruction loads are not simulated, they only tag the next accesses
+			trace->ip = rec.address;
+			continue;
+		}
+		trace->address = rec.address;
+		trace->size = rec.size;
+		trace->core = rec.core;
+		trace->oper = rec.oper;
+		return 1;
+	}
+	if (traceFailed(r)) {
+		printf("Error: corrupt binary trace\n");
+		exit(1);
+	}
+	return 0;
 }
 
-int checkCache(Trace* trace, Set* cache) { // return 1 if hit
+void printOutcome(Hierarchy* h, const cachesim_outcome_t* out){ // verbose output for one record
+	for (int part = 0; part < out->parts; part++) {
+		if (h->levels == 1) { // same format as csim-ref
+			printf(out->served[part] == 0 ? "hit " : "miss ");
+			if (out->evicted[part])
+				printf("eviction ");
+			continue;
+		}
+		for (int i = 0; i < out->served[part] && i < h->levels; i++)
+			printf("L%d:miss ", i + 1);
+		if (out->served[part] < h->levels)
+			printf("L%d:hit ", out->served[part] + 1);
+	}
+}
 
-	trace->address = (trace->rawAddress >> b);
-	trace->setNumber = trace->address & setMask;
-	trace->flag = trace->address & flagMask;
+int cacheSimulator(cachesim_t* sim, TraceReader* r, int verbose){ // batched, or record by record when verbose; return 1 if the trace had 'I' records
+	cachesim_access_t batch[BATCH];
+	Trace trace;
+	size_t n = 0;
+	int sawIp = 0;
 
-	for (int i = 0; i < E; i++) 
-			if ((cache[trace->setNumber].line[i].valid == 1) && (cache[trace->setNumber].line[i].flag == trace->flag)){ 
-					updateLRU(i, trace->setNumber, cache);
-					return 1;
-			}
-	return 0;
+	trace.ip = 0;
+	while (nextRecord(r, &trace)) {
+		sawIp |= trace.ip != 0;
+		if (verbose) {
+			printf("%c %lx,%d ", trace.oper, trace.address, trace.size);
+			cachesim_set_ip(sim, trace.ip);
+			cachesim_access(sim, trace.address, trace.size, trace.oper);
+			printOutcome(cachesim_hierarchy(sim), cachesim_last(sim));
+			printf("\n");
+			continue;
+		}
+		batch[n].address = trace.address;
+		batch[n].ip = trace.ip;
+		batch[n].size = trace.size;
+		batch[n].op = trace.oper;
+		if (++n == BATCH) {
+			cachesim_access_many(sim, batch, n);
+			n = 0;
+		}
+	}
+	cachesim_access_many(sim, batch, n);
+	return sawIp;
 }
 
-void updateCache(Trace* trace, Set* cache) { // will be called only if a miss happened
-	int i = 0;
-	if (cache[trace->setNumber].setStatus < E) { // the set is not full
-		while (i < E) {
-			if (cache[trace->setNumber].line[i].valid == 0) {
-				cache[trace->setNumber].line[i].valid = 1;
-				cache[trace->setNumber].line[i].flag = trace->flag;
-				cache[trace->setNumber].line[i].lru = E;
-				updateLRU(i, trace->setNumber, cache);
-				break;
+void coherenceAccessRecord(Coherence* c, Trace* trace, int vflag){
+	int hit;
+
+	if (vflag)
+		printf("%d %c %lx,%d ", trace->core, trace->oper, trace->address, trace->size);
+	hit = coherenceAccess(c, trace->core, trace->address, trace->size, trace->oper == 'S');
+	if (vflag)
+		printf(hit ? "hit " : "miss ");
+	if (trace->oper == 'M') {
+		hit = coherenceAccess(c, trace->core, trace->address, trace->size, 1);
+		if (vflag)
+			printf(hit ? "hit " : "miss ");
+	}
+	if (vflag)
+		printf("\n");
+}
+
+int coherenceSimulator(Coherence* c, TraceReader** traceFiles, int traceCount, int vflag){ // one tagged trace, or one per core interleaved record by record
+	Trace trace;
+	int open = traceCount;
+
+	trace.ip = 0;
+	if (traceCount == 1) {
+		while (nextRecord(traceFiles[0], &trace)) {
+			if (trace.core < 0) {
+				printf("Error: untagged record %c %lx,%d in a single multicore trace\n", trace.oper, trace.address, trace.size);
+				return 1;
 			}
-			i++;
+			if (trace.core >= c->cores) {
+				printf("Error: core tag %d outside 0..%d\n", trace.core, c->cores - 1);
+				return 1;
+			}
+			coherenceAccessRecord(c, &trace, vflag);
 		}
-		cache[trace->setNumber].setStatus++;
+		return 0;
 	}
-	else // the set is full and eviction is required
-		for (i = 0; i < E; i++)
-			if (cache[trace->setNumber].line[i].lru == E) {
-				cache[trace->setNumber].line[i].flag = trace->flag;
-				updateLRU(i, trace->setNumber, cache);
-				evictionCount++;
-				break;
+	while (open > 0)
+		for (int i = 0; i < traceCount; i++) {
+			if (traceFiles[i] == NULL)
+				continue;
+			if (!nextRecord(traceFiles[i], &trace)) {
+				traceClose(traceFiles[i]);
+				traceFiles[i] = NULL;
+				open--;
+				continue;
 			}
+			trace.core = i;
+			coherenceAccessRecord(c, &trace, vflag);
+		}
+	return 0;
 }
- 	
-int cacheSimulator(){
-	Set* cache;
-	cache = (Set *)malloc((1 << s) * sizeof(Set));
-	Trace trace;
 
-	for (int i = 0; i < (1 << s); i++) {
-		cache[i].line = (Line *)malloc(E * sizeof(Line));
-		cache[i].setStatus = 0;
+void printCoherence(Coherence* c){ // per-core traffic and the lines with the most false sharing
+	unsigned long int count, hits = 0, misses = 0, evictions = 0;
+	LineStat* lines = coherenceSortedLines(c, &count);
+	CacheStats* st;
+	CoreStats* cs;
+
+	printf("protocol:%s cores:%d\n", c->moesi ? "MOESI" : "MESI", c->cores);
+	for (int i = 0; i < c->cores; i++) {
+		st = &c->cache[i]->stats;
+		cs = &c->core[i];
+		printf("core %d: hits:%lu misses:%lu evictions:%lu writebacks:%lu invalidated:%lu "
+			"upgrades:%lu invalidations-sent:%lu transfers-in:%lu transfers-out:%lu false-sharing:%lu\n",
+			i, st->hits, st->misses, st->evictions, st->writebacks, st->invalidations,
+			cs->upgrades, cs->invalidationsSent, cs->transfersIn, cs->transfersOut, cs->falseSharing);
+		hits += st->hits;
+		misses += st->misses;
+		evictions += st->evictions;
 	}
+	printf("memory: reads:%lu writes:%lu\n", c->memReads, c->memWrites);
+	printf("contended lines (top %d of %lu):\n", count < 10 ? (int)count : 10, count);
+	for (unsigned long int i = 0; i < count && i < 10; i++)
+		printf("  %lx: invalidations:%lu false-sharing:%lu transfers:%lu\n",
+			lines[i].blockAddr << c->cache[0]->b,
+			lines[i].invalidations, lines[i].falseSharing, lines[i].transfers);
+	free(lines);
+	printSummary(hits, misses, evictions);
+}
+
+void printLevels(Hierarchy* h, cachesim_stats_t* stats){ // per-level report for the hierarchy mode
+	CacheStats* st;
+
+	printf("policy:%s\n", policyName(h->policy));
+	for (int i = 0; i < h->levels; i++) {
+		st = &stats->level[i];
+		printf("L%d (s=%d, E=%d, b=%d): hits:%lu misses:%lu evictions:%lu writebacks:%lu invalidations:%lu\n",
+			i + 1, h->level[i]->s, h->level[i]->E, h->level[i]->b,
+			st->hits, st->misses, st->evictions, st->writebacks, st->invalidations);
+		if (h->prefetcher)
+			printf("   prefetch lookups: hits:%lu misses:%lu\n", st->prefetchHits, st->prefetchMisses);
+	}
+	printf("memory: reads:%lu writes:%lu\n", stats->mem_reads, stats->mem_writes);
+}
+
+void printPrefetch(Prefetcher* pf){
+	PrefetchStats* st = &pf->stats;
+
+	printf("prefetch (%s, degree %d, distance %d, latency %d): issued:%lu useful:%lu late:%lu useless:%lu polluting:%lu\n",
+		prefetcherName(pf->kind), pf->degree, pf->distance, pf->latency,
+		st->issued, st->useful, st->late, st->useless, st->polluting);
+}
+
+void printMissStats(const char* name, MissStats* st){
+	printf("  %-12s accesses:%lu hits:%lu compulsory:%lu capacity:%lu conflict:%lu\n",
+		name, st->accesses, st->hits, st->compulsory, st->capacity, st->conflict);
+}
+
+void printAttribution(Attribution* a){ // 3C totals, per range, who evicts whom, hottest sets and a set heatmap
+	const char* shades = " .:-=+*#%@";
+	unsigned long int sets = 1UL << a->s, max = 0, misses;
+	unsigned long int* order;
+	int hot;
+
+	printf("3C attribution:\n");
+	printMissStats("total", &a->total);
+	for (int i = 0; i <= a->ranges; i++)
+		if (i < a->ranges || a->range[i].stats.accesses > 0)
+			printMissStats(a->range[i].name, &a->range[i].stats);
+	if (a->ranges > 0) {
+		printf("conflict misses by victim range (row missed, column evicted):\n  %-12s", "");
+		for (int j = 0; j <= a->ranges; j++)
+			printf(" %10.10s", a->range[j].name);
+		printf("\n");
+		for (int i = 0; i <= a->ranges; i++) {
+			printf("  %-12s", a->range[i].name);
+			for (int j = 0; j <= a->ranges; j++)
+				printf(" %10lu", a->evicted[i][j]);
+			printf("\n");
+		}
+	}
+
+	if ((order = malloc(sets * sizeof(unsigned long int))) == NULL)
+		return;
+	for (unsigned long int i = 0; i < sets; i++) { // selection of the 16 sets with the most misses
+		order[i] = i;
+		misses = a->set[i].accesses - a->set[i].hits;
+		if (misses > max)
+			max = misses;
+	}
+	hot = sets < 16 ? (int)sets : 16;
+	for (int i = 0; i < hot; i++)
+		for (unsigned long int j = i + 1; j < sets; j++)
+			if (a->set[order[j]].accesses - a->set[order[j]].hits >
+				a->set[order[i]].accesses - a->set[order[i]].hits) {
+				misses = order[i];
+				order[i] = order[j];
+				order[j] = misses;
+			}
+	printf("hottest sets:\n");
+	for (int i = 0; i < hot && a->set[order[i]].accesses > a->set[order[i]].hits; i++) {
+		char name[16];
+
+		sprintf(name, "set %lu", order[i]);
+		printMissStats(name, &a->set[order[i]]);
+	}
+	free(order);
+
+	printf("set misses heatmap (\"%s\" from 0 to %lu, 32 sets per row):\n", shades, max);
+	for (unsigned long int i = 0; i < sets; i++) {
+		misses = a->set[i].accesses - a->set[i].hits;
+		if (i % 32 == 0)
+			printf("  %5lu |", i);
+		putchar(shades[max ? (misses * 9 + max - 1) / max : 0]);
+		if (i % 32 == 31 || i == sets - 1)
+			printf("|\n");
+	}
+}
+
+void printEstimate(const char* name, Estimate* e){
+	printf(" %s:%.0f", name, e->value);
+	if (e->se >= 0)
+		printf(" (se %.0f)", e->se);
+}
+
+void printSampling(Sampler* sp, unsigned long int accesses){ // L1 estimates with their standard errors
+	Estimate hits, misses, evictions;
+
+	samplerEstimate(sp, accesses, &hits, &misses, &evictions);
+	printf("sampled %lu of %lu sets (%.2f%%), estimates:", sp->sampled, sp->sets,
+		100.0 * sp->sampled / sp->sets);
+	printEstimate("hits", &hits);
+	printEstimate("misses", &misses);
+	printEstimate("evictions", &evictions);
+	printf("\n");
+}
+
+void printTlbLevel(const char* name, Cache* level){
+	printf("%s (%d entries, %d-way): hits:%lu misses:%lu\n", name, level->E << level->s, level->E,
+		level->stats.hits, level->stats.misses);
+}
+
+void printTlb(Tlb* t){
+	static const char* pageNames[] = {[12] = "4KB", [21] = "2MB", [30] = "1GB"};
+
+	printf("tlb (%s pages): translations:%lu\n", pageNames[t->pageBits], t->stats.accesses);
+	printTlbLevel("dTLB", t->dtlb);
+	if (t->stlb)
+		printTlbLevel("STLB", t->stlb);
+	printf("page walks:%lu references:%lu psc-hits:%lu\n", t->stats.walks, t->stats.walkRefs, t->stats.pscHits);
+}
+
+void usage(char *argv[]){
+	printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+	printf("       %s [-hv] -L <s:E:b> [-L <s:E:b> ...] [-i <policy>] -t <file>\n", argv[0]);
+	printf("       %s [-hv] -c <cores> [-m <protocol>] -s <num> -E <num> -b <num> -t <file> [-t <file> ...]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h           Print this help message.\n");
+	printf("  -v           Optional verbose flag.\n");
+	printf("  -s <num>     Number of set index bits.\n");
+	printf("  -E <num>     Number of lines per set.\n");
+	printf("  -b <num>     Number of block offset bits.\n");
+	printf("  -t <file>    Trace file, text or binary (see tracecvt), repeat to give one trace per core.\n");
+	printf("  -L <s:E:b>   Add a cache level, L1 first (max %d, same b for all).\n", MAX_LEVELS);
+	printf("  -i <policy>  Inclusion policy: inclusive, exclusive or nine (default inclusive).\n");
+	printf("               inclusive needs every level to hold at least as many lines as the one before.\n");
+	printf("  -c <cores>   Simulate private coherent caches; a single trace is tagged \"<core> L addr,size\".\n");
+	printf("  -m <proto>   Coherence protocol: mesi or moesi (default mesi).\n");
+	printf("  -p <kind>    L1 prefetcher: next, stride or stream (default none).\n");
+	printf("               stride is indexed by the preceding I record, so it needs a trace that has them.\n");
+	printf("  -d <num>     Prefetch degree, blocks per trigger (default 1, max %d).\n", MAX_DEGREE);
+	printf("  -D <num>     Prefetch distance, blocks skipped ahead (default 0).\n");
+	printf("  -l <num>     Prefetch latency in demand accesses (default 10).\n");
+	printf("  -a           Split L1 misses into compulsory, capacity and conflict, per set and range.\n");
+	printf("  -r <n:lo:hi> Name the address range [lo, hi) (hex) for -a, repeatable (max %d).\n", MAX_RANGES);
+	printf("  -R <file>    Read \"name lo hi\" ranges for -a from file, as tracegen writes to .ranges.\n");
+	printf("  -S <rate>    Simulate only this fraction of the sets and estimate the counts.\n");
+	printf("  -T <e:w[:e:w]> Model a dTLB, and an STLB, of e entries and w ways (default 64:4:1536:12).\n");
+	printf("  -P <size>    Page size for -T: 4k, 2m or 1g (default 4k); either option enables the TLB.\n");
+	printf("\nExamples:\n");
+	printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+	printf("  linux>  %s -L 6:8:6 -L 10:4:6 -L 13:16:6 -i exclusive -t traces/long.trace\n", argv[0]);
+	printf("  linux>  %s -p stride -d 2 -s 5 -E 1 -b 5 -t traces/trans.trace\n", argv[0]);
+	printf("  linux>  %s -a -R .ranges -s 5 -E 1 -b 5 -t trace.f0\n", argv[0]);
+	printf("  linux>  %s -S 0.1 -s 10 -E 4 -b 6 -t long.btrace\n", argv[0]);
+	printf("  linux>  %s -T 64:4:1536:12 -P 2m -s 5 -E 1 -b 5 -t traces/trans.trace\n", argv[0]);
+	printf("  linux>  %s -m moesi -s 6 -E 8 -b 6 -t thread0.trace -t thread1.trace\n", argv[0]);
+}
 
-	while (fscanf(traceFile,"%c %lx,%d", &trace.oper, &trace.rawAddress, &trace.size) != EOF) {
-		switch(trace.oper) {
-			case 'L':
-			case 'S':
-				if (checkCache(&trace, cache) == 1) {hitCount++;}
-					else {
-						missCount++;
-						updateCache(&trace, cache);
-					}
-				break;
-			case 'M':
-				if (checkCache(&trace, cache) == 1) {hitCount += 2;}
-					else {
-						missCount++;
-						updateCache(&trace, cache);
-						hitCount++;
-					}
-				break;
-			case 'I':
-			default:
-				break;
-			} // switch case end
-	} // while loop end
-	return 0;
-	for (int i = 0; i < s; i++)
-		free(cache[i].line);
-	free(cache);
-}	
 
 int main(int argc, char **argv){
 	int hflag = 0, vflag = 0;
 	char *argString = NULL;
 	char *tracePath = NULL;
+	TraceReader *traceFiles[MAX_CORES];	// text or binary, one per core when several -t are given
+	int traceCount = 0;
+	int s = 0, E = 0, b = 0, levels = 0, levelB[MAX_LEVELS];
+	int cores = 0, moesi = 0;
+	cachesim_config_t config;
+	cachesim_stats_t stats;
+	cachesim_t* sim;
+	Coherence* coherence;
+	int rangeCount = 0;
+	char *rangeSpec[MAX_RANGES], *rangeFile = NULL;
+	const char* error;
 
+	cachesim_config_init(&config);
 	int c;
-	while ((c = getopt(argc, argv, "vhs:E:b:t:")) != -1){
+	while ((c = getopt(argc, argv, "vhs:E:b:t:L:i:c:m:p:d:D:l:ar:R:S:T:P:")) != -1){
 		switch(c){
 			case 'v':
 				vflag = 1;
@@ -151,20 +369,167 @@ int main(int argc, char **argv){
 				break;
 			case 't':
 				tracePath = optarg;
-				traceFile = fopen(tracePath, "r");
+				if (traceCount == MAX_CORES || (traceFiles[traceCount] = traceOpen(tracePath)) == NULL) {
+					printf("Error: cannot open trace file \"%s\"\n", tracePath);
+					return 1;
+				}
+				traceCount++;
+				break;
+			case 'L':
+				if (levels == MAX_LEVELS ||
+					sscanf(optarg, "%d:%d:%d", &config.s[levels], &config.E[levels], &levelB[levels]) != 3) {
+					printf("Error: bad cache level \"%s\"\n", optarg);
+					return 1;
+				}
+				levels++;
+				break;
+			case 'i':
+				if (parsePolicy(optarg, &config.policy) != 0) {
+					printf("Error: unknown inclusion policy \"%s\"\n", optarg);
+					return 1;
+				}
+				break;
+			case 'c':
+				cores = atoi(optarg);
+				break;
+			case 'm':
+				if (strcmp(optarg, "mesi") != 0 && strcmp(optarg, "moesi") != 0) {
+					printf("Error: unknown coherence protocol \"%s\"\n", optarg);
+					return 1;
+				}
+				moesi = optarg[1] == 'o';
+				break;
+			case 'p':
+				if (parsePrefetcher(optarg, &config.prefetch) != 0) {
+					printf("Error: unknown prefetcher \"%s\"\n", optarg);
+					return 1;
+				}
+				break;
+			case 'd':
+				config.degree = atoi(optarg);
+				break;
+			case 'D':
+				config.distance = atoi(optarg);
+				break;
+			case 'l':
+				config.latency = atoi(optarg);
+				break;
+			case 'a':
+				config.attribute = 1;
+				break;
+			case 'r':
+				if (rangeCount == MAX_RANGES) {
+					printf("Error: more than %d address ranges\n", MAX_RANGES);
+					return 1;
+				}
+				rangeSpec[rangeCount++] = optarg;
+				break;
+			case 'R':
+				rangeFile = optarg;
+				break;
+			case 'S':
+				config.sample_rate = atof(optarg);
+				break;
+			case 'T':
+				config.stlb_entries = 0;
+				if (sscanf(optarg, "%d:%d:%d:%d", &config.dtlb_entries, &config.dtlb_ways,
+					&config.stlb_entries, &config.stlb_ways) < 2) {
+					printf("Error: bad TLB geometry \"%s\"\n", optarg);
+					return 1;
+				}
+				config.tlb = 1;
+				break;
+			case 'P':
+				if ((config.page_bits = parsePageSize(optarg)) < 0) {
+					printf("Error: unknown page size \"%s\"\n", optarg);
+					return 1;
+				}
+				config.tlb = 1;
 				break;
 			case '?':
 			default:
-				printf("%s", "Error");
+				usage(argv);
 				return 1;
 			}
 	}
 
-	setMask = ~ (-1 << s);
-	flagMask =(unsigned long int) -1 << s;
+	if (hflag) {
+		usage(argv);
+		return 0;
+	}
+	if (traceCount == 0) {
+		printf("Error: missing or unreadable trace file\n");
+		usage(argv);
+		return 1;
+	}
+
+	if (cores > 0 || traceCount > 1) { // coherence mode
+		if (cores == 0)
+			cores = traceCount;
+		if (levels > 0 || config.tlb || (traceCount > 1 && traceCount != cores) ||
+			(coherence = coherenceCreate(cores, s, E, b, moesi)) == NULL) {
+			printf("Error: coherence mode needs -s/-E/-b, up to %d cores and one trace or one per core\n", MAX_CORES);
+			return 1;
+		}
+		if (coherenceSimulator(coherence, traceFiles, traceCount, vflag) != 0)
+			return 1;
+		printCoherence(coherence);
+		coherenceFree(coherence);
+		return 0;
+	}
+
+	if (levels == 0) {
+		config.s[0] = s;
+		config.E[0] = E;
+		config.b = b;
+	}
+	else {
+		config.levels = levels;
+		config.b = levelB[0];
+		for (int i = 1; i < levels; i++)
+			if (levelB[i] != config.b) {
+				printf("Error: invalid geometry for L%d (levels must share one block size)\n", i + 1);
+				return 1;
+			}
+	}
+	if (config.sample_rate > 0 && vflag) {
+		printf("Error: -S cannot be combined with -v\n");
+		return 1;
+	}
+	if ((rangeCount > 0 || rangeFile) && !config.attribute) {
+		printf("Error: -r and -R need -a\n");
+		return 1;
+	}
+	if ((sim = cachesim_create(&config, &error)) == NULL) {
+		printf("Error: %s\n", error);
+		return 1;
+	}
+	for (int i = 0; i < rangeCount; i++)
+		if (attribParseRange(cachesim_attribution(sim), rangeSpec[i]) != 0) {
+			printf("Error: bad address range \"%s\"\n", rangeSpec[i]);
+			return 1;
+		}
+	if (rangeFile && attribLoadRanges(cachesim_attribution(sim), rangeFile) != 0) {
+		printf("Error: cannot read address ranges from \"%s\"\n", rangeFile);
+		return 1;
+	}
 
-	cacheSimulator();
-	printSummary(hitCount, missCount, evictionCount);
-	fclose(traceFile);
+	if (!cacheSimulator(sim, traceFiles[0], vflag) && config.prefetch == PF_STRIDE)
+		printf("Warning: the trace has no I records, so ip-stride saw every access as one instruction\n");
+	cachesim_stats(sim, &stats);
+	if (cachesim_sampler(sim))
+		printSampling(cachesim_sampler(sim), stats.accesses);
+	if (levels > 0)
+		printLevels(cachesim_hierarchy(sim), &stats);
+	if (config.prefetch != PF_NONE)
+		printPrefetch(cachesim_hierarchy(sim)->prefetcher);
+	if (cachesim_tlb(sim))
+		printTlb(cachesim_tlb(sim));
+	if (cachesim_attribution(sim))
+		printAttribution(cachesim_attribution(sim));
+	if (!cachesim_sampler(sim)) // estimates are not counts, they stay out of the summary
+		printSummary(stats.level[0].hits, stats.level[0].misses, stats.level[0].evictions);
+	cachesim_free(sim);
+	traceClose(traceFiles[0]);
 	return 0;
 }
@@ -0,0 +1,219 @@
+/*
+ * kernel.c - Kernel signatures, reference kernels and the registry,
+ *     see kernel.h
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "kernel.h"
+
+kernel_func_t kernel_list[MAX_KERNELS];
+int kernel_count = 0;
+
+/* Set while registerKernelsSim runs: fill .sim of the entries in order */
+static int sim_pass = 0;
+static int sim_next = 0;
+
+void registerKernels(void);
+void registerKernelsSim(void);
+
+void registerKernel(const kernel_sig_t *sig, kernel_fn_t fn, char *desc)
+{
+    if (sim_pass) {
+        if (sim_next < kernel_count)
+            kernel_list[sim_next++].sim = fn;
+        return;
+    }
+    if (kernel_count == MAX_KERNELS)
+        return;
+    kernel_list[kernel_count].sig = sig;
+    kernel_list[kernel_count].native = fn;
+    kernel_list[kernel_count].sim = NULL;
+    kernel_list[kernel_count].description = desc;
+    kernel_count++;
+}
+
+void registerAllKernels(void)
+{
+    registerKernels();
+    sim_pass = 1;
+    sim_next = 0;
+    registerKernelsSim();
+    sim_pass = 0;
+}
+
+/* Small values, so int matmul sums cannot overflow */
+static int *random_ints(size_t n)
+{
+    int *a = malloc(n * sizeof(int));
+    size_t i;
+
+    if (a != NULL)
+        for (i = 0; i < n; i++)
+            a[i] = rand() % 16;
+    return a;
+}
+
+/* A random permutation of 0..n-1, so scatter writes each element once */
+static int *random_perm(size_t n)
+{
+    int *a = malloc(n * sizeof(int));
+    size_t i, j;
+    int t;
+
+    if (a == NULL)
+        return NULL;
+    for (i = 0; i < n; i++)
+        a[i] = i;
+    for (i = n - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+    }
+    return a;
+}
+
+/*
+ * Matmul
+ */
+static void matmul_ref(int n, int A[n][n], int B[n][n], int C[n][n])
+{
+    int i, j, k, sum;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            sum = 0;
+            for (k = 0; k < n; k++)
+                sum += A[i][k] * B[k][j];
+            C[i][j] = sum;
+        }
+}
+
+static void matmul_setup(kernel_problem_t *p)
+{
+    p->out_len = (size_t)p->size * p->size;
+    p->in = random_ints(p->out_len);
+    p->in2 = random_ints(p->out_len);
+}
+
+static void matmul_run(kernel_fn_t fn, kernel_problem_t *p)
+{
+    int n = p->size;
+    ((matmul_fn_t)fn)(n, (int (*)[n])p->in, (int (*)[n])p->in2, (int (*)[n])p->out);
+}
+
+const kernel_sig_t matmul_sig = {
+    "matmul", 48, 512, matmul_setup, matmul_run, (kernel_fn_t)matmul_ref
+};
+
+/*
+ * Stencil
+ */
+static void stencil_ref(int M, int N, int A[N][M], int B[N][M])
+{
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                B[i][j] = A[i][j];
+            else
+                B[i][j] = A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+}
+
+static void stencil_setup(kernel_problem_t *p)
+{
+    p->out_len = (size_t)p->size * p->size;
+    p->in = random_ints(p->out_len);
+}
+
+static void stencil_run(kernel_fn_t fn, kernel_problem_t *p)
+{
+    int n = p->size;
+    ((stencil_fn_t)fn)(n, n, (int (*)[n])p->in, (int (*)[n])p->out);
+}
+
+const kernel_sig_t stencil_sig = {
+    "stencil", 128, 2048, stencil_setup, stencil_run, (kernel_fn_t)stencil_ref
+};
+
+/*
+ * Gather and scatter
+ */
+static void gather_ref(int n, const int *src, const int *idx, int *dst)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = src[idx[i]];
+}
+
+static void scatter_ref(int n, const int *src, const int *idx, int *dst)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        dst[idx[i]] = src[i];
+}
+
+static void index_setup(kernel_problem_t *p)
+{
+    p->out_len = (size_t)p->size * p->size;
+    p->in = random_ints(p->out_len);
+    p->idx = random_perm(p->out_len);
+}
+
+static void index_run(kernel_fn_t fn, kernel_problem_t *p)
+{
+    ((index_fn_t)fn)(p->out_len, p->in, p->idx, p->out);
+}
+
+const kernel_sig_t gather_sig = {
+    "gather", 128, 2048, index_setup, index_run, (kernel_fn_t)gather_ref
+};
+
+const kernel_sig_t scatter_sig = {
+    "scatter", 128, 2048, index_setup, index_run, (kernel_fn_t)scatter_ref
+};
+
+/*
+ * Problems
+ */
+int kernelSetup(const kernel_sig_t *sig, kernel_problem_t *p, int size)
+{
+    memset(p, 0, sizeof(*p));
+    p->size = size;
+    sig->setup(p);
+    p->out = malloc(p->out_len * sizeof(int));
+    p->expect = malloc(p->out_len * sizeof(int));
+    if (p->in == NULL || p->out == NULL || p->expect == NULL ||
+        (sig->setup == matmul_setup && p->in2 == NULL) ||
+        (sig->setup == index_setup && p->idx == NULL)) {
+        kernelFree(p);
+        return 0;
+    }
+    kernelPoison(p);
+    sig->run(sig->reference, p);
+    memcpy(p->expect, p->out, p->out_len * sizeof(int));
+    return 1;
+}
+
+void kernelPoison(kernel_problem_t *p)
+{
+    memset(p->out, 0x5a, p->out_len * sizeof(int));
+}
+
+int kernelCheck(const kernel_problem_t *p)
+{
+    return memcmp(p->out, p->expect, p->out_len * sizeof(int)) == 0;
+}
+
+void kernelFree(kernel_problem_t *p)
+{
+    free(p->in);
+    free(p->in2);
+    free(p->idx);
+    free(p->out);
+    free(p->expect);
+    memset(p, 0, sizeof(*p));
+}
@@ -0,0 +1,83 @@
+/*
+ * kernel.h - Registry of blocked kernels beyond transpose, evaluated by
+ *     test-kernels the way test-trans evaluates trans.c.
+ *
+ * Each kernel has a signature (matmul, stencil, gather, scatter) that
+ * knows how to build a problem of a given size, call a kernel of that
+ * signature on it, and compute the expected output with a reference
+ * kernel. kernels.c is compiled twice, plain and instrumented for
+ * tracesim; its registerKernels is renamed registerKernelsSim in the
+ * instrumented copy, and the two passes fill the native and simulated
+ * entry points of the same list in the same order.
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stddef.h>
+
+#define MAX_KERNELS 100
+
+/* Any kernel, cast to its signature's type before the call */
+typedef void (*kernel_fn_t)(void);
+
+/* C = A B, all n x n */
+typedef void (*matmul_fn_t)(int n, int A[n][n], int B[n][n], int C[n][n]);
+/* B = 5-point sum of A on the interior, A on the border, both N x M */
+typedef void (*stencil_fn_t)(int M, int N, int A[N][M], int B[N][M]);
+/* dst[i] = src[idx[i]] (gather) or dst[idx[i]] = src[i] (scatter) */
+typedef void (*index_fn_t)(int n, const int *src, const int *idx, int *dst);
+
+/*
+ * A problem instance. size is the side of a square matrix; gather and
+ * scatter move size * size elements, so sizes compare across signatures.
+ */
+typedef struct kernel_problem {
+    int size;
+    int *in, *in2, *idx;        /* inputs, unused ones NULL */
+    int *out;                   /* written by the kernel */
+    int *expect;                /* written by the reference */
+    size_t out_len;             /* elements of out and expect */
+} kernel_problem_t;
+
+typedef struct kernel_sig {
+    const char *name;
+    int sim_size;               /* default size under the simulator */
+    int native_size;            /* default size when timed */
+    void (*setup)(kernel_problem_t *p);  /* fill inputs, set out_len */
+    void (*run)(kernel_fn_t fn, kernel_problem_t *p);
+    kernel_fn_t reference;
+} kernel_sig_t;
+
+extern const kernel_sig_t matmul_sig, stencil_sig, gather_sig, scatter_sig;
+
+typedef struct kernel_func {
+    const kernel_sig_t *sig;
+    kernel_fn_t native;         /* from kernels.o */
+    kernel_fn_t sim;            /* from kernels-inst.o */
+    char *description;
+} kernel_func_t;
+
+extern kernel_func_t kernel_list[MAX_KERNELS];
+extern int kernel_count;
+
+/* Add a kernel of the given signature to kernel_list */
+void registerKernel(const kernel_sig_t *sig, kernel_fn_t fn, char *desc);
+
+#define registerMatmul(fn, desc)  registerKernel(&matmul_sig, (kernel_fn_t)(fn), desc)
+#define registerStencil(fn, desc) registerKernel(&stencil_sig, (kernel_fn_t)(fn), desc)
+#define registerGather(fn, desc)  registerKernel(&gather_sig, (kernel_fn_t)(fn), desc)
+#define registerScatter(fn, desc) registerKernel(&scatter_sig, (kernel_fn_t)(fn), desc)
+
+/* Register kernels.c, both passes */
+void registerAllKernels(void);
+
+/* Build a problem of the given size with its expected output; 0 if out of memory */
+int kernelSetup(const kernel_sig_t *sig, kernel_problem_t *p, int size);
+/* Fill out with garbage, so a kernel that skips an element fails */
+void kernelPoison(kernel_problem_t *p);
+/* 1 if out matches expect */
+int kernelCheck(const kernel_problem_t *p);
+void kernelFree(kernel_problem_t *p);
+
+#endif /* KERNEL_H */
@@ -0,0 +1,308 @@
+/*
+ * kernels.c - Blocked kernels beyond transpose, with the naive versions
+ *     they are measured against.
+ *
+ * Each kernel must have the prototype of its signature in kernel.h and
+ * be registered in registerKernels. Kernels are static: this file is
+ * also compiled with tracesim hooks under another registerKernels name,
+ * and both copies are linked into test-kernels.
+ *
+ * Blocked kernels size their tiles from trans_geometry, the cache
+ * test-kernels is simulating or timing. The eight-wide kernels do not:
+ * they hold eight ints in locals, one 32-byte line (b = 5), since a
+ * buffer sized from the geometry would be memory that tracesim traces.
+ * On wider lines they miss once per eight elements, not once per line.
+ */
+#include <stdint.h>
+#include "cachelab.h"
+#include "kernel.h"
+
+/* Ints in the cache described by trans_geometry */
+static int cache_ints(void)
+{
+    return trans_geometry.E * (1 << (trans_geometry.s + trans_geometry.b)) / (int)sizeof(int);
+}
+
+/* Ints in one cache block, at least 1 */
+static int block_ints(void)
+{
+    int n = (1 << trans_geometry.b) / (int)sizeof(int);
+    return n > 0 ? n : 1;
+}
+
+/*
+ * Matrix multiply
+ */
+static char matmul_ijk_desc[] = "Naive ijk matmul";
+static void matmul_ijk(int n, int A[n][n], int B[n][n], int C[n][n])
+{
+    int i, j, k, sum;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            sum = 0;
+            for (k = 0; k < n; k++)
+                sum += A[i][k] * B[k][j];
+            C[i][j] = sum;
+        }
+}
+
+static char matmul_ikj_desc[] = "Row-streaming ikj matmul";
+static void matmul_ikj(int n, int A[n][n], int B[n][n], int C[n][n])
+{
+    int i, j, k, a;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++)
+            C[i][j] = 0;
+        for (k = 0; k < n; k++) {
+            a = A[i][k];
+            for (j = 0; j < n; j++)
+                C[i][j] += a * B[k][j];
+        }
+    }
+}
+
+/*
+ * matmul_blocked - ikj over T x T tiles, T the largest multiple of a
+ *     block such that a tile of A, B and C fit in the cache together
+ */
+static char matmul_blocked_desc[] = "Blocked ikj matmul";
+static void matmul_blocked(int n, int A[n][n], int B[n][n], int C[n][n])
+{
+    int bi = block_ints(), T = bi;
+    int i, j, k, i0, j0, k0, i1, j1, k1, a;
+
+    while ((T + bi) * (T + bi) * 3 <= cache_ints())
+        T += bi;
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            C[i][j] = 0;
+    for (i0 = 0; i0 < n; i0 += T)
+        for (k0 = 0; k0 < n; k0 += T)
+            for (j0 = 0; j0 < n; j0 += T) {
+                i1 = i0 + T < n ? i0 + T : n;
+                k1 = k0 + T < n ? k0 + T : n;
+                j1 = j0 + T < n ? j0 + T : n;
+                for (i = i0; i < i1; i++)
+                    for (k = k0; k < k1; k++) {
+                        a = A[i][k];
+                        for (j = j0; j < j1; j++)
+                            C[i][j] += a * B[k][j];
+                    }
+            }
+}
+
+/*
+ * 2-D 5-point stencil
+ */
+static char stencil_rows_desc[] = "Row-order 5-point stencil";
+static void stencil_rows(int M, int N, int A[N][M], int B[N][M])
+{
+    int i, j;
+
+    for (j = 0; j < M; j++)
+        B[0][j] = A[0][j];
+    for (i = 1; i < N - 1; i++) {
+        B[i][0] = A[i][0];
+        for (j = 1; j < M - 1; j++)
+            B[i][j] = A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+        if (M > 1)
+            B[i][M - 1] = A[i][M - 1];
+    }
+    if (N > 1)
+        for (j = 0; j < M; j++)
+            B[N - 1][j] = A[N - 1][j];
+}
+
+static char stencil_cols_desc[] = "Column-order 5-point stencil";
+static void stencil_cols(int M, int N, int A[N][M], int B[N][M])
+{
+    int i, j;
+
+    for (j = 0; j < M; j++)
+        for (i = 0; i < N; i++)
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                B[i][j] = A[i][j];
+            else
+                B[i][j] = A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+}
+
+/*
+ * stencil_lines - Row order, eight columns at a time from a 32-byte
+ *     boundary of A. The rows above and below are summed into locals
+ *     before the row itself is read: on a cache where they map to the
+ *     same sets, as any two rows do under a direct-mapped cache of two
+ *     rows or less, each is missed once per eight columns rather than
+ *     once per column. Strip-mining cannot help there, since no strip
+ *     keeps rows i - 1 and i + 1 apart. Assumes 32-byte lines; see the
+ *     top of this file.
+ */
+static char stencil_lines_desc[] = "Eight-wide 5-point stencil";
+static void stencil_lines(int M, int N, int A[N][M], int B[N][M])
+{
+    int i, j, j1, s0, s1, s2, s3, s4, s5, s6, s7;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j = j1) {
+            j1 = j + 8 - (int)((uintptr_t)&A[i][j] / sizeof(int) % 8);
+            if (i == 0 || i == N - 1 || j == 0 || j1 >= M || j1 - j < 8) {
+                for (; j < j1 && j < M; j++)
+                    if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                        B[i][j] = A[i][j];
+                    else
+                        B[i][j] = A[i][j] + A[i - 1][j] + A[i + 1][j] + A[i][j - 1] + A[i][j + 1];
+                continue;
+            }
+            s0 = A[i - 1][j];
+            s1 = A[i - 1][j + 1];
+            s2 = A[i - 1][j + 2];
+            s3 = A[i - 1][j + 3];
+            s4 = A[i - 1][j + 4];
+            s5 = A[i - 1][j + 5];
+            s6 = A[i - 1][j + 6];
+            s7 = A[i - 1][j + 7];
+            s0 += A[i + 1][j];
+            s1 += A[i + 1][j + 1];
+            s2 += A[i + 1][j + 2];
+            s3 += A[i + 1][j + 3];
+            s4 += A[i + 1][j + 4];
+            s5 += A[i + 1][j + 5];
+            s6 += A[i + 1][j + 6];
+            s7 += A[i + 1][j + 7];
+            s0 += A[i][j - 1] + A[i][j] + A[i][j + 1];
+            s1 += A[i][j] + A[i][j + 1] + A[i][j + 2];
+            s2 += A[i][j + 1] + A[i][j + 2] + A[i][j + 3];
+            s3 += A[i][j + 2] + A[i][j + 3] + A[i][j + 4];
+            s4 += A[i][j + 3] + A[i][j + 4] + A[i][j + 5];
+            s5 += A[i][j + 4] + A[i][j + 5] + A[i][j + 6];
+            s6 += A[i][j + 5] + A[i][j + 6] + A[i][j + 7];
+            s7 += A[i][j + 6] + A[i][j + 7] + A[i][j + 8];
+            B[i][j] = s0;
+            B[i][j + 1] = s1;
+            B[i][j + 2] = s2;
+            B[i][j + 3] = s3;
+            B[i][j + 4] = s4;
+            B[i][j + 5] = s5;
+            B[i][j + 6] = s6;
+            B[i][j + 7] = s7;
+        }
+}
+
+/*
+ * Gather and scatter through a random permutation
+ */
+static char gather_desc[] = "Gather";
+static void gather(int n, const int *src, const int *idx, int *dst)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = src[idx[i]];
+}
+
+static char scatter_desc[] = "Scatter";
+static void scatter(int n, const int *src, const int *idx, int *dst)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        dst[idx[i]] = src[i];
+}
+
+/*
+ * gather_lines, scatter_lines - Eight elements at a time from a 32-byte
+ *     boundary of idx, held in locals between the read of one side and
+ *     the write of the other. The streamed arrays are then each missed
+ *     once per eight elements even where they map to the same sets,
+ *     leaving the random side's miss per element. Sorting the indices
+ *     would not beat that: for a permutation it only moves the random
+ *     accesses from one side to the other. Like stencil_lines, these
+ *     assume 32-byte lines.
+ */
+static char gather_lines_desc[] = "Eight-wide gather";
+static void gather_lines(int n, const int *src, const int *idx, int *dst)
+{
+    int i, i1, d0, d1, d2, d3, d4, d5, d6, d7;
+
+    for (i = 0; i < n; i = i1) {
+        i1 = i + 8 - (int)((uintptr_t)&idx[i] / sizeof(int) % 8);
+        if (i1 - i < 8 || i1 > n) {
+            for (; i < i1 && i < n; i++)
+                dst[i] = src[idx[i]];
+            continue;
+        }
+        d0 = idx[i];
+        d1 = idx[i + 1];
+        d2 = idx[i + 2];
+        d3 = idx[i + 3];
+        d4 = idx[i + 4];
+        d5 = idx[i + 5];
+        d6 = idx[i + 6];
+        d7 = idx[i + 7];
+        d0 = src[d0];
+        d1 = src[d1];
+        d2 = src[d2];
+        d3 = src[d3];
+        d4 = src[d4];
+        d5 = src[d5];
+        d6 = src[d6];
+        d7 = src[d7];
+        dst[i] = d0;
+        dst[i + 1] = d1;
+        dst[i + 2] = d2;
+        dst[i + 3] = d3;
+        dst[i + 4] = d4;
+        dst[i + 5] = d5;
+        dst[i + 6] = d6;
+        dst[i + 7] = d7;
+    }
+}
+
+static char scatter_lines_desc[] = "Eight-wide scatter";
+static void scatter_lines(int n, const int *src, const int *idx, int *dst)
+{
+    int i, i1, d0, d1, d2, d3, d4, d5, d6, d7;
+
+    for (i = 0; i < n; i = i1) {
+        i1 = i + 8 - (int)((uintptr_t)&idx[i] / sizeof(int) % 8);
+        if (i1 - i < 8 || i1 > n) {
+            for (; i < i1 && i < n; i++)
+                dst[idx[i]] = src[i];
+            continue;
+        }
+        d0 = src[i];
+        d1 = src[i + 1];
+        d2 = src[i + 2];
+        d3 = src[i + 3];
+        d4 = src[i + 4];
+        d5 = src[i + 5];
+        d6 = src[i + 6];
+        d7 = src[i + 7];
+        dst[idx[i]] = d0;
+        dst[idx[i + 1]] = d1;
+        dst[idx[i + 2]] = d2;
+        dst[idx[i + 3]] = d3;
+        dst[idx[i + 4]] = d4;
+        dst[idx[i + 5]] = d5;
+        dst[idx[i + 6]] = d6;
+        dst[idx[i + 7]] = d7;
+    }
+}
+
+/*
+ * registerKernels - Register the kernels test-kernels evaluates
+ */
+void registerKernels(void)
+{
+    registerMatmul(matmul_ijk, matmul_ijk_desc);
+    registerMatmul(matmul_ikj, matmul_ikj_desc);
+    registerMatmul(matmul_blocked, matmul_blocked_desc);
+    registerStencil(stencil_rows, stencil_rows_desc);
+    registerStencil(stencil_cols, stencil_cols_desc);
+    registerStencil(stencil_lines, stencil_lines_desc);
+    registerGather(gather, gather_desc);
+    registerGather(gather_lines, gather_lines_desc);
+    registerScatter(scatter, scatter_desc);
+    registerScatter(scatter_lines, scatter_lines_desc);
+}
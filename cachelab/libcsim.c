@@ -0,0 +1,189 @@
+/*
+ * libcsim.c - Reentrant cache simulator, see libcsim.h
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "libcsim.h"
+
+struct cachesim {
+	Hierarchy* h;
+	Attribution* attrib;
+	Sampler* sampler;
+	Tlb* tlb;
+	unsigned long int accesses;
+	unsigned long int ip;
+	cachesim_outcome_t last;
+	};
+
+void cachesim_config_init(cachesim_config_t* config){
+	memset(config, 0, sizeof(cachesim_config_t));
+	config->levels = 1;
+	config->E[0] = 1;
+	config->policy = INCLUSIVE;
+	config->prefetch = PF_NONE;
+	config->degree = 1;
+	config->latency = 10;
+	config->page_bits = 12;
+	config->dtlb_entries = 64;
+	config->dtlb_ways = 4;
+	config->stlb_entries = 1536;
+	config->stlb_ways = 12;
+}
+
+static cachesim_t* fail(cachesim_t* sim, const char** error, const char* message){
+	if (error)
+		*error = message;
+	cachesim_free(sim);
+	return NULL;
+}
+
+cachesim_t* cachesim_create(const cachesim_config_t* config, const char** error){
+	cachesim_t* sim;
+	Cache* cache;
+
+	if ((sim = calloc(1, sizeof(cachesim_t))) == NULL || (sim->h = hierCreate(config->policy)) == NULL)
+		return fail(sim, error, "out of memory");
+	if (config->levels < 1 || config->levels > MAX_LEVELS)
+		return fail(sim, error, "invalid number of levels");
+	for (int i = 0; i < config->levels; i++)
+		if ((cache = cacheCreate(config->s[i], config->E[i], config->b)) == NULL ||
+			hierAddLevel(sim->h, cache) != 0) {
+			cacheFree(cache);
+			return fail(sim, error, "invalid cache geometry");
+		}
+	for (int i = 1; i < config->levels && config->policy == INCLUSIVE; i++)
+		if ((config->E[i] << config->s[i]) < (config->E[i - 1] << config->s[i - 1]))
+			return fail(sim, error, "an inclusive level must hold at least as many lines as the one inside it");
+	if (config->prefetch != PF_NONE &&
+		(sim->h->prefetcher = prefetchCreate(config->prefetch, config->degree, config->distance, config->latency)) == NULL)
+		return fail(sim, error, "invalid prefetch degree, distance or latency");
+	if (config->attribute && (sim->attrib = attribCreate(config->s[0], config->E[0], config->b)) == NULL)
+		return fail(sim, error, "L1 too large for attribution");
+	if (config->tlb && (sim->tlb = tlbCreate(config->page_bits, config->dtlb_entries, config->dtlb_ways,
+		config->stlb_entries, config->stlb_ways)) == NULL)
+		return fail(sim, error, "TLB entries must be a power of two multiple of the ways");
+	if (config->sample_rate > 0) {
+		if (config->attribute || config->prefetch != PF_NONE)
+			return fail(sim, error, "sampling cannot be combined with attribution or prefetching");
+		if ((sim->sampler = samplerCreate(sim->h, config->sample_rate, config->sample_seed)) == NULL)
+			return fail(sim, error, "sampling needs a rate in (0, 1] and set index bits in every level");
+	}
+	return sim;
+}
+
+void cachesim_free(cachesim_t* sim){
+	if (sim == NULL)
+		return;
+	if (sim->h)
+		hierFree(sim->h);
+	attribFree(sim->attrib);
+	samplerFree(sim->sampler);
+	tlbFree(sim->tlb);
+	free(sim);
+}
+
+void cachesim_set_ip(cachesim_t* sim, unsigned long int ip){
+	sim->ip = ip;
+}
+
+static int simulate(cachesim_t* sim, unsigned long int address, int isWrite, int part){ // one load or store, part of an access
+	Hierarchy* h = sim->h;
+	unsigned long int evictions = h->demandEvictions;
+	int served;
+
+	sim->accesses++;	// sampled or not
+	if (sim->sampler)
+		served = samplerAccess(sim->sampler, h, address, isWrite);
+	else
+		served = hierAccess(h, address, isWrite);
+	if (served < 0)
+		return -1;
+	sim->last.parts = part + 1;
+	sim->last.served[part] = served;
+	sim->last.evicted[part] = h->demandEvictions != evictions;	// a prefetch fill's victim is not this access's
+	if (sim->attrib)
+		attribAccess(sim->attrib, address, served == 0, sim->last.evicted[part], h->demandVictim);
+	return served != 0;
+}
+
+int cachesim_access(cachesim_t* sim, unsigned long int address, int size, char op){
+	int misses;
+
+	sim->h->ip = sim->ip;
+	sim->last.parts = 0;
+	if (sim->tlb) // once per access, an 'M' translates its address once
+		tlbAccess(sim->tlb, address, size);
+	if ((misses = simulate(sim, address, op == 'S', 0)) < 0) {
+		sim->accesses += op == 'M';	// its store is not sampled either
+		return 0;
+	}
+	if (op == 'M')
+		misses += simulate(sim, address, 1, 1);
+	return misses;
+}
+
+unsigned long int cachesim_access_many(cachesim_t* sim, const cachesim_access_t* accesses, size_t n){
+	unsigned long int misses = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		if (sim->sampler && !sim->tlb && !samplerKeeps(sim->sampler, accesses[i].address)) {
+			sim->accesses += accesses[i].op == 'M' ? 2 : 1;
+			continue;
+		}
+		sim->ip = accesses[i].ip;
+		misses += cachesim_access(sim, accesses[i].address, accesses[i].size, accesses[i].op);
+	}
+	return misses;
+}
+
+const cachesim_outcome_t* cachesim_last(cachesim_t* sim){
+	return &sim->last;
+}
+
+static unsigned long int scaled(cachesim_t* sim, unsigned long int count){
+	return sim->sampler ? samplerScaleCount(sim->sampler, count) : count;
+}
+
+void cachesim_stats(cachesim_t* sim, cachesim_stats_t* stats){
+	Hierarchy* h = sim->h;
+	CacheStats* st;
+
+	memset(stats, 0, sizeof(cachesim_stats_t));
+	stats->accesses = sim->accesses;
+	stats->levels = h->levels;
+	for (int i = 0; i < h->levels; i++) {
+		st = &h->level[i]->stats;
+		stats->level[i].hits = scaled(sim, st->hits);
+		stats->level[i].misses = scaled(sim, st->misses);
+		stats->level[i].evictions = scaled(sim, st->evictions);
+		stats->level[i].writebacks = scaled(sim, st->writebacks);
+		stats->level[i].invalidations = scaled(sim, st->invalidations);
+		if (i == 0 && sim->sampler) // every L1 access is counted, the hits are the rest
+			stats->level[i].hits = stats->accesses > stats->level[i].misses ?
+				stats->accesses - stats->level[i].misses : 0;
+		stats->level[i].prefetchHits = st->prefetchHits;	// never sampled
+		stats->level[i].prefetchMisses = st->prefetchMisses;
+	}
+	stats->mem_reads = scaled(sim, h->memReads);
+	stats->mem_writes = scaled(sim, h->memWrites);
+	if (h->prefetcher)
+		stats->prefetch = h->prefetcher->stats;
+	if (sim->tlb)
+		stats->tlb = sim->tlb->stats;
+}
+
+Hierarchy* cachesim_hierarchy(cachesim_t* sim){
+	return sim->h;
+}
+
+Attribution* cachesim_attribution(cachesim_t* sim){
+	return sim->attrib;
+}
+
+Sampler* cachesim_sampler(cachesim_t* sim){
+	return sim->sampler;
+}
+
+Tlb* cachesim_tlb(cachesim_t* sim){
+	return sim->tlb;
+}
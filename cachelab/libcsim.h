@@ -0,0 +1,93 @@
+/*
+ * libcsim.h - Reentrant trace-driven cache simulator, the library
+ *     behind csim.
+ *
+ * A simulator owns its hierarchy, prefetcher, 3C attribution, set
+ * sampler and TLB, and keeps no global state, so several can run in
+ * one process. Accesses come one at a time or in batches:
+ *
+ *   cachesim_config_t config;
+ *   cachesim_config_init(&config);
+ *   config.s[0] = 5; config.E[0] = 1; config.b = 5;
+ *   cachesim_t* sim = cachesim_create(&config, &error);
+ *   cachesim_access_many(sim, accesses, n);
+ *   cachesim_stats(sim, &stats);
+ *   cachesim_free(sim);
+ */
+
+#ifndef LIBCSIM_H
+#define LIBCSIM_H
+
+#include <stddef.h>
+#include "cachesim.h"
+#include "attrib.h"
+#include "sample.h"
+#include "tlb.h"
+
+typedef struct {
+	int levels;			// 1..MAX_LEVELS, L1 first
+	int s[MAX_LEVELS];
+	int E[MAX_LEVELS];
+	int b;				// one block size for every level
+	Policy policy;
+	PrefetchKind prefetch;		// L1 prefetcher, PF_NONE for none
+	int degree, distance, latency;
+	int attribute;			// 3C attribution, ranges through cachesim_attribution
+	double sample_rate;		// fraction of sets to simulate, 0 for all
+	unsigned long int sample_seed;
+	int tlb;			// model address translation
+	int page_bits;			// 12, 21 or 30
+	int dtlb_entries, dtlb_ways;
+	int stlb_entries, stlb_ways;	// 0 entries for no STLB
+	} cachesim_config_t;
+
+typedef struct {
+	unsigned long int address;
+	unsigned long int ip;		// instruction address for the prefetchers, 0 if unknown
+	int size;
+	char op;			// 'L', 'S' or 'M' (a load then a store)
+	} cachesim_access_t;
+
+typedef struct {
+	int parts;			// 2 for an 'M', 0 when the set is not sampled
+	int served[2];			// level that held the block, levels for memory
+	int evicted[2];			// the L1 fill replaced a valid line
+	} cachesim_outcome_t;
+
+typedef struct {
+	unsigned long int accesses;	// loads and stores, an 'M' counts as two
+	int levels;
+	CacheStats level[MAX_LEVELS];	// estimates when sampling: scaled to all sets, L1 hits accesses - misses
+	unsigned long int mem_reads, mem_writes;
+	PrefetchStats prefetch;
+	TlbStats tlb;
+	} cachesim_stats_t;
+
+typedef struct cachesim cachesim_t;
+
+/* One level of s=0, E=1, b=0, no prefetcher, sampling or TLB; 64:4:1536:12 with 4KB pages if tlb is set */
+void cachesim_config_init(cachesim_config_t* config);
+
+/* NULL on a bad configuration, with the reason in *error if error is not NULL */
+cachesim_t* cachesim_create(const cachesim_config_t* config, const char** error);
+void cachesim_free(cachesim_t* sim);
+
+/* Instruction address for the next cachesim_access calls */
+void cachesim_set_ip(cachesim_t* sim, unsigned long int ip);
+
+/* Simulate one access, return its L1 misses (0, 1 or 2) */
+int cachesim_access(cachesim_t* sim, unsigned long int address, int size, char op);
+/* Simulate n accesses, return their L1 misses */
+unsigned long int cachesim_access_many(cachesim_t* sim, const cachesim_access_t* accesses, size_t n);
+/* What the last cachesim_access did, for verbose output */
+const cachesim_outcome_t* cachesim_last(cachesim_t* sim);
+
+void cachesim_stats(cachesim_t* sim, cachesim_stats_t* stats);
+
+/* The parts for detailed reports, NULL when not configured */
+Hierarchy* cachesim_hierarchy(cachesim_t* sim);
+Attribution* cachesim_attribution(cachesim_t* sim);
+Sampler* cachesim_sampler(cachesim_t* sim);
+Tlb* cachesim_tlb(cachesim_t* sim);
+
+#endif /* LIBCSIM_H */
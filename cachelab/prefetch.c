@@ -0,0 +1,168 @@
+/*
+ * prefetch.c - Next-line, IP-stride and stream prefetcher models.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+
+Prefetcher* prefetchCreate(PrefetchKind kind, int degree, int distance, int latency){
+	Prefetcher* pf;
+
+	if (degree < 1 || degree > MAX_DEGREE || distance < 0 || latency < 0)
+		return NULL;
+	pf = (Prefetcher *)calloc(1, sizeof(Prefetcher));
+	pf->kind = kind;
+	pf->degree = degree;
+	pf->distance = distance;
+	pf->latency = latency;
+	return pf;
+}
+
+void prefetchFree(Prefetcher* pf){
+	free(pf);
+}
+
+static unsigned long int hashBlock(unsigned long int blockAddr){
+	return (blockAddr * 0x9E3779B97F4A7C15UL) >> 40;
+}
+
+void pollutionMark(Prefetcher* pf, unsigned long int blockAddr){
+	unsigned long int bit = hashBlock(blockAddr) % POLLUTION_BITS;
+	pf->pollution[bit / 8] |= 1 << (bit % 8);
+}
+
+int pollutionTest(Prefetcher* pf, unsigned long int blockAddr){ // test and clear
+	unsigned long int bit = hashBlock(blockAddr) % POLLUTION_BITS;
+	int set = (pf->pollution[bit / 8] >> (bit % 8)) & 1;
+
+	pf->pollution[bit / 8] &= ~(1 << (bit % 8));
+	return set;
+}
+
+static int strideCandidates(Prefetcher* pf, unsigned long int ip, unsigned long int address, int b,
+	unsigned long int* out){
+	StrideEntry* e = &pf->stride[hashBlock(ip) % STRIDE_ENTRIES];
+	long int stride = (long int)(address - e->lastAddr);
+	int n = 0;
+
+	if (e->ip == ip && address == e->lastAddr)
+		return 0; // the store half of a modify, nothing to learn
+	if (e->ip != ip) { // a new instruction takes over the entry
+		e->ip = ip;
+		e->lastAddr = address;
+		e->stride = 0;
+		e->confidence = 0;
+		return 0;
+	}
+	if (stride == e->stride) {
+		if (e->confidence < 3)
+			e->confidence++;
+	}
+	else if (e->confidence > 0)
+		e->confidence--;
+	else
+		e->stride = stride;
+	e->lastAddr = address;
+
+	if (e->confidence < 2 || e->stride == 0)
+		return 0;
+	for (int k = 0; k < pf->degree; k++) {
+		unsigned long int block = (address + e->stride * (pf->distance + k + 1)) >> b;
+		if (block != address >> b && (n == 0 || out[n - 1] != block))
+			out[n++] = block;
+	}
+	return n;
+}
+
+static int streamCandidates(Prefetcher* pf, unsigned long int blockAddr, unsigned long int* out){
+	Stream* st = NULL;
+	int direction, n = 0;
+
+	pf->clock++;
+	for (int i = 0; i < STREAMS; i++) {
+		Stream* cand = &pf->stream[i];
+		if (cand->valid && blockAddr + STREAM_WINDOW >= cand->lastBlock &&
+			blockAddr <= cand->lastBlock + STREAM_WINDOW) {
+			st = cand;
+			break;
+		}
+	}
+
+	if (st == NULL) { // start a new stream in the least recently used slot
+		st = &pf->stream[0];
+		for (int i = 1; i < STREAMS && st->valid; i++)
+			if (!pf->stream[i].valid || pf->stream[i].lru < st->lru)
+				st = &pf->stream[i];
+		st->valid = 1;
+		st->lastBlock = blockAddr;
+		st->direction = 0;
+		st->confirmed = 0;
+		st->lru = pf->clock;
+		return 0;
+	}
+
+	st->lru = pf->clock;
+	if (blockAddr == st->lastBlock)
+		return 0;
+	direction = blockAddr > st->lastBlock ? 1 : -1;
+	if (direction == st->direction)
+		st->confirmed++;
+	else {
+		st->direction = direction;
+		st->confirmed = 1;
+	}
+	st->lastBlock = blockAddr;
+
+	if (st->confirmed < 2)
+		return 0;
+	for (int k = 0; k < pf->degree; k++)
+		out[n++] = blockAddr + direction * (long int)(pf->distance + k + 1);
+	return n;
+}
+
+/*
+ * prefetchCandidates - Train on one demand access and write the block
+ *     addresses to prefetch into out (room for pf->degree entries).
+ *     trigger is nonzero for an L1 miss or the first hit to a
+ *     prefetched line. Return the number of candidates.
+ */
+int prefetchCandidates(Prefetcher* pf, unsigned long int ip, unsigned long int address, int b,
+	int trigger, unsigned long int* out){
+	switch (pf->kind) {
+		case PF_NEXTLINE:
+			if (!trigger)
+				return 0;
+			for (int k = 0; k < pf->degree; k++)
+				out[k] = (address >> b) + pf->distance + k + 1;
+			return pf->degree;
+		case PF_STRIDE:
+			return strideCandidates(pf, ip, address, b, out);
+		case PF_STREAM:
+			return trigger ? streamCandidates(pf, address >> b, out) : 0;
+		default:
+			return 0;
+	}
+}
+
+int parsePrefetcher(const char* name, PrefetchKind* kind){ // return 0 on success
+	if (strcmp(name, "next") == 0 || strcmp(name, "next-line") == 0)
+		*kind = PF_NEXTLINE;
+	else if (strcmp(name, "stride") == 0 || strcmp(name, "ip-stride") == 0)
+		*kind = PF_STRIDE;
+	else if (strcmp(name, "stream") == 0)
+		*kind = PF_STREAM;
+	else if (strcmp(name, "none") == 0)
+		*kind = PF_NONE;
+	else
+		return -1;
+	return 0;
+}
+
+const char* prefetcherName(PrefetchKind kind){
+	switch (kind) {
+		case PF_NEXTLINE: return "next-line";
+		case PF_STRIDE: return "ip-stride";
+		case PF_STREAM: return "stream";
+		default: return "none";
+	}
+}
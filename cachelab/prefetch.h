@@ -0,0 +1,69 @@
+/*
+ * prefetch.h - Hardware prefetcher models that feed the L1 of a
+ *     cachesim hierarchy.
+ *
+ * The prefetcher is trained on demand L1 misses and on the first demand
+ * hit to a prefetched line, and proposes block addresses to fetch. A
+ * prefetched line arrives 'latency' demand accesses after it is issued:
+ * used after that it is useful, used before that it is late (the demand
+ * still hits, but only part of the miss latency was hidden). A prefetched
+ * line evicted unused is useless, and a demand miss on a block that a
+ * prefetch pushed out is polluting.
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#define STRIDE_ENTRIES 256	// IP-indexed reference prediction table
+#define STREAMS 16		// tracked streams
+#define STREAM_WINDOW 16	// blocks a stream may jump and still match
+#define POLLUTION_BITS 4096	// hashed filter of blocks evicted by prefetches
+#define MAX_DEGREE 16
+
+typedef enum { PF_NONE, PF_NEXTLINE, PF_STRIDE, PF_STREAM } PrefetchKind;
+
+typedef struct {
+	unsigned long int ip;
+	unsigned long int lastAddr;
+	long int stride;
+	int confidence;		// saturating 0..3, prefetch at 2 and above
+	} StrideEntry;
+
+typedef struct {
+	int valid;
+	unsigned long int lastBlock;
+	int direction;		// +1 ascending, -1 descending, 0 not known yet
+	int confirmed;		// consecutive accesses in 'direction'
+	unsigned long int lru;
+	} Stream;
+
+typedef struct {
+	unsigned long int issued;
+	unsigned long int useful;
+	unsigned long int late;
+	unsigned long int useless;
+	unsigned long int polluting;
+	} PrefetchStats;
+
+typedef struct {
+	PrefetchKind kind;
+	int degree;		// blocks proposed per trigger
+	int distance;		// blocks (or strides) skipped before the first proposal
+	int latency;		// demand accesses until a prefetch arrives
+	StrideEntry stride[STRIDE_ENTRIES];
+	Stream stream[STREAMS];
+	unsigned long int clock;
+	unsigned char pollution[POLLUTION_BITS / 8];
+	PrefetchStats stats;
+	} Prefetcher;
+
+Prefetcher* prefetchCreate(PrefetchKind kind, int degree, int distance, int latency);
+void prefetchFree(Prefetcher* pf);
+int prefetchCandidates(Prefetcher* pf, unsigned long int ip, unsigned long int address, int b,
+	int trigger, unsigned long int* out);
+void pollutionMark(Prefetcher* pf, unsigned long int blockAddr);
+int pollutionTest(Prefetcher* pf, unsigned long int blockAddr);
+int parsePrefetcher(const char* name, PrefetchKind* kind);
+const char* prefetcherName(PrefetchKind kind);
+
+#endif /* PREFETCH_H */
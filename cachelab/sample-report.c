@@ -0,0 +1,174 @@
+/*
+ * sample-report.c - Validate csim -S against full simulation: for a few
+ *     cache geometries and sampling rates, compare the estimated L1
+ *     misses with the exact count over many sample seeds and report the
+ *     mean and worst error, the mean standard error, how often the
+ *     exact count was within two standard errors of the estimate, and
+ *     the speedup of the simulation loop over a trace already in memory.
+ *
+ * usage: ./sample-report [-h] [-n <seeds>] [<trace>]   (default traces/long.trace)
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include "cachesim.h"
+#include "sample.h"
+#include "btrace.h"
+
+typedef struct {
+	unsigned long int address;
+	char isWrite;
+	} Access;
+
+typedef struct {
+	const char* name;
+	int levels;
+	int s[MAX_LEVELS], E[MAX_LEVELS];
+	int b;
+	} Geometry;
+
+static const Geometry geometries[] = {
+	{"s=4 E=2 b=4", 1, {4}, {2}, 4},
+	{"s=8 E=4 b=5", 1, {8}, {4}, 5},
+	{"s=10 E=8 b=6", 1, {10}, {8}, 6},
+	{"L1 6:8:6 L2 10:4:6", 2, {6, 10}, {8, 4}, 6},
+	};
+
+static const double rates[] = {0.5, 0.25, 0.1, 0.05, 0.01};
+
+static Access* accesses;
+static unsigned long int count;
+
+static int loadTrace(const char* path){ // 'M' becomes a load and a store, 'I' is dropped
+	TraceReader* r = traceOpen(path);
+	TraceRecord rec;
+	unsigned long int cap = 1 << 16;
+
+	if (r == NULL || (accesses = malloc(cap * sizeof(Access))) == NULL)
+		return -1;
+	while (traceNext(r, &rec)) {
+		if (rec.oper == 'I')
+			continue;
+		if (count + 2 > cap && (accesses = realloc(accesses, (cap *= 2) * sizeof(Access))) == NULL)
+			return -1;
+		accesses[count].address = rec.address;
+		accesses[count++].isWrite = rec.oper == 'S';
+		if (rec.oper == 'M') {
+			accesses[count].address = rec.address;
+			accesses[count++].isWrite = 1;
+		}
+	}
+	traceClose(r);
+	return 0;
+}
+
+static Hierarchy* build(const Geometry* g){
+	Hierarchy* h = hierCreate(INCLUSIVE);
+
+	for (int i = 0; i < g->levels; i++)
+		hierAddLevel(h, cacheCreate(g->s[i], g->E[i], g->b));
+	return h;
+}
+
+/* L1 misses of the whole trace, sampled at rate (exact if 0); seconds per run in *secs */
+static unsigned long int run(const Geometry* g, double rate, unsigned long int seed, Estimate* est, double* secs){
+	Hierarchy* h = build(g);
+	Sampler* sp = rate > 0 ? samplerCreate(h, rate, seed) : NULL;
+	Estimate hits, evictions;
+	unsigned long int misses;
+	clock_t start = clock();
+
+	for (unsigned long int i = 0; i < count; i++)
+		if (sp) {
+			if (samplerKeeps(sp, accesses[i].address))
+				samplerAccess(sp, h, accesses[i].address, accesses[i].isWrite);
+		}
+		else
+			hierAccess(h, accesses[i].address, accesses[i].isWrite);
+	*secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	misses = h->level[0]->stats.misses;
+	if (sp) {
+		samplerEstimate(sp, count, &hits, est, &evictions);
+		samplerFree(sp);
+	}
+	hierFree(h);
+	return misses;
+}
+
+void usage(char *argv[]){
+	printf("Usage: %s [-h] [-n <seeds>] [<trace>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h           Print this help message.\n");
+	printf("  -n <num>     Independent set samples per rate (default 20).\n");
+	printf("<trace> is text or binary, default traces/long.trace.\n");
+}
+
+int main(int argc, char **argv){
+	const char* path = "traces/long.trace";
+	int seeds = 20, c, covered, errors;
+	unsigned long int exact;
+	double exactSecs, secs, sampledSecs, error, worst, se;
+	char mse[16], in[16];
+	Estimate est;
+
+	while ((c = getopt(argc, argv, "hn:")) != -1) {
+		switch (c) {
+			case 'n':
+				seeds = atoi(optarg);
+				break;
+			case 'h':
+				usage(argv);
+				return 0;
+			default:
+				usage(argv);
+				return 1;
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+	if (seeds <= 0 || loadTrace(path) != 0) {
+		printf("Error: cannot read trace file \"%s\"\n", path);
+		return 1;
+	}
+	printf("%s: %lu accesses, %d seeds per rate\n", path, count, seeds);
+	printf("%-20s %6s %10s %12s %9s %9s %9s %8s %8s\n",
+		"geometry", "rate", "exact", "mean est", "mean err", "max err", "mean se", "in 2se", "speedup");
+
+	for (int g = 0; g < sizeof(geometries) / sizeof(geometries[0]); g++) {
+		exact = run(&geometries[g], 0, 0, &est, &exactSecs);
+		for (int r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+			double mean = 0;
+
+			error = worst = se = sampledSecs = 0;
+			covered = errors = 0;
+			for (int k = 0; k < seeds; k++) {
+				run(&geometries[g], rates[r], k, &est, &secs);
+				mean += est.value / seeds;
+				error += fabs(est.value - exact) / seeds;
+				if (fabs(est.value - exact) > worst)
+					worst = fabs(est.value - exact);
+				if (est.se >= 0) {
+					se += est.se;
+					errors++;
+					covered += fabs(est.value - exact) <= 2 * est.se;
+				}
+				sampledSecs += secs / seeds;
+			}
+			if (errors) { // none when a single set is sampled
+				sprintf(mse, "%.1f%%", exact ? 100 * se / errors / exact : 0.0);
+				sprintf(in, "%.0f%%", 100.0 * covered / errors);
+			} else {
+				sprintf(mse, "-");
+				sprintf(in, "-");
+			}
+			printf("%-20s %6.2f %10lu %12.0f %8.1f%% %8.1f%% %9s %8s %7.1fx\n",
+				geometries[g].name, rates[r], exact, mean,
+				exact ? 100 * error / exact : 0.0, exact ? 100 * worst / exact : 0.0,
+				mse, in, sampledSecs > 0 ? exactSecs / sampledSecs : 0.0);
+		}
+	}
+	free(accesses);
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * sample.c - Set sampling, see sample.h
+ */
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include "sample.h"
+
+Sampler* samplerCreate(Hierarchy* h, double rate, unsigned long int seed){
+	Sampler* sp;
+	unsigned long int hash;
+	int s = h->level[0]->s;
+
+	for (int i = 1; i < h->levels; i++)
+		if (h->level[i]->s < s)
+			s = h->level[i]->s;
+	if (s == 0 || rate <= 0 || rate > 1 || (sp = calloc(1, sizeof(Sampler))) == NULL)
+		return NULL;
+	sp->s = s;
+	sp->b = h->level[0]->b;
+	sp->rate = rate;
+	sp->sets = 1UL << s;
+	sp->keep = calloc(sp->sets, 1);
+	sp->set = calloc(sp->sets, sizeof(SetCounts));
+	if (sp->keep == NULL || sp->set == NULL) {
+		samplerFree(sp);
+		return NULL;
+	}
+	for (unsigned long int i = 0; i < sp->sets; i++) { // a hash spreads the sample over strided index patterns
+		hash = (i + 1 + seed * 0xBF58476D1CE4E5B9UL) * 0x9E3779B97F4A7C15UL;
+		hash ^= hash >> 29;
+		if ((double)(hash >> 11) / (1UL << 53) < rate) {
+			sp->keep[i] = 1;
+			sp->sampled++;
+		}
+	}
+	if (sp->sampled == 0) {
+		sp->keep[0] = 1;
+		sp->sampled = 1;
+	}
+	return sp;
+}
+
+void samplerFree(Sampler* sp){
+	if (sp == NULL)
+		return;
+	free(sp->keep);
+	free(sp->set);
+	free(sp);
+}
+
+int samplerAccess(Sampler* sp, Hierarchy* h, unsigned long int address, int isWrite){
+	unsigned long int set = (address >> sp->b) & (sp->sets - 1);
+	unsigned long int evictions = h->level[0]->stats.evictions;
+	int served;
+
+	if (!sp->keep[set])
+		return -1;
+	served = hierAccess(h, address, isWrite);
+	if (served != 0)
+		sp->set[set].misses++;
+	sp->set[set].evictions += h->level[0]->stats.evictions - evictions;
+	return served;
+}
+
+static void estimate(Sampler* sp, size_t field, Estimate* e){
+	double n = sp->sampled, N = sp->sets, sum = 0, sq = 0, x;
+
+	for (unsigned long int i = 0; i < sp->sets; i++)
+		if (sp->keep[i]) {
+			x = *(unsigned long int*)((char*)&sp->set[i] + field);
+			sum += x;
+			sq += x * x;
+		}
+	e->value = sum * N / n;
+	if (sp->sampled < 2) {
+		e->se = -1;
+		return;
+	}
+	// total = N * mean, with the finite population correction for sampling without replacement
+	x = (sq - sum * sum / n) / (n - 1);
+	e->se = N * sqrt((1 - n / N) * x / n);
+}
+
+void samplerEstimate(Sampler* sp, unsigned long int accesses, Estimate* hits, Estimate* misses, Estimate* evictions){
+	estimate(sp, offsetof(SetCounts, misses), misses);
+	estimate(sp, offsetof(SetCounts, evictions), evictions);
+	hits->value = accesses > misses->value ? accesses - misses->value : 0;
+	hits->se = misses->se;	// hits and misses add up to the exact accesses
+}
+
+unsigned long int samplerScaleCount(Sampler* sp, unsigned long int count){
+	return (unsigned long int)((double)count * sp->sets / sp->sampled + 0.5);
+}
@@ -0,0 +1,66 @@
+/*
+ * sample.h - Set sampling for csim -S.
+ *
+ * Only accesses that map to a hashed subset of the sets are simulated.
+ * The sets are chosen on the index bits every level shares (the
+ * smallest s), so an L1 set that is sampled brings along exactly the
+ * outer-level sets its blocks map to, and every sampled set sees the
+ * same accesses it would in a full run. Totals are the sampled counts
+ * scaled by sets / sampled sets, except the L1 hits: every access is
+ * counted, sampled or not, and the hits are the accesses less the
+ * estimated misses, so a hot set such as the stack's, sampled or not,
+ * cannot skew them.
+ *
+ * The spread of the per-set L1 counts gives a standard error, treating
+ * the sampled sets as a simple random sample of all sets. It is not a
+ * confidence interval: it only sees the sampled sets, so a few sets
+ * unlike all of them are missed by it, and the error is then often
+ * several standard errors (sample-report measures how often).
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "cachesim.h"
+
+typedef struct {
+	unsigned long int misses;
+	unsigned long int evictions;
+	} SetCounts;
+
+typedef struct {
+	int s;			// sampled index bits, the smallest s of the hierarchy
+	int b;
+	double rate;		// requested fraction of sets
+	unsigned long int sets, sampled;
+	unsigned char* keep;	// 2^s flags
+	SetCounts* set;		// 2^s L1 counts, only the sampled ones are used
+	} Sampler;
+
+typedef struct {
+	double value;		// estimated total
+	double se;		// standard error over the sampled sets, -1 with one sampled set
+	} Estimate;
+
+/*
+ * Sample about rate of the sets of h, at least one, picked by a hash
+ * salted with seed; NULL if some level of h has no set bits
+ */
+Sampler* samplerCreate(Hierarchy* h, double rate, unsigned long int seed);
+void samplerFree(Sampler* sp);
+
+/* 1 if address maps to a sampled set; inline, as it runs for every access */
+static inline int samplerKeeps(const Sampler* sp, unsigned long int address){
+	return sp->keep[(address >> sp->b) & (sp->sets - 1)];
+}
+
+/* hierAccess if address maps to a sampled set, else -1 */
+int samplerAccess(Sampler* sp, Hierarchy* h, unsigned long int address, int isWrite);
+
+/* Estimates of the L1 hits, misses and evictions of accesses loads and stores to all sets */
+void samplerEstimate(Sampler* sp, unsigned long int accesses, Estimate* hits, Estimate* misses, Estimate* evictions);
+
+/* A count over the sampled sets scaled to all sets */
+unsigned long int samplerScaleCount(Sampler* sp, unsigned long int count);
+
+#endif /* SAMPLE_H */
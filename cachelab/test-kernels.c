@@ -0,0 +1,177 @@
+/*
+ * test-kernels.c - Checks every kernel registered in kernels.c against
+ *     the reference of its signature, and scores it by simulated misses
+ *     and by native time.
+ *
+ * The simulated run uses the instrumented copy of the kernel on a small
+ * problem and the cache given by -g; the timed run uses the plain copy
+ * on a large problem with tiles sized for the native cache given by -G.
+ *
+ * usage: ./test-kernels [-k kind] [-g s:E:b] [-G s:E:b] [-s size] [-n size] [-r reps]
+ */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "cachelab.h"
+#include "cachesim.h"
+#include "tracesim.h"
+#include "kernel.h"
+
+/* Globals set on the command line */
+static const char *kind = NULL;       /* only kernels of this signature */
+static cache_geometry_t sim_geometry = {5, 1, 5};
+static cache_geometry_t native_geometry = {6, 8, 6};   /* 32KB 8-way L1 */
+static int sim_size = 0;              /* 0 = the signature's default */
+static int native_size = 0;
+static int reps = 3;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * eval_sim - Run kernel i under the simulator, return 1 if it is correct
+ */
+static int eval_sim(int i, int size, unsigned long *misses, unsigned long *accesses)
+{
+    kernel_func_t *k = &kernel_list[i];
+    kernel_problem_t p;
+    Hierarchy* h;
+    int ok;
+
+    if (k->sim == NULL || !kernelSetup(k->sig, &p, size))
+        return 0;
+    h = hierCreate(INCLUSIVE);
+    hierAddLevel(h, cacheCreate(sim_geometry.s, sim_geometry.E, sim_geometry.b));
+    trans_geometry = sim_geometry;
+    kernelPoison(&p);
+    traceSimStart(h);
+    k->sig->run(k->sim, &p);
+    traceSimStop();
+    *misses = h->level[0]->stats.misses;
+    *accesses = traceSimCount();
+    ok = kernelCheck(&p);
+    hierFree(h);
+    kernelFree(&p);
+    return ok;
+}
+
+/*
+ * eval_native - Best time of reps runs of kernel i, return 1 if every
+ *     run is correct
+ */
+static int eval_native(int i, int size, double *best)
+{
+    kernel_func_t *k = &kernel_list[i];
+    kernel_problem_t p;
+    double t;
+    int r, ok = 1;
+
+    if (!kernelSetup(k->sig, &p, size))
+        return 0;
+    trans_geometry = native_geometry;
+    for (r = 0; r < reps; r++) {
+        kernelPoison(&p);
+        t = now();
+        k->sig->run(k->native, &p);
+        t = now() - t;
+        if (r == 0 || t < *best)
+            *best = t;
+        ok = ok && kernelCheck(&p);
+    }
+    kernelFree(&p);
+    return ok;
+}
+
+static void parse_geometry(const char *arg, cache_geometry_t *g)
+{
+    if (sscanf(arg, "%d:%d:%d", &g->s, &g->E, &g->b) != 3 ||
+        g->s < 0 || g->E < 1 || g->b < 0) {
+        printf("Error: bad geometry \"%s\"\n", arg);
+        exit(1);
+    }
+}
+
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] [-k <kind>] [-g <s:E:b>] [-G <s:E:b>] [-s <size>] [-n <size>] [-r <reps>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -k <kind>   Only matmul, stencil, gather or scatter kernels.\n");
+    printf("  -g <s:E:b>  Simulated cache (default 5:1:5).\n");
+    printf("  -G <s:E:b>  Native cache the tiles are sized for (default 6:8:6).\n");
+    printf("  -s <size>   Matrix side under the simulator (default per kind).\n");
+    printf("  -n <size>   Matrix side when timed (default per kind).\n");
+    printf("  -r <reps>   Timed runs, the best is reported (default 3).\n");
+    printf("Gather and scatter move size * size elements.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long misses, accesses;
+    int i, c, size, ok_sim, ok_native, failed = 0;
+    double t;
+
+    while ((c = getopt(argc, argv, "hk:g:G:s:n:r:")) != -1) {
+        switch (c) {
+        case 'k':
+            kind = optarg;
+            break;
+        case 'g':
+            parse_geometry(optarg, &sim_geometry);
+            break;
+        case 'G':
+            parse_geometry(optarg, &native_geometry);
+            break;
+        case 's':
+            sim_size = atoi(optarg);
+            break;
+        case 'n':
+            native_size = atoi(optarg);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (sim_size < 0 || native_size < 0 || reps < 1) {
+        usage(argv);
+        exit(1);
+    }
+
+    srand(1);
+    registerAllKernels();
+    printf("Simulating s=%d, E=%d, b=%d; timing best of %d\n\n",
+           sim_geometry.s, sim_geometry.E, sim_geometry.b, reps);
+    printf("%-4s %-8s %-30s %-7s %10s %10s %7s %10s\n",
+           "func", "kind", "description", "correct", "misses", "accesses", "n", "ms");
+    for (i = 0; i < kernel_count; i++) {
+        if (kind != NULL && strcmp(kind, kernel_list[i].sig->name) != 0)
+            continue;
+        misses = accesses = 0;
+        t = 0;
+        size = sim_size ? sim_size : kernel_list[i].sig->sim_size;
+        ok_sim = eval_sim(i, size, &misses, &accesses);
+        size = native_size ? native_size : kernel_list[i].sig->native_size;
+        ok_native = eval_native(i, size, &t);
+        printf("%-4d %-8s %-30s %-7d %10lu %10lu %7d %10.3f\n", i,
+               kernel_list[i].sig->name, kernel_list[i].description,
+               ok_sim && ok_native, misses, accesses, size, t * 1e3);
+        failed += !(ok_sim && ok_native);
+    }
+    printf("\nTEST_KERNELS_RESULTS=%d:%d\n", failed == 0, failed);
+    return failed != 0;
+}
@@ -3,6 +3,7 @@
  *     student's transpose functions and records the results for their
  *     official submitted version as well.
  */
+#define _XOPEN_SOURCE 700 /* mkdtemp, PATH_MAX */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -12,8 +13,11 @@
 #include <getopt.h>
 #include <sys/types.h>
 #include "cachelab.h"
+#include "cachesim.h"
+#include "tracesim.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h> // for INT_MAX
+#include <ftw.h> // for nftw
 
 /* Maximum array dimension */
 #define MAXN 256
@@ -32,6 +36,22 @@ extern int func_counter;
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int fast = 0; /* simulate in process instead of valgrind + csim-ref */
+static int jobs = 1; /* functions traced and simulated concurrently */
+static int sweep = 0; /* in-process miss table over many shapes */
+
+/* Shapes (M, N) of the sweep, square and odd rectangular ones */
+static const int sweep_shapes[][2] = {
+    {8, 8}, {16, 16}, {32, 32}, {48, 48}, {61, 67}, {64, 64}, {67, 61},
+    {96, 96}, {100, 37}, {128, 128}, {31, 200}, {200, 31}, {255, 255}, {256, 256}
+};
+
+/* Matrices for the in-process path, laid out like the ones in tracegen */
+static int A[256][256];
+static int B[256][256];
+
+/* Stand-ins for the tracegen markers, whose accesses the valgrind trace includes */
+static volatile char MARKER_START, MARKER_END;
 
 /* The correctness and performance for the submitted transpose function */
 struct results {
@@ -41,121 +61,369 @@ struct results {
 };
 static struct results results = {-1, 0, INT_MAX};
 
-/* 
- * eval_perf - Evaluate the performance of the registered transpose functions
+/*
+ * eval_inprocess - Run function i (from trans.c compiled with
+ *     -fsanitize=thread) with its accesses fed to an embedded simulator.
+ *     Return 0 if the result is not a transpose.
  */
-void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+int eval_inprocess(int i, unsigned int s, unsigned int E, unsigned int b,
+                   unsigned int *hits, unsigned int *misses, unsigned int *evictions)
 {
-    int i,flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
+    Hierarchy* h = hierCreate(INCLUSIVE);
+    hierAddLevel(h, cacheCreate(s, E, b));
+    trans_geometry.s = s;
+    trans_geometry.E = E;
+    trans_geometry.b = b;
+
+    initMatrix(M, N, A, B);
+    traceSimStart(h);
+    traceSimAccess((const void *)&MARKER_START, 1);
+    (*func_list[i].func_ptr)(M, N, A, B);
+    traceSimAccess((const void *)&MARKER_END, 1);
+    traceSimStop();
+
+    *hits = h->level[0]->stats.hits;
+    *misses = h->level[0]->stats.misses;
+    *evictions = h->level[0]->stats.evictions;
+    hierFree(h);
+    return validate(i, M, N, A, B);
+}
 
-    registerFunctions(); 
+/*
+ * shell_quote - Copy s into out as one single-quoted shell word, so a
+ *     path with spaces or metacharacters passes through system() as is
+ */
+static void shell_quote(char *out, const char *s)
+{
+    *out++ = '\'';
+    for (; *s; s++) {
+        if (*s == '\'') {
+            strcpy(out, "'\\''");
+            out += 4;
+        }
+        else
+            *out++ = *s;
+    }
+    *out++ = '\'';
+    *out = '\0';
+}
+
+/*
+ * eval_trace - Trace function i by running tracegen under valgrind,
+ *     keep the accesses between the markers and simulate them with
+ *     csim-ref. All scratch files (trace.tmp, trace.f<i>, .marker,
+ *     .csim_results) are created in dir. Return the tracegen exit
+ *     status, which is nonzero if the function is not a transpose.
+ */
+int eval_trace(int i, unsigned int s, unsigned int E, unsigned int b,
+               const char *dir, int quiet,
+               unsigned int *hits, unsigned int *misses, unsigned int *evictions)
+{
+    int flag;
+    unsigned int len;
+    unsigned long long int marker_start, marker_end, addr;
+    char buf[1000], cmd[8 * PATH_MAX + 255], cwd[PATH_MAX];
+    char qdir[4 * PATH_MAX + 3], qcwd[4 * PATH_MAX + 3];
+    char filename[PATH_MAX + 128];
 
     /* Open the complete trace file */
     FILE* full_trace_fp;  
     FILE* part_trace_fp; 
 
-    /* Evaluate the performance of each registered transpose function */
+    /* The tools live in the working directory, the scratch files in dir */
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+        strcpy(cwd, ".");
+    shell_quote(qdir, dir);
+    shell_quote(qcwd, cwd);
 
-    for (i=0; i<func_counter; i++) {
-        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
-            results.funcid = i; /* remember which function is the submission */
+    if (!quiet)
+        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
+    /* Use valgrind to generate the trace */
 
+    sprintf(cmd, "cd %s && valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v %s/tracegen -M %d -N %d -F %d  > trace.tmp", qdir, qcwd, M, N,i);
+    flag=WEXITSTATUS(system(cmd));
+    if (0!=flag)
+        return flag;
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
+    /* Get the start and end marker addresses */
+    sprintf(filename, "%s/.marker", dir);
+    FILE* marker_fp = fopen(filename, "r");
+    assert(marker_fp);
+    fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
+    fclose(marker_fp);
 
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
-            continue;
+    sprintf(filename, "%s/trace.tmp", dir);
+    full_trace_fp = fopen(filename, "r");
+    assert(full_trace_fp);
+
+
+    /* Filtered trace for each transpose function goes in a separate file */
+    sprintf(filename, "%s/trace.f%d", dir, i);
+    part_trace_fp = fopen(filename, "w");
+    assert(part_trace_fp);
+    
+    /* Locate trace corresponding to the trans function */
+    flag = 0;
+    while (fgets(buf, 1000, full_trace_fp) != NULL) {
+
+        /* We are only interested in memory access instructions */
+        if (buf[0]==' ' && buf[2]==' ' &&
+            (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
+            sscanf(buf+3, "%llx,%u", &addr, &len);
+        
+            /* If start marker found, set flag */
+            if (addr == marker_start)
+                flag = 1;
+
+            /* Valgrind creates many spurious accesses to the
+               stack that have nothing to do with the students
+               code. At the moment, we are ignoring all stack
+               accesses by using the simple filter of recording
+               accesses to only the low 32-bit portion of the
+               address space. At some point it would be nice to
+               try to do more informed filtering so that would
+               eliminate the valgrind stack references while
+               include the student stack references. */
+            if (flag && addr < 0xffffffff) {
+                fputs(buf, part_trace_fp);
+            }
+
+            /* if end marker found, close trace file */
+            if (addr == marker_end) {
+                flag = 0;
+                break;
+            }
         }
+    }
+    fclose(part_trace_fp);
+    fclose(full_trace_fp);
 
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
+    /* Run the reference simulator */
+    if (!quiet)
+        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+    sprintf(cmd, "cd %s && %s/csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
+            qdir, qcwd, s, E, b, i);
+    system(cmd);
+    
+    /* Collect results from the reference simulator */
+    sprintf(filename, "%s/.csim_results", dir);
+    FILE* in_fp = fopen(filename,"r");
+    assert(in_fp);
+    fscanf(in_fp, "%u %u %u", hits, misses, evictions);
+    fclose(in_fp);
+    return 0;
+}
 
+/*
+ * record_result - Save the outcome of function i
+ */
+void record_result(int i, int correct,
+                   unsigned int hits, unsigned int misses, unsigned int evictions)
+{
+    func_list[i].correct = correct;
 
-        func_list[i].correct=1;
+    /* Save the correctness of the transpose submission */
+    if (results.funcid == i)
+        results.correct = correct;
+    if (!correct)
+        return;
 
-        /* Save the correctness of the transpose submission */
-        if (results.funcid == i ) {
-            results.correct = 1;
-        }
+    func_list[i].num_hits = hits;
+    func_list[i].num_misses = misses;
+    func_list[i].num_evictions = evictions;
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
+    /* If it is transpose_submit(), record number of misses */
+    if (results.funcid == i) {
+        results.misses = misses;
+    }
+}
 
+/*
+ * compare_misses - qsort order for the parallel summary table
+ */
+int compare_misses(const void *x, const void *y)
+{
+    const trans_func_t *p = &func_list[*(const int *)x];
+    const trans_func_t *q = &func_list[*(const int *)y];
+
+    if (p->correct != q->correct)
+        return q->correct - p->correct;
+    if (p->num_misses != q->num_misses)
+        return p->num_misses < q->num_misses ? -1 : 1;
+    return *(const int *)x - *(const int *)y;
+}
 
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
+/* nftw callback for remove_dir */
+static int remove_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    return remove(path);
+}
 
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
+/* remove_dir - Delete dir and everything in it */
+static void remove_dir(const char *dir)
+{
+    if (nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0)
+        perror(dir);
+}
+
+/*
+ * eval_parallel - Run the trace, filter and simulate pipeline of up to
+ *     jobs functions at a time, each in its own fork()ed child and
+ *     its own temporary directory, then print one table sorted by misses
+ */
+void eval_parallel(unsigned int s, unsigned int E, unsigned int b, int jobs)
+{
+    static char dir[MAX_TRANS_FUNCS][PATH_MAX];
+    char filename[PATH_MAX + 16];
+    pid_t pid[MAX_TRANS_FUNCS];
+    int order[MAX_TRANS_FUNCS];
+    int i, next = 0, running = 0, status, correct;
+    unsigned int hits, misses, evictions;
+    const char *tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    FILE *fp;
+
+    printf("\nEvaluating %d functions, %d at a time (s=%d, E=%d, b=%d)\n",
+           func_counter, jobs, s, E, b);
+    fflush(stdout);
+
+    while (next < func_counter || running > 0) {
+        if (next < func_counter && running < jobs) {
+            i = next++;
+            if (snprintf(dir[i], sizeof(dir[i]), "%s/test-trans.XXXXXX", tmp) >= sizeof(dir[i])) {
+                fprintf(stderr, "TMPDIR is too long: %s\n", tmp);
+                exit(1);
+            }
+            if (mkdtemp(dir[i]) == NULL) {
+                perror("mkdtemp");
+                exit(1);
+            }
+            if ((pid[i] = fork()) == 0) {
+                /* Child: the exit status carries the tracegen verdict */
+                status = eval_trace(i, s, E, b, dir[i], 1, &hits, &misses, &evictions);
+                if (status == 0) {
+                    sprintf(filename, "%s/result", dir[i]);
+                    fp = fopen(filename, "w");
+                    assert(fp);
+                    fprintf(fp, "%u %u %u\n", hits, misses, evictions);
+                    fclose(fp);
                 }
+                exit(status == 0 ? 0 : 1);
             }
+            if (pid[i] < 0) {
+                perror("fork");
+                exit(1);
+            }
+            running++;
+            continue;
         }
-        fclose(full_trace_fp);
 
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
-        func_list[i].num_hits = hits;
-        func_list[i].num_misses = misses;
-        func_list[i].num_evictions = evictions;
+        /* Wait for any child and collect its results */
+        pid_t done = wait(&status);
+        if (done < 0)
+            break;
+        running--;
+        for (i = 0; i < next && pid[i] != done; i++)
+            ;
+        correct = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        hits = misses = evictions = 0;
+        if (correct) {
+            sprintf(filename, "%s/result", dir[i]);
+            fp = fopen(filename, "r");
+            assert(fp);
+            fscanf(fp, "%u %u %u", &hits, &misses, &evictions);
+            fclose(fp);
+        }
+        record_result(i, correct, hits, misses, evictions);
+        remove_dir(dir[i]);
+    }
+
+    for (i = 0; i < func_counter; i++)
+        order[i] = i;
+    qsort(order, func_counter, sizeof(int), compare_misses);
+
+    printf("\n%6s %8s %8s %10s  %s\n", "func", "misses", "hits", "evictions", "description");
+    for (i = 0; i < func_counter; i++) {
+        trans_func_t *f = &func_list[order[i]];
+        if (f->correct)
+            printf("%6d %8u %8u %10u  %s\n", order[i], f->num_misses,
+                   f->num_hits, f->num_evictions, f->description);
+        else
+            printf("%6d %8s %8s %10s  %s\n", order[i], "invalid", "-", "-", f->description);
+    }
+}
+
+/*
+ * eval_sweep - Print the in-process misses of every registered function
+ *     for each shape in sweep_shapes, "-" where it is not a transpose
+ */
+void eval_sweep(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i, k;
+    unsigned int hits, misses, evictions;
+    int shapes = sizeof(sweep_shapes) / sizeof(sweep_shapes[0]);
+
+    registerFunctions();
+    for (i = 0; i < func_counter; i++)
+        printf("func %d: %s\n", i, func_list[i].description);
+
+    printf("\nMisses (s=%d, E=%d, b=%d)\n%9s", s, E, b, "M x N");
+    for (i = 0; i < func_counter; i++)
+        printf(" %8s%-2d", "func ", i);
+    printf("\n");
+
+    for (k = 0; k < shapes; k++) {
+        M = sweep_shapes[k][0];
+        N = sweep_shapes[k][1];
+        printf("%4d x %-3d", M, N);
+        for (i = 0; i < func_counter; i++) {
+            if (eval_inprocess(i, s, E, b, &hits, &misses, &evictions))
+                printf(" %10u", misses);
+            else
+                printf(" %10s", "-");
+        }
+        printf("\n");
+    }
+}
+
+/* 
+ * eval_perf - Evaluate the performance of the registered transpose functions
+ */
+void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+{
+    int i,flag;
+    unsigned int hits, misses, evictions;
+
+    registerFunctions(); 
+
+    for (i=0; i<func_counter; i++) {
+        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
+            results.funcid = i; /* remember which function is the submission */
+    }
+
+    if (jobs > 1) {
+        eval_parallel(s, E, b, jobs);
+        return;
+    }
+
+    /* Evaluate the performance of each registered transpose function */
+
+    for (i=0; i<func_counter; i++) {
+        if (fast) {
+            printf("\nFunction %d (%d total)\nValidating and simulating in process (s=%d, E=%d, b=%d)\n",
+                   i, func_counter, s, E, b);
+            if (!eval_inprocess(i, s, E, b, &hits, &misses, &evictions)) {
+                printf("Validation error at function %d!\nSkipping performance evaluation for this function.\n", i);
+                continue;
+            }
+        }
+        else if ((flag = eval_trace(i, s, E, b, ".", 0, &hits, &misses, &evictions)) != 0) {
+            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
+            continue;
+        }
+
+        record_result(i, 1, hits, misses, evictions);
         printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
                i, func_list[i].description, hits, misses, evictions);
-    
-        /* If it is transpose_submit(), record number of misses */
-        if (results.funcid == i) {
-            results.misses = misses;
-        }
     }
   
 }
@@ -164,9 +432,14 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
  * usage - Print usage info
  */
 void usage(char *argv[]){
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hf] [-j <jobs>] -M <rows> -N <cols>\n", argv[0]);
+    printf("       %s -S\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
+    printf("  -f          Simulate in process, without valgrind and csim-ref.\n");
+    printf("  -j <jobs>   Evaluate this many functions concurrently (0 = one per core).\n");
+    printf("              Needs the valgrind pipeline: not allowed with -f.\n");
+    printf("  -S          Print in-process misses of every function over a sweep of shapes.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
     printf("Example: %s -M 8 -N 8\n", argv[0]);       
@@ -199,7 +472,7 @@ int main(int argc, char* argv[])
 {
     char c;
 
-    while ((c = getopt(argc,argv,"M:N:h")) != -1) {
+    while ((c = getopt(argc,argv,"M:N:hfj:S")) != -1) {
         switch(c) {
         case 'M':
             M = atoi(optarg);
@@ -207,6 +480,17 @@ int main(int argc, char* argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'f':
+            fast = 1;
+            break;
+        case 'S':
+            sweep = 1;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs <= 0)
+                jobs = sysconf(_SC_NPROCESSORS_ONLN);
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -216,6 +500,11 @@ int main(int argc, char* argv[])
         }
     }
   
+    if (sweep) {
+        eval_sweep(5, 1, 5);
+        return 0;
+    }
+
     if (M == 0 || N == 0) {
         printf("Error: Missing required argument\n");
         usage(argv);
@@ -228,6 +517,12 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
+    if (fast && jobs > 1) {
+        printf("Error: -j cannot be combined with -f\n");
+        usage(argv);
+        exit(1);
+    }
+
     /* Install SIGSEGV and SIGALRM handlers */
     if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
         fprintf(stderr, "Unable to install SIGALRM handler\n");
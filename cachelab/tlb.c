@@ -0,0 +1,95 @@
+/*
+ * tlb.c - TLB hierarchy and page walk model, see tlb.h
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "tlb.h"
+
+static Cache* tlbLevel(int entries, int ways){ // entries / ways sets of ways entries
+	int s = 0;
+
+	if (entries <= 0 || ways <= 0 || entries % ways != 0)
+		return NULL;
+	while ((1 << s) < entries / ways)
+		s++;
+	if ((1 << s) != entries / ways)
+		return NULL;
+	return cacheCreate(s, ways, 0);
+}
+
+Tlb* tlbCreate(int pageBits, int dtlbEntries, int dtlbWays, int stlbEntries, int stlbWays){
+	Tlb* t;
+
+	if ((pageBits != 12 && pageBits != 21 && pageBits != 30) || (t = calloc(1, sizeof(Tlb))) == NULL)
+		return NULL;
+	t->pageBits = pageBits;
+	t->walkLevels = (48 - pageBits) / 9;
+	t->dtlb = tlbLevel(dtlbEntries, dtlbWays);
+	t->stlb = stlbEntries ? tlbLevel(stlbEntries, stlbWays) : NULL;
+	t->psc = cacheCreate(0, PSC_ENTRIES, 0);
+	if (t->dtlb == NULL || (stlbEntries && t->stlb == NULL) || t->psc == NULL) {
+		tlbFree(t);
+		return NULL;
+	}
+	return t;
+}
+
+void tlbFree(Tlb* t){
+	if (t == NULL)
+		return;
+	cacheFree(t->dtlb);
+	cacheFree(t->stlb);
+	cacheFree(t->psc);
+	free(t);
+}
+
+/* Look vpn up in level, filling it on a miss; return 1 on a hit */
+static int tlbLookup(Cache* level, unsigned long int vpn){
+	Line* line = cacheLookup(level, vpn);
+	Victim victim;
+
+	if (line != NULL) {
+		level->stats.hits++;
+		cacheTouch(level, line);
+		return 1;
+	}
+	level->stats.misses++;
+	cacheFill(level, vpn, 0, &victim);
+	return 0;
+}
+
+static int translate(Tlb* t, unsigned long int vpn){ // return 1 if it took a walk
+	t->stats.accesses++;
+	if (tlbLookup(t->dtlb, vpn))
+		return 0;
+	if (t->stlb && tlbLookup(t->stlb, vpn))
+		return 0;
+	t->stats.walks++;
+	if (tlbLookup(t->psc, vpn >> 9)) { // the leaf table's address is cached
+		t->stats.pscHits++;
+		t->stats.walkRefs++;
+	}
+	else
+		t->stats.walkRefs += t->walkLevels;
+	return 1;
+}
+
+int tlbAccess(Tlb* t, unsigned long int address, int size){
+	unsigned long int first = address >> t->pageBits;
+	unsigned long int last = (address + (size > 0 ? size - 1 : 0)) >> t->pageBits;
+	int walks = translate(t, first);
+
+	if (last != first)
+		walks += translate(t, last);
+	return walks;
+}
+
+int parsePageSize(const char* name){
+	if (strcmp(name, "4k") == 0 || strcmp(name, "4K") == 0)
+		return 12;
+	if (strcmp(name, "2m") == 0 || strcmp(name, "2M") == 0)
+		return 21;
+	if (strcmp(name, "1g") == 0 || strcmp(name, "1G") == 0)
+		return 30;
+	return -1;
+}
@@ -0,0 +1,51 @@
+/*
+ * tlb.h - Address translation model for csim -T.
+ *
+ * A first-level data TLB, an optional second-level (shared) STLB and a
+ * paging-structure cache sit in front of the cache hierarchy. Each is a
+ * set-associative LRU cache of cachesim.h: the TLBs hold virtual page
+ * numbers, the paging-structure cache holds the entries one level above
+ * the leaf page table, so a walk that hits it reads only the leaf entry.
+ * A full walk reads one entry per level of a 4-level, 48-bit page table:
+ * 4 for 4KB pages, 3 for 2MB and 2 for 1GB. Addresses are translated
+ * one to one, the caches still see virtual addresses.
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+#include "cachesim.h"
+
+#define PSC_ENTRIES 32	// fully associative paging-structure cache
+
+typedef struct {
+	unsigned long int accesses;	// pages translated, two for an access that crosses a page
+	unsigned long int walks;	// misses in every TLB level
+	unsigned long int walkRefs;	// page table entries read by the walks
+	unsigned long int pscHits;	// walks shortened by the paging-structure cache
+	} TlbStats;
+
+typedef struct {
+	int pageBits;		// 12, 21 or 30
+	int walkLevels;		// page table levels read by a full walk
+	Cache* dtlb;
+	Cache* stlb;		// NULL for none
+	Cache* psc;
+	TlbStats stats;
+	} Tlb;
+
+/*
+ * Create a TLB for pages of 2^pageBits bytes from entries:ways of the
+ * dTLB and STLB (stlbEntries 0 for none); entries / ways must be a
+ * power of two. NULL on a bad geometry.
+ */
+Tlb* tlbCreate(int pageBits, int dtlbEntries, int dtlbWays, int stlbEntries, int stlbWays);
+void tlbFree(Tlb* t);
+
+/* Translate the pages of [address, address + size), return the number of walks */
+int tlbAccess(Tlb* t, unsigned long int address, int size);
+
+/* Page size from "4k", "2m" or "1g", as a bit count; -1 if unknown */
+int parsePageSize(const char* name);
+
+#endif /* TLB_H */
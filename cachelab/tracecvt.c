@@ -0,0 +1,132 @@
+/*
+ * tracecvt.c - Convert valgrind lackey traces between text and the
+ *     binary format of btrace.h, in whichever direction the input
+ *     calls for, or print what a trace holds.
+ *
+ * usage: ./tracecvt [-hiz] [-B <records>] [-f <first>] [-n <count>] <in> [<out>]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "btrace.h"
+
+static long int fileSize(const char* path){
+	FILE* fp = fopen(path, "rb");
+	long int size = -1;
+
+	if (fp != NULL && fseek(fp, 0, SEEK_END) == 0)
+		size = ftell(fp);
+	if (fp != NULL)
+		fclose(fp);
+	return size;
+}
+
+void usage(char *argv[]){
+	printf("Usage: %s [-hiz] [-B <records>] [-f <first>] [-n <count>] <in> [<out>]\n", argv[0]);
+	printf("Options:\n");
+	printf("  -h           Print this help message.\n");
+	printf("  -i           Print the records, size and load time of <in> and stop.\n");
+	printf("  -z           LZ compress the blocks of a binary output.\n");
+	printf("  -B <num>     Records per block of a binary output (default %d).\n", BTRACE_BLOCK);
+	printf("  -f <num>     Skip to record <num>, through the block index if <in> is binary.\n");
+	printf("  -n <num>     Convert at most <num> records.\n");
+	printf("A text <in> is written as binary and a binary one as text; <out> - is stdout.\n");
+	printf("\nExamples:\n");
+	printf("  linux>  %s -z traces/long.trace long.btrace\n", argv[0]);
+	printf("  linux>  %s -f 1000 -n 20 long.btrace -\n", argv[0]);
+}
+
+int main(int argc, char **argv){
+	int info = 0, flags = 0, blockRecords = BTRACE_BLOCK, c;
+	unsigned long int first = 0, count = 0, n = 0;
+	TraceReader* r;
+	TraceWriter* w = NULL;
+	FILE* out = NULL;
+	TraceRecord rec;
+	char line[64];
+	clock_t start;
+	double secs;
+
+	while ((c = getopt(argc, argv, "hizB:f:n:")) != -1) {
+		switch (c) {
+			case 'i':
+				info = 1;
+				break;
+			case 'z':
+				flags |= BTRACE_LZ;
+				break;
+			case 'B':
+				blockRecords = atoi(optarg);
+				break;
+			case 'f':
+				first = strtoul(optarg, NULL, 0);
+				break;
+			case 'n':
+				count = strtoul(optarg, NULL, 0);
+				break;
+			case 'h':
+				usage(argv);
+				return 0;
+			default:
+				usage(argv);
+				return 1;
+		}
+	}
+	if (optind + (info ? 1 : 2) != argc || blockRecords <= 0) {
+		usage(argv);
+		return 1;
+	}
+	if ((r = traceOpen(argv[optind])) == NULL) {
+		printf("Error: cannot open trace file \"%s\"\n", argv[optind]);
+		return 1;
+	}
+
+	if (info) {
+		start = clock();
+		while (traceNext(r, &rec))
+			n++;
+		if (traceFailed(r))
+			printf("Error: \"%s\" is corrupt after record %lu\n", argv[optind], n);
+		secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+		printf("%s: %s, %lu records, %ld bytes (%.2f per record), read in %.3fs\n",
+			argv[optind], traceIsBinary(r) ? "binary" : "text", n, fileSize(argv[optind]),
+			n ? (double)fileSize(argv[optind]) / n : 0.0, secs);
+		traceClose(r);
+		return 0;
+	}
+
+	if (traceIsBinary(r) && traceSeek(r, first) != 0) {
+		printf("Error: record %lu is past the end of the trace\n", first);
+		return 1;
+	}
+	for (; !traceIsBinary(r) && first > 0 && traceNext(r, &rec); first--)
+		;
+	if (traceIsBinary(r))
+		out = strcmp(argv[optind + 1], "-") == 0 ? stdout : fopen(argv[optind + 1], "w");
+	else
+		w = traceCreate(argv[optind + 1], flags, blockRecords);
+	if (out == NULL && w == NULL) {
+		printf("Error: cannot create \"%s\"\n", argv[optind + 1]);
+		return 1;
+	}
+	while ((count == 0 || n < count) && traceNext(r, &rec)) {
+		if (w != NULL && traceWrite(w, &rec) != 0)
+			break;
+		if (out != NULL)
+			fprintf(out, "%s\n", traceFormat(&rec, line));
+		n++;
+	}
+	if (traceFailed(r))
+		printf("Error: \"%s\" is corrupt after record %lu\n", argv[optind], first + n);
+	traceClose(r);
+	if ((w != NULL && traceFinish(w) != 0) || (out != NULL && out != stdout && fclose(out) != 0)) {
+		printf("Error: writing \"%s\" failed\n", argv[optind + 1]);
+		return 1;
+	}
+	if (w != NULL)
+		printf("%lu records, %ld -> %ld bytes (%.1fx smaller)\n", n, fileSize(argv[optind]),
+			fileSize(argv[optind + 1]), (double)fileSize(argv[optind]) / fileSize(argv[optind + 1]));
+	return 0;
+}
@@ -31,21 +31,6 @@ static int M;
 static int N;
 
 
-int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
-    for(int i=0;i<M;i++) {
-        for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
-                return 0;
-            }
-        }
-    }
-    return 1;
-}
-
 int main(int argc, char* argv[]){
     int i;
 
@@ -84,6 +69,16 @@ int main(int argc, char* argv[]){
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
 
+    /* Record where A and B live, for csim -a -R .ranges */
+    FILE* ranges_fp = fopen(".ranges","w");
+    assert(ranges_fp);
+    fprintf(ranges_fp, "A %llx %llx\nB %llx %llx\n",
+            (unsigned long long int) A,
+            (unsigned long long int) A + M * N * sizeof(int),
+            (unsigned long long int) B,
+            (unsigned long long int) B + M * N * sizeof(int));
+    fclose(ranges_fp);
+
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
@@ -0,0 +1,53 @@
+/*
+ * tracesim.c - Sanitizer hooks that feed instrumented memory accesses
+ *     straight into an embedded cache simulator. See tracesim.h.
+ */
+#include <stddef.h>
+#include "tracesim.h"
+
+static Hierarchy* traceHier = NULL;	// NULL while tracing is off
+static unsigned long int traceCount = 0;
+
+void traceSimStart(Hierarchy* h){
+	traceCount = 0;
+	traceHier = h;
+}
+
+void traceSimStop(void){
+	traceHier = NULL;
+}
+
+void traceSimAccess(const void* addr, int isWrite){
+	if (traceHier == NULL)
+		return;
+	traceCount++;
+	hierAccess(traceHier, (unsigned long int)addr, isWrite);
+}
+
+unsigned long int traceSimCount(void){
+	return traceCount;
+}
+
+/*
+ * The entry points below are what gcc and clang emit for
+ * -fsanitize=thread. Accesses are simulated as one reference each
+ * regardless of size, the same as a valgrind lackey record.
+ */
+void __tsan_init(void){}
+void __tsan_func_entry(void* pc){}
+void __tsan_func_exit(void){}
+
+#define TRACE_HOOKS(N) \
+	void __tsan_read##N(void* addr){ traceSimAccess(addr, 0); } \
+	void __tsan_write##N(void* addr){ traceSimAccess(addr, 1); } \
+	void __tsan_unaligned_read##N(void* addr){ traceSimAccess(addr, 0); } \
+	void __tsan_unaligned_write##N(void* addr){ traceSimAccess(addr, 1); }
+
+TRACE_HOOKS(1)
+TRACE_HOOKS(2)
+TRACE_HOOKS(4)
+TRACE_HOOKS(8)
+TRACE_HOOKS(16)
+
+void __tsan_read_range(void* addr, size_t size){ traceSimAccess(addr, 0); }
+void __tsan_write_range(void* addr, size_t size){ traceSimAccess(addr, 1); }
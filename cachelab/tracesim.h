@@ -0,0 +1,23 @@
+/*
+ * tracesim.h - In-process memory tracing of instrumented code.
+ *
+ * A translation unit compiled with -fsanitize=thread calls a
+ * __tsan_readN or __tsan_writeN hook before each load and store the
+ * compiler cannot prove private to the function; locals whose address
+ * is never taken are skipped, much like the stack filter of test-trans.
+ * No sanitizer runtime is linked. tracesim.c provides the hooks and,
+ * between traceSimStart and traceSimStop, feeds every access to a
+ * cachesim hierarchy.
+ */
+
+#ifndef TRACESIM_H
+#define TRACESIM_H
+
+#include "cachesim.h"
+
+void traceSimStart(Hierarchy* h);
+void traceSimStop(void);
+void traceSimAccess(const void* addr, int isWrite);
+unsigned long int traceSimCount(void); // accesses seen since the last start
+
+#endif /* TRACESIM_H */
@@ -0,0 +1,271 @@
+/*
+ * trans-par.c - Thread pool, parallel and in-place transposes, see
+ *     trans-par.h
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "trans-simd.h"
+#include "trans-par.h"
+
+struct trans_pool {
+    int threads;
+    pthread_t *tid;
+    pthread_mutex_t lock;
+    pthread_cond_t work;          /* a new job or quit */
+    pthread_cond_t done;          /* pending reached 0 */
+    unsigned long job;            /* incremented per trans_pool_run */
+    int pending;                  /* threads still running the job */
+    int quit;
+    void (*fn)(void *arg, int id, int n);
+    void *arg;
+};
+
+typedef struct worker_arg {
+    trans_pool_t *pool;
+    int id;
+} worker_arg_t;
+
+static void *worker(void *p)
+{
+    worker_arg_t w = *(worker_arg_t *)p;
+    trans_pool_t *pool = w.pool;
+    unsigned long seen = 0;
+    void (*fn)(void *arg, int id, int n);
+    void *arg;
+
+    free(p);
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->job == seen && !pool->quit)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->job;
+        fn = pool->fn;
+        arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        fn(arg, w.id, pool->threads);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+trans_pool_t *trans_pool_create(int threads)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    trans_pool_t *pool;
+    worker_arg_t *w;
+    cpu_set_t set;
+    int i;
+
+    if (cpus < 1)
+        cpus = 1;
+    if (threads <= 0)
+        threads = cpus;
+    if ((pool = calloc(1, sizeof(trans_pool_t))) == NULL)
+        return NULL;
+    if ((pool->tid = calloc(threads, sizeof(pthread_t))) == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 0; i < threads; i++) {
+        if ((w = malloc(sizeof(worker_arg_t))) == NULL)
+            break;
+        w->pool = pool;
+        w->id = i;
+        if (pthread_create(&pool->tid[i], NULL, worker, w) != 0) {
+            free(w);
+            break;
+        }
+        /* Pinning is best effort, the pool works without it */
+        CPU_ZERO(&set);
+        CPU_SET(i % cpus, &set);
+        pthread_setaffinity_np(pool->tid[i], sizeof(set), &set);
+        pool->threads++;
+    }
+    if (pool->threads < threads) {
+        trans_pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void trans_pool_free(trans_pool_t *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->threads; i++)
+        pthread_join(pool->tid[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool->tid);
+    free(pool);
+}
+
+int trans_pool_size(const trans_pool_t *pool)
+{
+    return pool->threads;
+}
+
+void trans_pool_run(trans_pool_t *pool, void (*fn)(void *arg, int id, int n), void *arg)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->pending = pool->threads;
+    pool->job++;
+    pthread_cond_broadcast(&pool->work);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+typedef struct trans_job {
+    int M, N;
+    int *A, *B;
+} trans_job_t;
+
+/*
+ * band - Rows [*j0, *j1) of an M-row matrix that thread id of n owns,
+ *     whole SIMD_BLOCK tiles so no tile is split between threads
+ */
+static void band(int M, int id, int n, int *j0, int *j1)
+{
+    long tiles = (M + SIMD_BLOCK - 1) / SIMD_BLOCK;
+
+    *j0 = tiles * id / n * SIMD_BLOCK;
+    *j1 = tiles * (id + 1) / n * SIMD_BLOCK;
+    if (*j0 > M)
+        *j0 = M;
+    if (*j1 > M)
+        *j1 = M;
+}
+
+static void parallel_job(void *arg, int id, int n)
+{
+    trans_job_t *job = arg;
+    int M = job->M, N = job->N, j0, j1;
+
+    band(M, id, n, &j0, &j1);
+    trans_simd_range(M, N, (int (*)[M])job->A, (int (*)[N])job->B, j0, j1);
+}
+
+void trans_parallel(trans_pool_t *pool, int M, int N, int A[N][M], int B[M][N])
+{
+    trans_job_t job = {M, N, &A[0][0], &B[0][0]};
+
+    trans_pool_run(pool, parallel_job, &job);
+}
+
+static void touch_job(void *arg, int id, int n)
+{
+    trans_job_t *job = arg;
+    int j0, j1;
+
+    band(job->M, id, n, &j0, &j1);
+    memset(job->B + (size_t)j0 * job->N, 0, sizeof(int) * (size_t)(j1 - j0) * job->N);
+}
+
+void trans_first_touch(trans_pool_t *pool, int M, int N, int B[M][N])
+{
+    trans_job_t job = {M, N, NULL, &B[0][0]};
+
+    trans_pool_run(pool, touch_job, &job);
+}
+
+/*
+ * swap_tiles - Swap tile (ti, tj) of the square matrix with the
+ *     transpose of tile (tj, ti); a diagonal tile is transposed in place
+ */
+static void swap_tiles(int n, int *a, int ti, int tj)
+{
+    int i0 = ti * SIMD_BLOCK, j0 = tj * SIMD_BLOCK;
+    int i1 = i0 + SIMD_BLOCK < n ? i0 + SIMD_BLOCK : n;
+    int j1 = j0 + SIMD_BLOCK < n ? j0 + SIMD_BLOCK : n;
+    int i, j, t;
+
+    for (i = i0; i < i1; i++)
+        for (j = (ti == tj ? i + 1 : j0); j < j1; j++) {
+            t = a[(size_t)i * n + j];
+            a[(size_t)i * n + j] = a[(size_t)j * n + i];
+            a[(size_t)j * n + i] = t;
+        }
+}
+
+/* Rows of tiles are dealt round robin: row ti has tiles - ti pairs */
+static void square_job(void *arg, int id, int n)
+{
+    trans_job_t *job = arg;
+    int tiles = (job->M + SIMD_BLOCK - 1) / SIMD_BLOCK;
+    int ti, tj;
+
+    for (ti = id; ti < tiles; ti += n)
+        for (tj = ti; tj < tiles; tj++)
+            swap_tiles(job->M, job->A, ti, tj);
+}
+
+/*
+ * Element k = i * M + j of the N x M matrix belongs at j * N + i, which
+ * is k * N mod (M * N - 1) for every k but the last. Each cycle of that
+ * map is rotated once, starting from its first unmarked element.
+ */
+static int cycle_inplace(int M, int N, int *A)
+{
+    size_t size = (size_t)M * N, mod = size - 1, k, next;
+    unsigned char *done;
+    int t, u;
+
+    if (size <= 2 || M == 1 || N == 1)
+        return 1;
+    if ((done = calloc((size + 7) / 8, 1)) == NULL)
+        return 0;
+    for (k = 1; k < mod; k++) {
+        if (done[k / 8] & (1 << (k % 8)))
+            continue;
+        t = A[k];
+        next = k;
+        do {
+            next = (unsigned long long)next * N % mod;
+            u = A[next];
+            A[next] = t;
+            t = u;
+            done[next / 8] |= 1 << (next % 8);
+        } while (next != k);
+    }
+    free(done);
+    return 1;
+}
+
+int trans_inplace(trans_pool_t *pool, int M, int N, int *A)
+{
+    trans_job_t job = {M, N, A, NULL};
+
+    if (M != N)
+        return cycle_inplace(M, N, A);
+    if (pool != NULL)
+        trans_pool_run(pool, square_job, &job);
+    else
+        square_job(&job, 0, 1);
+    return 1;
+}
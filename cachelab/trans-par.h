@@ -0,0 +1,40 @@
+/*
+ * trans-par.h - Multithreaded and in-place transposes for matrices far
+ *     larger than MAXN.
+ *
+ * A trans_pool_t keeps its threads for many transposes, each pinned to
+ * one CPU. trans_parallel gives thread t the same band of SIMD_BLOCK
+ * rows of B every time, and trans_first_touch zeroes a fresh B with that
+ * same split, so on a NUMA machine each thread writes pages its own node
+ * allocated.
+ */
+
+#ifndef TRANS_PAR_H
+#define TRANS_PAR_H
+
+typedef struct trans_pool trans_pool_t;
+
+/* Start a pool of threads, 0 for one per online CPU; NULL on failure */
+trans_pool_t *trans_pool_create(int threads);
+void trans_pool_free(trans_pool_t *pool);
+int trans_pool_size(const trans_pool_t *pool);
+
+/* Call fn(arg, id, threads) on every thread of the pool, and wait */
+void trans_pool_run(trans_pool_t *pool, void (*fn)(void *arg, int id, int n), void *arg);
+
+/* Out-of-place transpose, one band of rows of B per thread */
+void trans_parallel(trans_pool_t *pool, int M, int N, int A[N][M], int B[M][N]);
+
+/* Zero B from the threads trans_parallel will write it with */
+void trans_first_touch(trans_pool_t *pool, int M, int N, int B[M][N]);
+
+/*
+ * trans_inplace - Transpose the N x M matrix at A into an M x N matrix
+ *     in the same memory. Square matrices swap tile pairs across the
+ *     pool (NULL runs them on the caller); other shapes follow the
+ *     cycles of the permutation on the caller, with one bit per element
+ *     to mark cycles done. Returns 0 if that bitmap cannot be allocated.
+ */
+int trans_inplace(trans_pool_t *pool, int M, int N, int *A);
+
+#endif /* TRANS_PAR_H */
@@ -0,0 +1,229 @@
+/*
+ * trans-simd.c - Cache-blocked transpose with in-register 8x8 kernels,
+ *     see trans-simd.h
+ */
+#include <stddef.h>
+#include "trans-simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+/* b[c * ldb + r] = a[r * lda + c] for r, c < 8 */
+static inline void t8_scalar(const int *a, int lda, int *b, int ldb)
+{
+    int r, c;
+
+    for (r = 0; r < 8; r++)
+        for (c = 0; c < 8; c++)
+            b[c * ldb + r] = a[r * lda + c];
+}
+
+/* The edges of a tile that do not make up a whole 8x8 block */
+static void trans_edges(int M, int N, int A[N][M], int B[M][N],
+                        int i0, int i1, int j0, int j1)
+{
+    int i8 = i0 + (i1 - i0) / 8 * 8;
+    int j8 = j0 + (j1 - j0) / 8 * 8;
+    int i, j;
+
+    for (i = i0; i < i8; i++)
+        for (j = j8; j < j1; j++)
+            B[j][i] = A[i][j];
+    for (i = i8; i < i1; i++)
+        for (j = j0; j < j1; j++)
+            B[j][i] = A[i][j];
+}
+
+/*
+ * TRANS_TILES - Body of a blocked transpose of columns [j0, j1) of A,
+ *     calling KERNEL on each whole 8x8 block, expanded once per
+ *     instruction set so the kernel inlines
+ */
+#define TRANS_TILES(KERNEL)                                                 \
+    int ti, tj, ti1, tj1, i, j;                                             \
+                                                                            \
+    for (ti = 0; ti < N; ti += SIMD_BLOCK)                                  \
+        for (tj = j0; tj < j1; tj += SIMD_BLOCK) {                          \
+            ti1 = ti + SIMD_BLOCK < N ? ti + SIMD_BLOCK : N;                \
+            tj1 = tj + SIMD_BLOCK < j1 ? tj + SIMD_BLOCK : j1;              \
+            for (i = ti; i + 8 <= ti1; i += 8)                              \
+                for (j = tj; j + 8 <= tj1; j += 8)                          \
+                    KERNEL(&A[i][j], M, &B[j][i], N);                       \
+            trans_edges(M, N, A, B, ti, ti1, tj, tj1);                      \
+        }
+
+static void range_scalar(int M, int N, int A[N][M], int B[M][N], int j0, int j1)
+{
+    TRANS_TILES(t8_scalar)
+}
+
+#ifdef SIMD_X86
+
+/* 4x4 transpose of r0..r3 by interleaving 32-bit then 64-bit lanes */
+#define SSE_T4(r0, r1, r2, r3) do {                                         \
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);                            \
+        __m128i t1 = _mm_unpackhi_epi32(r0, r1);                            \
+        __m128i t2 = _mm_unpacklo_epi32(r2, r3);                            \
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);                            \
+        r0 = _mm_unpacklo_epi64(t0, t2);                                    \
+        r1 = _mm_unpackhi_epi64(t0, t2);                                    \
+        r2 = _mm_unpacklo_epi64(t1, t3);                                    \
+        r3 = _mm_unpackhi_epi64(t1, t3);                                    \
+    } while (0)
+
+/* One 4x4 quadrant: rows a[0..3][0..3] to b[0..3][0..3] */
+__attribute__((target("sse2")))
+static inline void t4_sse2(const int *a, int lda, int *b, int ldb)
+{
+    __m128i r0 = _mm_loadu_si128((const __m128i *)(a));
+    __m128i r1 = _mm_loadu_si128((const __m128i *)(a + lda));
+    __m128i r2 = _mm_loadu_si128((const __m128i *)(a + 2 * lda));
+    __m128i r3 = _mm_loadu_si128((const __m128i *)(a + 3 * lda));
+
+    SSE_T4(r0, r1, r2, r3);
+    _mm_storeu_si128((__m128i *)(b), r0);
+    _mm_storeu_si128((__m128i *)(b + ldb), r1);
+    _mm_storeu_si128((__m128i *)(b + 2 * ldb), r2);
+    _mm_storeu_si128((__m128i *)(b + 3 * ldb), r3);
+}
+
+__attribute__((target("sse2")))
+static inline void t8_sse2(const int *a, int lda, int *b, int ldb)
+{
+    t4_sse2(a, lda, b, ldb);
+    t4_sse2(a + 4, lda, b + 4 * ldb, ldb);
+    t4_sse2(a + 4 * lda, lda, b + 4, ldb);
+    t4_sse2(a + 4 * lda + 4, lda, b + 4 * ldb + 4, ldb);
+}
+
+/*
+ * t8_avx2 - Rows 0..7 in one register each. unpack 32 then 64 leaves
+ *     column c of rows 0-3 and 4-7 in the low and high 128-bit lanes of
+ *     u[c % 4] and u[c % 4 + 4]; permute2x128 joins the halves.
+ */
+__attribute__((target("avx2")))
+static inline void t8_avx2(const int *a, int lda, int *b, int ldb)
+{
+    __m256i r0 = _mm256_loadu_si256((const __m256i *)(a));
+    __m256i r1 = _mm256_loadu_si256((const __m256i *)(a + lda));
+    __m256i r2 = _mm256_loadu_si256((const __m256i *)(a + 2 * lda));
+    __m256i r3 = _mm256_loadu_si256((const __m256i *)(a + 3 * lda));
+    __m256i r4 = _mm256_loadu_si256((const __m256i *)(a + 4 * lda));
+    __m256i r5 = _mm256_loadu_si256((const __m256i *)(a + 5 * lda));
+    __m256i r6 = _mm256_loadu_si256((const __m256i *)(a + 6 * lda));
+    __m256i r7 = _mm256_loadu_si256((const __m256i *)(a + 7 * lda));
+    __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+    __m256i u0, u1, u2, u3, u4, u5, u6, u7;
+
+    t0 = _mm256_unpacklo_epi32(r0, r1);
+    t1 = _mm256_unpackhi_epi32(r0, r1);
+    t2 = _mm256_unpacklo_epi32(r2, r3);
+    t3 = _mm256_unpackhi_epi32(r2, r3);
+    t4 = _mm256_unpacklo_epi32(r4, r5);
+    t5 = _mm256_unpackhi_epi32(r4, r5);
+    t6 = _mm256_unpacklo_epi32(r6, r7);
+    t7 = _mm256_unpackhi_epi32(r6, r7);
+
+    u0 = _mm256_unpacklo_epi64(t0, t2);
+    u1 = _mm256_unpackhi_epi64(t0, t2);
+    u2 = _mm256_unpacklo_epi64(t1, t3);
+    u3 = _mm256_unpackhi_epi64(t1, t3);
+    u4 = _mm256_unpacklo_epi64(t4, t6);
+    u5 = _mm256_unpackhi_epi64(t4, t6);
+    u6 = _mm256_unpacklo_epi64(t5, t7);
+    u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    _mm256_storeu_si256((__m256i *)(b), _mm256_permute2x128_si256(u0, u4, 0x20));
+    _mm256_storeu_si256((__m256i *)(b + ldb), _mm256_permute2x128_si256(u1, u5, 0x20));
+    _mm256_storeu_si256((__m256i *)(b + 2 * ldb), _mm256_permute2x128_si256(u2, u6, 0x20));
+    _mm256_storeu_si256((__m256i *)(b + 3 * ldb), _mm256_permute2x128_si256(u3, u7, 0x20));
+    _mm256_storeu_si256((__m256i *)(b + 4 * ldb), _mm256_permute2x128_si256(u0, u4, 0x31));
+    _mm256_storeu_si256((__m256i *)(b + 5 * ldb), _mm256_permute2x128_si256(u1, u5, 0x31));
+    _mm256_storeu_si256((__m256i *)(b + 6 * ldb), _mm256_permute2x128_si256(u2, u6, 0x31));
+    _mm256_storeu_si256((__m256i *)(b + 7 * ldb), _mm256_permute2x128_si256(u3, u7, 0x31));
+}
+
+__attribute__((target("sse2")))
+static void range_sse2(int M, int N, int A[N][M], int B[M][N], int j0, int j1)
+{
+    TRANS_TILES(t8_sse2)
+}
+
+__attribute__((target("avx2")))
+static void range_avx2(int M, int N, int A[N][M], int B[M][N], int j0, int j1)
+{
+    TRANS_TILES(t8_avx2)
+}
+
+simd_level_t simd_level(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+    return SIMD_SCALAR;
+}
+
+#else /* !SIMD_X86 */
+
+#define range_sse2 range_scalar
+#define range_avx2 range_scalar
+
+simd_level_t simd_level(void)
+{
+    return SIMD_SCALAR;
+}
+
+#endif /* SIMD_X86 */
+
+const char *simd_level_name(simd_level_t level)
+{
+    static const char *names[] = {"scalar", "sse2", "avx2"};
+    return names[level];
+}
+
+void trans_simd_scalar(int M, int N, int A[N][M], int B[M][N])
+{
+    range_scalar(M, N, A, B, 0, M);
+}
+
+void trans_simd_sse2(int M, int N, int A[N][M], int B[M][N])
+{
+    range_sse2(M, N, A, B, 0, M);
+}
+
+void trans_simd_avx2(int M, int N, int A[N][M], int B[M][N])
+{
+    range_avx2(M, N, A, B, 0, M);
+}
+
+/* Threads may race to pick the kernel; they all store the same pointer */
+void trans_simd_range(int M, int N, int A[N][M], int B[M][N], int j0, int j1)
+{
+    static void (*kernel)(int M, int N, int A[N][M], int B[M][N], int j0, int j1) = NULL;
+    void (*k)(int M, int N, int A[N][M], int B[M][N], int j0, int j1);
+
+    k = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (k == NULL) {
+        switch (simd_level()) {
+        case SIMD_AVX2:
+            k = range_avx2;
+            break;
+        case SIMD_SSE2:
+            k = range_sse2;
+            break;
+        default:
+            k = range_scalar;
+        }
+        __atomic_store_n(&kernel, k, __ATOMIC_RELAXED);
+    }
+    k(M, N, A, B, j0, j1);
+}
+
+void trans_simd(int M, int N, int A[N][M], int B[M][N])
+{
+    trans_simd_range(M, N, A, B, 0, M);
+}
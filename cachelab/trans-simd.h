@@ -0,0 +1,38 @@
+/*
+ * trans-simd.h - Native transpose kernels for wall-clock throughput.
+ *
+ * The matrix is walked in SIMD_BLOCK x SIMD_BLOCK tiles and each tile in
+ * 8x8 blocks transposed in registers (one AVX2 register or two SSE2
+ * registers per row of 8 ints), with scalar code for the ragged edges.
+ * trans_simd picks the widest kernel the CPU supports the first time it
+ * is called. These kernels are not registered in trans.c: the simulated
+ * miss counts of test-trans say nothing about vector width.
+ */
+
+#ifndef TRANS_SIMD_H
+#define TRANS_SIMD_H
+
+/* Tile side in ints, a multiple of 8 */
+#define SIMD_BLOCK 64
+
+typedef enum {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+} simd_level_t;
+
+void trans_simd_scalar(int M, int N, int A[N][M], int B[M][N]);
+void trans_simd_sse2(int M, int N, int A[N][M], int B[M][N]);
+void trans_simd_avx2(int M, int N, int A[N][M], int B[M][N]);
+
+/* The fastest of the above this CPU runs */
+void trans_simd(int M, int N, int A[N][M], int B[M][N]);
+
+/* trans_simd of columns [j0, j1) of A only, into rows [j0, j1) of B */
+void trans_simd_range(int M, int N, int A[N][M], int B[M][N], int j0, int j1);
+
+/* Widest kernel this CPU supports, from CPUID */
+simd_level_t simd_level(void);
+const char *simd_level_name(simd_level_t level);
+
+#endif /* TRANS_SIMD_H */
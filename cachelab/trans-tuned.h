@@ -0,0 +1,14 @@
+/*
+ * trans-tuned.h - Generated by ./autotune, do not edit. Best
+ *     trans_blocked parameters per shape and cache geometry,
+ *     looked up by trans_tuned.
+ */
+static const trans_tuned_entry_t trans_tuned_table[] = {
+    /* M, N, s, E, b, {th, tw, diag, tile order, inner order}, th 0 for transpose_submit */
+    {32, 32, 5, 1, 5, {0, 0, DIAG_NONE, ORDER_ROWS, ORDER_ROWS}}, /* 272 misses, 2560 accesses, transpose_submit */
+    {64, 64, 5, 1, 5, {0, 0, DIAG_NONE, ORDER_ROWS, ORDER_ROWS}}, /* 1201 misses, 15168 accesses, transpose_submit */
+    {61, 67, 5, 1, 5, {12, 32, DIAG_BUFFER, ORDER_ROWS, ORDER_COLS}}, /* 1711 misses, 8241 accesses */
+    {67, 61, 5, 1, 5, {16, 64, DIAG_BUFFER, ORDER_ROWS, ORDER_COLS}}, /* 1735 misses, 8219 accesses */
+    {128, 128, 5, 1, 5, {64, 2, DIAG_BUFFER, ORDER_ROWS, ORDER_ROWS}}, /* 10757 misses, 33411 accesses */
+    {100, 37, 5, 1, 5, {24, 4, DIAG_BUFFER, ORDER_ROWS, ORDER_ROWS}}, /* 1474 misses, 7653 accesses */
+};
@@ -13,8 +13,10 @@
 #include <stdio.h>
 #include "cachelab.h"
 #include "contracts.h"
+#include "transtune.h"
 
 int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+void trans_recursive(int M, int N, int A[N][M], int B[M][N]);
 
 /* 
  * transpose_submit - This is the solution transpose function that you
@@ -257,6 +259,12 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
 		}
 	}
 
+//--------------------------------------------------------------------
+// Any other shape
+//--------------------------------------------------------------------
+	if (!((M == 32) && (N == 32)) && !((M == 64) && (N == 64)) && !((M == 61) && (N == 67)))
+		trans_recursive(M, N, A, B);
+
 
     ENSURES(is_transpose(M, N, A, B));
 }
@@ -286,6 +294,103 @@ void trans(int M, int N, int A[N][M], int B[M][N])
     ENSURES(is_transpose(M, N, A, B));
 }
 
+/*
+ * trans_alias - Rows of a matrix with rowBytes per row that can be
+ *     cached together: rows a multiple of 2^(s+b) bytes apart share a
+ *     set, and a set holds E of them.
+ */
+static int trans_alias(int rowBytes)
+{
+    long span = 1L << (trans_geometry.s + trans_geometry.b);
+    long period = span;
+
+    while (period > 1 && rowBytes % period != 0)
+        period /= 2; /* period = gcd(rowBytes, span), span is a power of two */
+    return (int)(span / period) * trans_geometry.E;
+}
+
+/*
+ * trans_base - Side of the square tiles trans_recursive stops at: a
+ *     multiple of the ints per block, as large as possible while the A
+ *     tile and the B tile together take at most the whole cache, and
+ *     no taller than the rows of A or B that can be cached together.
+ */
+static int trans_base(int M, int N)
+{
+    int perBlock = (1 << trans_geometry.b) / (int)sizeof(int);
+    long lines = (long)trans_geometry.E << trans_geometry.s;
+    int side, limit;
+
+    if (perBlock < 1)
+        perBlock = 1;
+    side = perBlock;
+    while (2L * (2 * side) * (2 * side) / perBlock <= lines)
+        side *= 2;
+
+    limit = trans_alias(M * (int)sizeof(int));
+    if (trans_alias(N * (int)sizeof(int)) < limit)
+        limit = trans_alias(N * (int)sizeof(int));
+    while (limit > 1 && side > limit) /* with one row per set, blocking cannot help */
+        side /= 2;
+    return side;
+}
+
+/*
+ * trans_tile - Recursively halve the longer side of the tile with rows
+ *     [r0, r1) and columns [c0, c1) of A until both fit the base size,
+ *     keeping split points on multiples of base so tiles line up with
+ *     cache blocks. In a base tile the diagonal element of each row is
+ *     written last, since on a square matrix B[i][i] maps to the same
+ *     set as the A row being read.
+ */
+static void trans_tile(int M, int N, int A[N][M], int B[M][N],
+                       int r0, int r1, int c0, int c1, int base)
+{
+    int i, j, half, diag;
+
+    if (r1 - r0 > base && r1 - r0 >= c1 - c0) {
+        half = (r1 - r0) / 2 / base * base;
+        half = half ? half : base;
+        trans_tile(M, N, A, B, r0, r0 + half, c0, c1, base);
+        trans_tile(M, N, A, B, r0 + half, r1, c0, c1, base);
+        return;
+    }
+    if (c1 - c0 > base) {
+        half = (c1 - c0) / 2 / base * base;
+        half = half ? half : base;
+        trans_tile(M, N, A, B, r0, r1, c0, c0 + half, base);
+        trans_tile(M, N, A, B, r0, r1, c0 + half, c1, base);
+        return;
+    }
+
+    for (i = r0; i < r1; i++) {
+        diag = 0;
+        for (j = c0; j < c1; j++) {
+            if (i == j)
+                diag = A[i][j];
+            else
+                B[j][i] = A[i][j];
+        }
+        if (i >= c0 && i < c1)
+            B[i][i] = diag;
+    }
+}
+
+/*
+ * trans_recursive - Cache-oblivious transpose for any M x N, with the
+ *     base case sized from trans_geometry
+ */
+char trans_recursive_desc[] = "Cache-oblivious recursive transpose";
+void trans_recursive(int M, int N, int A[N][M], int B[M][N])
+{
+    REQUIRES(M > 0);
+    REQUIRES(N > 0);
+
+    trans_tile(M, N, A, B, 0, N, 0, M, trans_base(M, N));
+
+    ENSURES(is_transpose(M, N, A, B));
+}
+
 /*
  * registerFunctions - This function registers your transpose
  *     functions with the driver.  At runtime, the driver will
@@ -299,6 +404,8 @@ void registerFunctions()
     registerTransFunction(transpose_submit, transpose_submit_desc); 
     /* Register any additional transpose functions */
     registerTransFunction(trans, trans_desc); 
+    registerTransFunction(trans_recursive, trans_recursive_desc);
+    registerTransFunction(trans_tuned, trans_tuned_desc);
 
 }
 
@@ -0,0 +1,52 @@
+/*
+ * transtune.h - Parameterized blocked transpose searched by autotune,
+ *     and the tuned transpose that replays the best parameters found
+ */
+
+#ifndef TRANSTUNE_H
+#define TRANSTUNE_H
+
+/* How elements on the diagonal of a square matrix are handled */
+typedef enum {
+    DIAG_NONE,    /* copy element by element */
+    DIAG_DEFER,   /* write the diagonal element of each row last */
+    DIAG_BUFFER   /* read up to 8 elements into locals, then write them */
+} trans_diag_t;
+
+/* Traversal order, for tiles and for elements within a tile */
+typedef enum {
+    ORDER_ROWS,   /* along the rows of A */
+    ORDER_COLS    /* along the columns of A, i.e. the rows of B */
+} trans_order_t;
+
+typedef struct trans_params {
+    int th;                   /* tile height, in rows of A */
+    int tw;                   /* tile width, in columns of A */
+    trans_diag_t diag;
+    trans_order_t tile_order;
+    trans_order_t inner_order;
+} trans_params_t;
+
+/*
+ * One row of the table autotune writes to trans-tuned.h; params.th 0
+ * means no variant beat transpose_submit, which trans_tuned then runs
+ */
+typedef struct trans_tuned_entry {
+    int M, N, s, E, b;
+    trans_params_t params;
+} trans_tuned_entry_t;
+
+/* Blocked transpose with the given parameters */
+void trans_blocked(int M, int N, int A[N][M], int B[M][N], const trans_params_t *p);
+
+/* trans_blocked with the tuned parameters for M, N and trans_geometry */
+extern char trans_tuned_desc[];
+void trans_tuned(int M, int N, int A[N][M], int B[M][N]);
+
+/* The hand-written transpose in trans.c, which tuning has to beat */
+void transpose_submit(int M, int N, int A[N][M], int B[M][N]);
+
+/* Format p as "th x tw, diag, tiles, inner" into buf */
+char *trans_params_str(const trans_params_t *p, char *buf);
+
+#endif /* TRANSTUNE_H */
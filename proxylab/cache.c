@@ -1,186 +1,370 @@
+/*
+ * cache.c - Sharded object cache, see cache.h
+ *
+ * A URI's 64-bit FNV-1a hash picks its shard (low bits) and its bucket
+ * within the shard (high bits). Lookups take the shard's lock shared,
+ * so hits on one shard run in parallel: a hit only takes a reference
+ * and counts itself in the object's policy node (LRU alone relinks, so
+ * under LRU lookups lock exclusively).
+ *
+ * Each shard runs its own replacement policy over a share of the
+ * capacity. The size of the whole cache is one atomic counter: an
+ * insert that pushes it over the limit evicts from the shards in turn,
+ * one exclusive lock at a time, until it fits again. With admission
+ * on, every lookup is recorded in one TinyLFU sketch for the whole
+ * cache, and an insert that needs room must beat the first object its
+ * shard would evict.
+ *
+ * With a disk tier, the inserting thread demotes each object it evicts,
+ * once the shard lock is dropped, and each one admission turns away, so
+ * only memory's hottest objects are kept in memory alone. A lookup that misses in memory
+ * reads the object back from disk and offers it to the cache again.
+ */
+#define _GNU_SOURCE	/* memfd_create */
 #include "cache.h"
+#include "tinylfu.h"
+#include "disk.h"
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
+#define INITIAL_BUCKETS 64
 
-struct cacheobj 
+static struct cacheconfig config;
+static struct tinylfu sketch;
+static shard *shards;
+static unsigned nshards;
+static size_t total;			/* bytes cached, updated atomically */
+static unsigned hand;			/* next shard to evict from */
+
+static uint64_t hash_uri(const char *uri)
 {
-	size_t size;
-	struct cacheblock *prev,*next;
-	char *uri,*buf;
-};
+	uint64_t h = 14695981039346656037ULL;
+
+	while (*uri)
+		h = (h ^ (unsigned char)*uri++) * 1099511628211ULL;
+	return h;
+}
 
-typedef struct cacheobj obj; 
+static obj **bucket(shard *s, uint64_t hash)
+{
+	return &s->buckets[(hash >> 32) & (s->nbuckets - 1)];
+}
 
-struct Cache
+/* Double the bucket array of s once it averages more than one object per bucket */
+static void grow(shard *s)
 {
-	size_t size;
-	cacheblock *head,*tail;
-};
+	obj **old = s->buckets, *o, *next;
+	size_t n = s->nbuckets;
 
-typedef struct Cache Cache;
+	s->nbuckets *= 2;
+	s->buckets = Calloc(s->nbuckets, sizeof(obj *));
+	for (size_t i = 0; i < n; i++) {
+		for (o = old[i]; o != NULL; o = next) {
+			next = o->chain;
+			o->chain = *bucket(s, o->node.hash);
+			*bucket(s, o->node.hash) = o;
+		}
+	}
+	Free(old);
+}
+
+static obj *lookup(shard *s, const char *uri, uint64_t hash)
+{
+	obj *o;
 
-Cache cache;
-pthread_rwlock_t cachelock;
-pthread_rwlock_t listlock;
+	for (o = *bucket(s, hash); o != NULL; o = o->chain)
+		if (o->node.hash == hash && !strcmp(o->uri, uri))
+			return o;
+	return NULL;
+}
 
+static void free_obj(obj *o)
+{
+	Free(o->uri);
+	close(o->fd);
+	Free(o);
+}
 
-void init_cache()
+void cacheput(obj *o)
 {
-	cache.head = NULL;
-	cache.tail = NULL;
-	cache.size = 0;
+	if (__sync_sub_and_fetch(&o->refcnt, 1) == 0)
+		free_obj(o);
+}
 
-	pthread_rwlock_init(&cachelock, 0);
-	pthread_rwlock_init(&listlock, 0);
-	return;
+void cacheconfig_init(struct cacheconfig *c)
+{
+	c->shards = CACHE_SHARDS;
+	c->max_size = MAX_CACHE_SIZE;
+	c->max_object = MAX_OBJECT_SIZE;
+	c->policy = POLICY_S3FIFO;
+	c->admission = 1;
+	c->disk_dir = NULL;
+	c->disk_size = DISK_CACHE_SIZE;
 }
 
-void cacheevit(){
-	if(cache.head == NULL){
-		return;
-	}
-	else{	
-		Free(cache.head->title);
-		Free(cache.head->content);	
-		cache.size -= (cache.head)->size;
-		cache.head = (cache.head)->next;
-		Free(cache.head->prev);
-		(cache.head)->prev=NULL;
+void init_cache(const struct cacheconfig *c)
+{
+	config = *c;
+	nshards = 1;
+	while (nshards < (unsigned)(config.shards > 0 ? config.shards : CACHE_SHARDS))
+		nshards *= 2;
+	shards = Calloc(nshards, sizeof(shard));
+	for (unsigned i = 0; i < nshards; i++) {
+		pthread_rwlock_init(&shards[i].lock, NULL);
+		policy_init(&shards[i].policy, config.policy, config.max_size / nshards);
+		shards[i].nbuckets = INITIAL_BUCKETS;
+		shards[i].buckets = Calloc(INITIAL_BUCKETS, sizeof(obj *));
 	}
-	return;
+	if (config.admission)
+		tinylfu_init(&sketch, config.max_size);
+	if (config.disk_dir != NULL && disk_open(config.disk_dir, config.disk_size) < 0)
+		unix_error("init_cache: cannot open the disk tier");
+	total = 0;
+	hand = 0;
+}
+
+size_t cachemaxobject(void)
+{
+	return config.max_object;
+}
+
+/* Unlink the object the policy of s picks and return it, still holding the cache's pin; NULL if s is empty */
+static obj *cacheevict(shard *s)
+{
+	obj *victim, **pp;
+
+	if ((victim = (obj *)policy_next(&s->policy)) == NULL)
+		return NULL;
+	policy_evict(&s->policy, &victim->node);
+	for (pp = bucket(s, victim->node.hash); *pp != victim; pp = &(*pp)->chain)
+		;
+	*pp = victim->chain;
+	s->count--;
+	return victim;
+}
+
+int cachememfd(void)
+{
+	return memfd_create("proxy-cache", MFD_CLOEXEC);
+}
+
+ssize_t cachesend(int sockfd, obj *o, off_t *off)
+{
+	return sendfile(sockfd, o->fd, off, o->node.size - *off);
 }
 
-int cacheinsert(char *uri,size_t cachecnt,char *cachebuf){
-	pthread_rwlock_wrlock(&cachelock);
-	pthread_rwlock_wrlock(&listlock);
+/*
+ * cacheinsert - cache a copy of cachebuf for uri; 1 if inserted, 0 if
+ *     empty, already cached, not admitted or out of memfds, -1 if
+ *     larger than the largest object
+ */
+int cacheinsert(char *uri, size_t cachecnt, char *cachebuf)
+{
+	int fd;
 
-	if(cachecnt == 0){
-        pthread_rwlock_unlock(&listlock);
-        pthread_rwlock_unlock(&cachelock);
+	if (cachecnt == 0)
+		return 0;
+	if (cachecnt > config.max_object)
+		return -1;
+	if ((fd = cachememfd()) < 0)
+		return 0;
+	if (rio_writen(fd, cachebuf, cachecnt) != cachecnt) {
+		close(fd);
 		return 0;
 	}
+	return cacheadopt(uri, fd, cachecnt);
+}
 
-	if(cachecnt > MAX_OBJECT_SIZE){
-        pthread_rwlock_unlock(&listlock);
-        pthread_rwlock_unlock(&cachelock);
+static obj *new_obj(char *uri, uint64_t hash, int fd, size_t size)
+{
+	obj *o = Calloc(1, sizeof(obj));
 
-		return -1;
+	o->node.size = size;
+	o->node.hash = hash;
+	o->refcnt = 1;
+	o->uri = Malloc(strlen(uri) + 1);
+	strcpy(o->uri, uri);
+	o->fd = fd;
+	return o;
+}
+
+/*
+ * cache_obj - add o to the cache, which takes its own pin, if admitted
+ *     and not cached already, then evict until the cache fits; 1 if
+ *     added. Evicted objects, and o if refused, are demoted to the
+ *     disk tier.
+ */
+static int cache_obj(obj *o)
+{
+	uint64_t hash = o->node.hash;
+	shard *s = &shards[hash & (nshards - 1)];
+	struct pnode *victim;
+	obj *evicted;
+	unsigned idle = 0;
+	int admit = 1;
+
+	/* Only an insert that displaces something has to earn its place */
+	if (config.admission && __sync_fetch_and_add(&total, 0) + o->node.size > config.max_size) {
+		pthread_rwlock_wrlock(&s->lock);
+		if ((victim = policy_next(&s->policy)) != NULL)
+			admit = tinylfu_admit(&sketch, hash, victim->hash);
+		pthread_rwlock_unlock(&s->lock);
+		if (!admit) {
+			if (config.disk_dir != NULL)
+				disk_put(o->uri, hash, o->fd, o->node.size);
+			return 0;
+		}
 	}
 
-	while(cache.size+size > MAX_CACHE_SIZE){
-			cacheevit();
+	pthread_rwlock_wrlock(&s->lock);
+	if (lookup(s, o->uri, hash) != NULL) { /* another miss got here first */
+		pthread_rwlock_unlock(&s->lock);
+		return 0;
 	}
+	o->refcnt++;
+	o->chain = *bucket(s, hash);
+	*bucket(s, hash) = o;
+	policy_insert(&s->policy, &o->node);
+	if (++s->count > s->nbuckets)
+		grow(s);
+	pthread_rwlock_unlock(&s->lock);
 
-	obj *newobj = malloc(sizeof(obj));
-		newobj->size=size;
-		newobj->uri = malloc(strlen(uri)+1);
-		newobj->buf = malloc(size);
-		memcpy(newobj->buf,buf,size);
-		memcpy(newobj->uri,uri,strlen(uri));
-		(newobj->uri)[strlen(uri)] = '\0';
-		
-		if(cache.size == 0){
-			newobj->next = NULL;
-			newobj->prev = NULL;
-			cache.head = newobj;
-			cache.tail = newobj;
-			cache.size += newobj->size;
-		}
-		else{
-			newobj->next = NULL;
-			newobj->prev = cache.tail;
-			(cache.tail)->next = newobj;
-			cache.tail = newobj;
-			cache.size += newobj->size;
+	/* Evict round the shards until the whole cache fits; stop after a sweep frees nothing */
+	__sync_fetch_and_add(&total, o->node.size);
+	while (__sync_fetch_and_add(&total, 0) > config.max_size && idle < nshards) {
+		shard *v = &shards[__sync_fetch_and_add(&hand, 1) & (nshards - 1)];
+
+		pthread_rwlock_wrlock(&v->lock);
+		evicted = cacheevict(v);
+		pthread_rwlock_unlock(&v->lock);
+		if (evicted == NULL) {
+			idle++;
+			continue;
 		}
-		pthread_rwlock_unlock(&listlock);
-		pthread_rwlock_unlock(&cachelock);
-		return 1;		
-}
-obj *cachehit(char *uri){
-	obj*ptr = NULL;
-	pthread_rwlock_rdlock(&cachelock);
-	pthread_rwlock_wrlock(&listlock);
-
-	ptr = cache.head;
-
-
-	while(ptr != NULL){
-		if(strcmp(ptr->uri,uri)==0)
-		{
-			if(ptr->prev != NULL && ptr->next != NULL)
-			{
-				(ptr->prev)->next=ptr->next;
-				(ptr->next)->prev=ptr->prev;
-
-				 ptr->next = NULL;
-			     ptr->prev = cache.tail;
-                 (cache.tail)->next = ptr;
-                 cache.tail = ptr;
-			}
-			else if(ptr->prev != NULL && ptr->next == NULL)
-			{
-				
-				(ptr->prev)->next=NULL;
-				cache.tail=ptr->prev;
-			}
-			else if(ptr->prev == NULL && ptr->next != NULL)
-			{
-				(ptr->next)->prev=NULL;
-				cache.head=ptr->next;
-
-				ptr->next = NULL;
-			    ptr->prev = cache.tail;
-                (cache.tail)->next = ptr;
-                cache.tail = ptr;
-			}
-			else
-			{
-				cache.head=NULL;
-				cache.tail=NULL;
-			}
+		__sync_fetch_and_sub(&total, evicted->node.size);
+		idle = 0;
+		if (config.disk_dir != NULL)
+			disk_put(evicted->uri, evicted->node.hash, evicted->fd, evicted->node.size);
+		cacheput(evicted);	/* readers still holding it free it last */
+	}
+	return 1;
+}
 
-			pthread_rwlock_unlock(&listlock);
-			pthread_rwlock_unlock(&cachelock);
+/*
+ * cacheadopt - cache the first cachecnt bytes of fd for uri, as
+ *     cacheinsert; fd belongs to the cache from here on either way
+ */
+int cacheadopt(char *uri, int fd, size_t cachecnt)
+{
+	obj *o;
+	int rc;
 
-			return ptr;	     
-		}
-		ptr = ptr->next;
+	if (cachecnt == 0 || cachecnt > config.max_object) {
+		close(fd);
+		return cachecnt ? -1 : 0;
 	}
+	o = new_obj(uri, hash_uri(uri), fd, cachecnt);
+	rc = cache_obj(o);
+	cacheput(o);
+	return rc;
+}
 
-    pthread_rwlock_unlock(&listlock);   
-	pthread_rwlock_unlock(&cachelock);
-	return NULL;
+/* Read uri's object back from the disk tier into memory, or NULL; it is cached again if admitted */
+static obj *promote(char *uri, uint64_t hash)
+{
+	ssize_t size;
+	obj *o;
+	int fd;
+
+	if ((fd = cachememfd()) < 0)
+		return NULL;
+	if ((size = disk_get(uri, hash, fd)) < 0) {
+		close(fd);
+		return NULL;
+	}
+	o = new_obj(uri, hash, fd, size);
+	cache_obj(o);
+	return o;
 }
-void cacheclose(){
-	obj *ptr = cache.head;
-	obj *tmp = NULL;	
 
-	while(ptr != NULL) {
-		tmp = ptr;
-		ptr = ptr->next;
-		Free(tmp->buf);
-		Free(tmp->uri);
-		Free(tmp);
+obj *cacheget(char *uri)
+{
+	uint64_t hash = hash_uri(uri);
+	shard *s = &shards[hash & (nshards - 1)];
+	obj *o;
+
+	if (config.admission)
+		tinylfu_record(&sketch, hash);
+	if (config.policy == POLICY_LRU)
+		pthread_rwlock_wrlock(&s->lock);
+	else
+		pthread_rwlock_rdlock(&s->lock);
+	if ((o = lookup(s, uri, hash)) != NULL) {
+		__sync_fetch_and_add(&o->refcnt, 1);
+		policy_hit(&s->policy, &o->node);
+	}
+	pthread_rwlock_unlock(&s->lock);
+	if (o == NULL && config.disk_dir != NULL)
+		o = promote(uri, hash);
+	return o;
+}
+
+void cacheclose()
+{
+	obj *ptr, *tmp;
+
+	for (unsigned i = 0; i < nshards; i++) {
+		for (size_t b = 0; b < shards[i].nbuckets; b++) {
+			for (ptr = shards[i].buckets[b]; ptr != NULL; ) {
+				tmp = ptr;
+				ptr = ptr->chain;
+				cacheput(tmp);
+			}
+		}
+		Free(shards[i].buckets);
+		policy_free(&shards[i].policy);
+		pthread_rwlock_destroy(&shards[i].lock);
 	}
+	if (config.admission)
+		tinylfu_free(&sketch);
+	if (config.disk_dir != NULL)
+		disk_close();
+	Free(shards);
+	shards = NULL;
+	nshards = 0;
+}
 
-	pthread_rwlock_destroy(&cachelock);
-	pthread_rwlock_destroy(&listlock);
+void cachesync()
+{
+	obj *ptr;
 
-	return;
+	if (config.disk_dir == NULL)
+		return;
+	for (unsigned i = 0; i < nshards; i++) {
+		pthread_rwlock_rdlock(&shards[i].lock);
+		for (size_t b = 0; b < shards[i].nbuckets; b++)
+			for (ptr = shards[i].buckets[b]; ptr != NULL; ptr = ptr->chain)
+				disk_put(ptr->uri, ptr->node.hash, ptr->fd, ptr->node.size);
+		pthread_rwlock_unlock(&shards[i].lock);
+	}
 }
-void print_cache(){
+
+void print_cache()
+{
 	int objcnt = 0;
-	obj *ptr = NULL;
-    printf("***** Cache (size = %u) ******\n",(unsigned int)cache.size);
-    
-    ptr = cache.head;
-    while (ptr != NULL){
-       objcnt++;
-       printf("p[%d]\t%s\n", objcnt, ptr->uri);
-       ptr = ptr->next;
-    }
-    printf("*** end (object count = %d) ***\n", objcnt);
-    return;
-}
\ No newline at end of file
+	obj *ptr;
+
+	printf("***** Cache (size = %u, %u shards, %s%s) ******\n", (unsigned int)total, nshards,
+		policy_name(config.policy), config.admission ? " + TinyLFU" : "");
+	for (unsigned i = 0; i < nshards; i++) {
+		pthread_rwlock_rdlock(&shards[i].lock);
+		for (size_t b = 0; b < shards[i].nbuckets; b++) {
+			for (ptr = shards[i].buckets[b]; ptr != NULL; ptr = ptr->chain) {
+				objcnt++;
+				printf("p[%d]\tshard %u\t%s\n", objcnt, i, ptr->uri);
+			}
+		}
+		pthread_rwlock_unlock(&shards[i].lock);
+	}
+	printf("*** end (object count = %d) ***\n", objcnt);
+}
@@ -1,28 +1,87 @@
+/*
+ * cache.h - The proxy's object cache: a hash table keyed by URI, split
+ *     into shards that each have their own lock, table and replacement
+ *     policy (see policy.h), so lookups of different URIs rarely
+ *     contend. A TinyLFU filter (see tinylfu.h) can keep objects that
+ *     are seldom asked for from displacing popular ones.
+ *
+ * Cached objects are immutable and reference counted. cacheget pins an
+ * object under a shared lock and only counts the hit; the caller sends
+ * it with no lock held and unpins it with cacheput. An object evicted
+ * while pinned is freed by its last cacheput.
+ *
+ * Each object's bytes live in a memfd, so a hit goes to the client
+ * with sendfile and a miss can be spliced into the cache without
+ * passing through user space.
+ *
+ * Given a directory, objects evicted from memory are demoted to a
+ * log-structured disk tier (see disk.h), which survives restarts; a
+ * miss in memory that hits on disk is promoted back.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
 #include "csapp.h"
+#include <stdint.h>
+#include "policy.h"
 
+/* Recommended max cache and object sizes */
 #define MAX_CACHE_SIZE 1049000
 #define MAX_OBJECT_SIZE 102400
 
-struct cacheobj 
+#define CACHE_SHARDS 16		/* default shard count, a power of two */
+#define DISK_CACHE_SIZE (64 << 20)	/* default disk tier size */
+
+struct cacheconfig
+{
+	int shards;			/* rounded up to a power of two */
+	size_t max_size;		/* bytes in all */
+	size_t max_object;		/* largest object cached */
+	int policy;			/* POLICY_* */
+	int admission;			/* filter inserts through TinyLFU */
+	const char *disk_dir;		/* the disk tier's directory, or NULL for none */
+	size_t disk_size;		/* bytes on disk in all */
+};
+
+struct cacheobj
 {
-	size_t size;
-	struct cacheblock *prev,*next;
-	char *uri,*buf;
+	struct pnode node;		/* size, hash and policy state */
+	int refcnt;			/* pins, plus one while cached */
+	struct cacheobj *chain;		/* hash bucket */
+	char *uri;
+	int fd;				/* memfd holding the response */
 };
 
-typedef struct cacheobj obj; 
+typedef struct cacheobj obj;
 
-struct Cache
+struct cacheshard
 {
-	size_t size;
-	obj *head,*tail;
+	pthread_rwlock_t lock;		/* shared for lookups, exclusive for changes */
+	struct policy policy;
+	obj **buckets;
+	size_t nbuckets,count;
 };
 
-typedef struct Cache Cache;
+typedef struct cacheshard shard;
 
-void init_cache();
-void cacheevit();
+/* The defaults: MAX_CACHE_SIZE, MAX_OBJECT_SIZE, CACHE_SHARDS, S3-FIFO with TinyLFU, no disk tier */
+void cacheconfig_init(struct cacheconfig *config);
+void init_cache(const struct cacheconfig *config);
+/* The largest object the cache takes */
+size_t cachemaxobject(void);
 int cacheinsert(char*uri,size_t bufsize,char*buf);
-obj *cachehit(char*uri);
+/* A new, empty memfd for an object */
+int cachememfd(void);
+/* Like cacheinsert, but the object is the first size bytes of fd, which the cache takes over */
+int cacheadopt(char*uri,int fd,size_t size);
+/* sendfile the rest of o from *off to sockfd; as sendfile, advancing *off */
+ssize_t cachesend(int sockfd,obj*o,off_t*off);
+/* Pin the object cached for uri, or NULL; release it with cacheput */
+obj *cacheget(char*uri);
+void cacheput(obj*o);
 void cacheclose();
+/* Demote everything in memory to the disk tier too, so a restart finds it */
+void cachesync();
 void print_cache();
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,146 @@
+/*
+ * cachebench.c - Multithreaded microbenchmark of the proxy cache:
+ *     lookups per second against thread count, with one shard (a single
+ *     lock) and with the sharded table.
+ *
+ * usage: ./cachebench [-t <max threads>] [-s <shards>] [-k <keys>] [-b <bytes>] [-d <secs>]
+ *
+ * Each thread looks up uniformly random keys out of <keys> objects of
+ * <bytes> bytes and inserts on a miss, as the proxy does. The keys fit
+ * in the cache by default, so nearly every lookup hits.
+ */
+#include "csapp.h"
+#include "cache.h"
+#include <sys/time.h>
+
+static int keys = 4000, bytes = 200;
+static volatile int stop;
+
+struct worker {
+	pthread_t tid;
+	unsigned seed;
+	long lookups, hits;
+};
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void key_uri(char *uri, int k)
+{
+	sprintf(uri, "http://origin.example:8080/objects/%d.html", k);
+}
+
+static void *run(void *vargp)
+{
+	struct worker *w = vargp;
+	char uri[MAXLINE], *body = Calloc(1, bytes);
+	unsigned x = w->seed;
+	obj *o;
+
+	while (!stop) {
+		for (int i = 0; i < 256; i++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			key_uri(uri, x % keys);
+			if ((o = cacheget(uri)) != NULL) {
+				w->hits++;
+				cacheput(o);
+			}
+			else
+				cacheinsert(uri, bytes, body);
+			w->lookups++;
+		}
+	}
+	Free(body);
+	return NULL;
+}
+
+/* Lookups per second with threads threads on a cache of shards shards */
+static double measure(int threads, int shards, double secs, double *hit_rate)
+{
+	struct worker *w = Calloc(threads, sizeof(struct worker));
+	char uri[MAXLINE], *body = Calloc(1, bytes);
+	struct cacheconfig config;
+	long lookups = 0, hits = 0;
+	double start, elapsed;
+
+	cacheconfig_init(&config);
+	config.shards = shards;
+	config.admission = 0;
+	init_cache(&config);
+	for (int k = 0; k < keys; k++) {
+		key_uri(uri, k);
+		cacheinsert(uri, bytes, body);
+	}
+	stop = 0;
+	start = now();
+	for (int i = 0; i < threads; i++) {
+		w[i].seed = 2463534242u + i * 7919;
+		Pthread_create(&w[i].tid, NULL, run, &w[i]);
+	}
+	usleep(secs * 1e6);
+	stop = 1;
+	for (int i = 0; i < threads; i++) {
+		Pthread_join(w[i].tid, NULL);
+		lookups += w[i].lookups;
+		hits += w[i].hits;
+	}
+	elapsed = now() - start;
+	cacheclose();
+	*hit_rate = lookups ? (double)hits / lookups : 0;
+	Free(w);
+	Free(body);
+	return lookups / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = 16, shards = CACHE_SHARDS, c;
+	double secs = 1, one, many, hit1, hitn;
+	char label[32];
+
+	while ((c = getopt(argc, argv, "t:s:k:b:d:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			shards = atoi(optarg);
+			break;
+		case 'k':
+			keys = atoi(optarg);
+			break;
+		case 'b':
+			bytes = atoi(optarg);
+			break;
+		case 'd':
+			secs = atof(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t <max threads>] [-s <shards>] [-k <keys>] "
+				"[-b <bytes>] [-d <secs>]\n", argv[0]);
+			exit(1);
+		}
+	}
+	if (max_threads < 1 || shards < 1 || keys < 1 || bytes < 1 || bytes > MAX_OBJECT_SIZE) {
+		fprintf(stderr, "%s: bad arguments\n", argv[0]);
+		exit(1);
+	}
+
+	printf("%d keys of %d bytes, %.1fs per run, %ld cpus\n", keys, bytes, secs,
+		sysconf(_SC_NPROCESSORS_ONLN));
+	snprintf(label, sizeof(label), "%d shards/s", shards);
+	printf("%7s %14s %14s %8s\n", "threads", "1 shard/s", label, "hit rate");
+	for (int t = 1; t <= max_threads; t *= 2) {
+		one = measure(t, 1, secs, &hit1);
+		many = measure(t, shards, secs, &hitn);
+		printf("%7d %14.0f %14.0f %7.1f%%\n", t, one, many, 100 * hitn);
+	}
+	return 0;
+}
@@ -0,0 +1,398 @@
+/*
+ * disk.c - Log-structured disk tier of the cache, see disk.h
+ */
+#define _GNU_SOURCE
+#include "csapp.h"
+#include "disk.h"
+#include <dirent.h>
+#include <sys/sendfile.h>
+#include <time.h>
+
+#define DISK_MAGIC 0x31445850		/* "PXD1" */
+#define INITIAL_BUCKETS 1024
+#define LATENCY_SLOTS 10000		/* read latencies by microsecond, up to 10 ms */
+
+struct diskrec {			/* on disk, followed by the URI and the response */
+	uint32_t magic;
+	uint32_t urilen;
+	uint64_t size;
+	uint64_t hash;
+};
+
+struct segment {
+	unsigned id;
+	int fd;
+	size_t len;
+	int refcnt;			/* readers, plus one while in the store */
+	struct segment *next;		/* the next newer segment */
+};
+
+struct entry {
+	uint64_t hash;
+	char *uri;
+	struct segment *seg;
+	off_t off;			/* of the response within seg */
+	size_t size;
+	struct entry *chain;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static char *root;			/* the directory, or NULL while closed */
+static size_t capacity, segment_size, total;
+static struct segment *oldest, *active;	/* appends go to active, the newest */
+static int nsegments;
+static unsigned next_id = 1;
+static struct entry **buckets;
+static size_t nbuckets, count;
+static long demoted, hits, misses, max_us;
+static long latency[LATENCY_SLOTS + 1];	/* the last slot counts slower reads */
+static double rebuild_ms;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static struct entry **bucket(uint64_t hash)
+{
+	return &buckets[(hash >> 32) & (nbuckets - 1)];
+}
+
+/* The link to uri's entry; it points to NULL if uri is not stored */
+static struct entry **find(const char *uri, uint64_t hash)
+{
+	struct entry **pp;
+
+	for (pp = bucket(hash); *pp != NULL; pp = &(*pp)->chain)
+		if ((*pp)->hash == hash && !strcmp((*pp)->uri, uri))
+			break;
+	return pp;
+}
+
+static void grow(void)
+{
+	struct entry **old = buckets, *e, *next;
+	size_t n = nbuckets;
+
+	nbuckets *= 2;
+	buckets = Calloc(nbuckets, sizeof(struct entry *));
+	for (size_t i = 0; i < n; i++) {
+		for (e = old[i]; e != NULL; e = next) {
+			next = e->chain;
+			e->chain = *bucket(e->hash);
+			*bucket(e->hash) = e;
+		}
+	}
+	Free(old);
+}
+
+/* Index uri at off in seg, replacing any older record of it */
+static void add_entry(const char *uri, uint64_t hash, struct segment *seg, off_t off, size_t size)
+{
+	struct entry *e;
+
+	if ((e = *find(uri, hash)) == NULL) {
+		e = Calloc(1, sizeof(struct entry));
+		e->hash = hash;
+		e->uri = Malloc(strlen(uri) + 1);
+		strcpy(e->uri, uri);
+		e->chain = *bucket(hash);
+		*bucket(hash) = e;
+		if (++count > nbuckets)
+			grow();
+	}
+	e->seg = seg;
+	e->off = off;
+	e->size = size;
+}
+
+static void segment_path(char *path, size_t n, unsigned id)
+{
+	snprintf(path, n, "%s/seg.%08u", root, id);
+}
+
+static struct segment *add_segment(unsigned id, int fd)
+{
+	struct segment *s = Calloc(1, sizeof(struct segment)), **pp;
+
+	s->id = id;
+	s->fd = fd;
+	s->refcnt = 1;
+	for (pp = &oldest; *pp != NULL; pp = &(*pp)->next)
+		;
+	*pp = s;
+	nsegments++;
+	return s;
+}
+
+static void segput(struct segment *s)
+{
+	if (--s->refcnt == 0) {
+		close(s->fd);
+		Free(s);
+	}
+}
+
+/* Drop the oldest segment and every entry in it */
+static void evict_segment(void)
+{
+	struct segment *s = oldest;
+	struct entry **pp, *e;
+	char path[MAXLINE];
+
+	for (size_t b = 0; b < nbuckets; b++) {
+		for (pp = &buckets[b]; (e = *pp) != NULL; ) {
+			if (e->seg == s) {
+				*pp = e->chain;
+				Free(e->uri);
+				Free(e);
+				count--;
+			}
+			else
+				pp = &e->chain;
+		}
+	}
+	oldest = s->next;
+	nsegments--;
+	total -= s->len;
+	segment_path(path, sizeof(path), s->id);
+	unlink(path);
+	segput(s);	/* readers still copying from it close it last */
+}
+
+/* Start a new segment for appends; -1 on error */
+static int roll(void)
+{
+	char path[MAXLINE];
+	int fd;
+
+	segment_path(path, sizeof(path), next_id);
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+		return -1;
+	active = add_segment(next_id++, fd);
+	return 0;
+}
+
+/* Index the records of segment id, cutting off a torn last record; -1 on error */
+static int load_segment(unsigned id)
+{
+	char path[MAXLINE], uri[MAXLINE];
+	struct diskrec rec;
+	struct segment *s;
+	struct stat st;
+	off_t off = 0, end;
+	int fd;
+
+	segment_path(path, sizeof(path), id);
+	if ((fd = open(path, O_RDWR | O_CLOEXEC)) < 0)
+		return -1;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	s = add_segment(id, fd);
+	while (pread(fd, &rec, sizeof(rec), off) == sizeof(rec) && rec.magic == DISK_MAGIC &&
+		rec.urilen < MAXLINE && rec.size <= st.st_size &&
+		(end = off + sizeof(rec) + rec.urilen + rec.size) <= st.st_size &&
+		pread(fd, uri, rec.urilen, off + sizeof(rec)) == rec.urilen) {
+		uri[rec.urilen] = '\0';
+		add_entry(uri, rec.hash, s, off + sizeof(rec) + rec.urilen, rec.size);
+		off = end;
+	}
+	if (off < st.st_size && ftruncate(fd, off) < 0)
+		return -1;
+	s->len = off;
+	total += off;
+	return 0;
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+	unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int disk_open(const char *dir, size_t size)
+{
+	unsigned *ids = NULL, id;
+	size_t n = 0;
+	struct dirent *de;
+	double start = now_ms();
+	DIR *d;
+	int rc = 0;
+
+	if ((mkdir(dir, 0755) < 0 && errno != EEXIST) || (d = opendir(dir)) == NULL)
+		return -1;
+	pthread_mutex_lock(&lock);
+	root = Malloc(strlen(dir) + 1);
+	strcpy(root, dir);
+	capacity = size;
+	segment_size = size / DISK_SEGMENTS;
+	nbuckets = INITIAL_BUCKETS;
+	buckets = Calloc(nbuckets, sizeof(struct entry *));
+	while ((de = readdir(d)) != NULL) {
+		if (sscanf(de->d_name, "seg.%u", &id) != 1)
+			continue;
+		ids = Realloc(ids, (n + 1) * sizeof(unsigned));
+		ids[n++] = id;
+	}
+	closedir(d);
+
+	/* Oldest first, so a later record of a URI wins */
+	qsort(ids, n, sizeof(unsigned), compare_ids);
+	for (size_t i = 0; i < n && rc == 0; i++) {
+		rc = load_segment(ids[i]);
+		next_id = ids[i] + 1;
+	}
+	Free(ids);
+	for (active = oldest; active != NULL && active->next != NULL; active = active->next)
+		;
+	if (rc == 0 && (active == NULL || active->len >= segment_size))
+		rc = roll();	/* else keep appending to the newest segment */
+	while (rc == 0 && total > capacity && oldest != active)
+		evict_segment();
+	rebuild_ms = now_ms() - start;
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+void disk_close(void)
+{
+	struct entry *e, *next;
+
+	pthread_mutex_lock(&lock);
+	if (root != NULL) {
+		for (size_t b = 0; b < nbuckets; b++) {
+			for (e = buckets[b]; e != NULL; e = next) {
+				next = e->chain;
+				Free(e->uri);
+				Free(e);
+			}
+		}
+		Free(buckets);
+		while (oldest != NULL) {
+			struct segment *s = oldest;
+
+			oldest = s->next;
+			segput(s);
+		}
+		Free(root);
+		root = NULL;
+		active = NULL;
+		nsegments = 0;
+		total = count = 0;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/* sendfile n bytes of in from *off to out's file position; -1 on error */
+static int copy_range(int out, int in, off_t *off, size_t n)
+{
+	ssize_t m;
+
+	while (n > 0) {
+		if ((m = sendfile(out, in, off, n)) < 0 && errno == EINTR)
+			continue;
+		if (m <= 0)
+			return -1;
+		n -= m;
+	}
+	return 0;
+}
+
+int disk_put(const char *uri, uint64_t hash, int fd, size_t size)
+{
+	struct diskrec rec = { DISK_MAGIC, strlen(uri), size, hash };
+	size_t len = sizeof(rec) + rec.urilen + size;
+	off_t start, in = 0;
+	int rc = 0;
+
+	pthread_mutex_lock(&lock);
+	if (root == NULL || len > capacity || rec.urilen >= MAXLINE || *find(uri, hash) != NULL)
+		goto out;
+	if (active->len > 0 && active->len + len > segment_size && roll() < 0)
+		goto out;
+	start = active->len;
+	if (pwrite(active->fd, &rec, sizeof(rec), start) != sizeof(rec) ||
+		pwrite(active->fd, uri, rec.urilen, start + sizeof(rec)) != rec.urilen ||
+		lseek(active->fd, start + sizeof(rec) + rec.urilen, SEEK_SET) < 0 ||
+		copy_range(active->fd, fd, &in, size) < 0) {
+		if (ftruncate(active->fd, start) < 0)
+			active->len = lseek(active->fd, 0, SEEK_END);	/* skip what was written */
+		goto out;
+	}
+	active->len += len;
+	total += len;
+	add_entry(uri, hash, active, start + sizeof(rec) + rec.urilen, size);
+	demoted++;
+	rc = 1;
+	while (total > capacity && oldest != active)
+		evict_segment();
+out:
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+ssize_t disk_get(const char *uri, uint64_t hash, int fd)
+{
+	double start = now_ms();
+	struct segment *s;
+	struct entry *e;
+	size_t size;
+	off_t off;
+	long us;
+	int rc;
+
+	pthread_mutex_lock(&lock);
+	if (root == NULL || (e = *find(uri, hash)) == NULL) {
+		misses++;
+		pthread_mutex_unlock(&lock);
+		return -1;
+	}
+	s = e->seg;
+	s->refcnt++;
+	off = e->off;
+	size = e->size;
+	pthread_mutex_unlock(&lock);
+
+	rc = copy_range(fd, s->fd, &off, size);
+
+	us = (now_ms() - start) * 1000;
+	pthread_mutex_lock(&lock);
+	segput(s);
+	if (rc == 0) {
+		hits++;
+		latency[us < LATENCY_SLOTS ? us : LATENCY_SLOTS]++;
+		if (us > max_us)
+			max_us = us;
+	}
+	pthread_mutex_unlock(&lock);
+	return rc < 0 ? -1 : size;
+}
+
+/* The read latency, in microseconds, that fraction q of hits came within */
+static long percentile(double q)
+{
+	long seen = 0;
+
+	for (int i = 0; i < LATENCY_SLOTS; i++)
+		if ((seen += latency[i]) >= q * hits)
+			return i;
+	return max_us;
+}
+
+void disk_report(FILE *fp)
+{
+	pthread_mutex_lock(&lock);
+	fprintf(fp, "disk: %zu objects, %zu bytes in %d segments, index rebuilt in %.1f ms; "
+		"%ld demoted, %ld hits, %ld misses\n", count, total, nsegments, rebuild_ms,
+		demoted, hits, misses);
+	if (hits > 0)
+		fprintf(fp, "disk read latency us: p50 %ld p90 %ld p99 %ld max %ld\n",
+			percentile(0.5), percentile(0.9), percentile(0.99), max_us);
+	pthread_mutex_unlock(&lock);
+}
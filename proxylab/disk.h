@@ -0,0 +1,36 @@
+/*
+ * disk.h - The cache's second tier: a log-structured object store on
+ *     disk, fed by objects the memory cache evicts.
+ *
+ * Objects are appended to segment files (seg.00000001, ...) in one
+ * directory, each as a record header, the URI and the response. An
+ * in-memory hash index maps URIs to records. Space is reclaimed a whole
+ * segment at a time, oldest first, so the store never rewrites a file.
+ * On open the index is rebuilt by walking the record headers of every
+ * segment; a record cut short by a crash ends its segment.
+ *
+ * The tier has one lock. Appends hold it while they write; reads only
+ * look up the record under it and pin its segment, then copy with the
+ * lock released, so an evicted segment is closed by its last reader.
+ */
+#ifndef __DISK_H__
+#define __DISK_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define DISK_SEGMENTS 16	/* the capacity is split into about this many segments */
+
+/* Open, or create, the store in dir, holding at most capacity bytes; -1 on error */
+int disk_open(const char *dir, size_t capacity);
+void disk_close(void);
+/* Append the first size bytes of fd for uri unless it is stored already; 1 if appended */
+int disk_put(const char *uri, uint64_t hash, int fd, size_t size);
+/* Copy the object stored for uri to the start of fd; its size, or -1 if not stored */
+ssize_t disk_get(const char *uri, uint64_t hash, int fd);
+/* Print object counts, hit counts and read latency percentiles */
+void disk_report(FILE *fp);
+
+#endif /* __DISK_H__ */
@@ -0,0 +1,62 @@
+#!/bin/bash
+#
+# diskbench.sh - Hit ratio of the proxy cache with and without the disk
+#     tier, before and after a restart, and the tier's read latency.
+#
+# Each run replays the same requests: <urls> objects of <size> bytes
+# requested round robin, a working set far bigger than the memory
+# cache. The hit ratio counts the requests that did not reach the
+# origin. "restart" reuses the disk tier the run before left behind.
+#
+# usage: ./diskbench.sh [thread|pool]     (default: thread)
+#
+# Environment: ORIGIN_PORT, PROXY_PORT, CONNS, REQUESTS, URLS, SIZE,
+#     DISK_DIR, DROP_CACHES (1 to drop the page cache before the
+#     restart, so disk reads really go to the device; needs root).
+#
+ORIGIN_PORT=${ORIGIN_PORT:-9000}
+PROXY_PORT=${PROXY_PORT:-9100}
+CONNS=${CONNS:-20}
+REQUESTS=${REQUESTS:-10000}
+URLS=${URLS:-2000}
+SIZE=${SIZE:-20000}
+DISK_DIR=${DISK_DIR:-/tmp/diskbench.$$}
+MODE=${1:-thread}
+
+make -s proxy loadgen origin || exit 1
+
+./origin ${ORIGIN_PORT} 2> /dev/null &
+origin_pid=$!
+trap "kill ${origin_pid} 2> /dev/null; rm -rf ${DISK_DIR}" EXIT
+sleep 0.5
+
+origin_requests() {
+    curl -s http://127.0.0.1:${ORIGIN_PORT}/stats | awk '{ print $2 }'
+}
+
+# run <label> [<proxy args> ...]
+run() {
+    label=$1
+    shift
+    ./proxy -m ${MODE} "$@" ${PROXY_PORT} 2> /tmp/diskbench.err.$$ &
+    proxy_pid=$!
+    sleep 0.5
+    before=`origin_requests`
+    result=`./loadgen -c ${CONNS} -n ${REQUESTS} -U ${URLS} -x 127.0.0.1:${PROXY_PORT} \
+        "http://127.0.0.1:${ORIGIN_PORT}/disk?size=${SIZE}"`
+    after=`origin_requests`
+    kill -TERM ${proxy_pid}
+    wait ${proxy_pid} 2> /dev/null
+    echo "${result}" | awk -v label=${label} -v fetched=$((after - before - 1)) -v n=${REQUESTS} '
+        /req\/s/ { for (i = 1; i <= NF; i++) if ($(i+1) == "req/s") rate = $i }
+        /^latency/ { p99 = $8 }
+        END { printf "%-10s %8d %8.1f%% %9s %9s\n", label, fetched, 100 * (1 - fetched / n), rate, p99 }'
+    sed 's/^/    /' /tmp/diskbench.err.$$
+    rm -f /tmp/diskbench.err.$$
+}
+
+printf "%-10s %8s %9s %9s %9s\n" run origin "hit" "req/s" "p99 ms"
+run memory
+run cold -d ${DISK_DIR}
+[ "${DROP_CACHES}" = 1 ] && sync && echo 3 > /proc/sys/vm/drop_caches
+run restart -d ${DISK_DIR}
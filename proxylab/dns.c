@@ -0,0 +1,546 @@
+/*
+ * dns.c - Caching asynchronous resolver, see dns.h
+ *
+ * Names live in one hash table under one mutex. A lookup that finds
+ * no fresh entry marks the name pending and queues it; a helper thread
+ * sends the query, fills in the entry, wakes the callers blocked on
+ * the resolved condition and calls back those that asked not to block.
+ * Pending entries are never freed, nor ready ones while a blocked
+ * lookup has yet to wake and copy the answer out, so a waiter's
+ * pointer stays good however long it takes to get the lock back.
+ *
+ * Against spoofed replies, each query goes out from a socket of its
+ * own, so from a port the kernel picks afresh, with a random ID, and
+ * a reply counts only if it repeats the question: the same name, type
+ * A and class IN.
+ */
+#include "csapp.h"
+#include "dns.h"
+#include <poll.h>
+#include <time.h>
+#include <sys/random.h>
+
+#define DNS_BUCKETS 1024
+#define DNS_MAX_ENTRIES 8192	/* past this, expired names are swept out */
+#define DNS_PACKET 512
+#define DNS_TRIES 2
+#define NOT_OURS -2		/* parse_answer: a reply to some other query */
+
+enum { PENDING, READY };
+
+struct waiter {
+	void (*done)(void *);
+	void *arg;
+	struct waiter *next;
+};
+
+struct entry {
+	char *name;			/* lower case */
+	int state;
+	int found;			/* READY: addrs is the answer, else it is negative */
+	struct dnsaddrs addrs;
+	long expires;			/* ms on the monotonic clock, -1 for never */
+	struct waiter *waiters;		/* async lookups to call back */
+	int blocked;			/* dns_lookup callers waiting on it, which sweep spares */
+	struct entry *chain, *next_queued;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resolved = PTHREAD_COND_INITIALIZER;	/* a pending entry became ready */
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;	/* the queue is not empty */
+static struct entry *buckets[DNS_BUCKETS], *queue_head, *queue_tail;
+static int count;
+static struct sockaddr_in server;
+static long lookups, hits, negative_hits, waited, queries, failures, query_us;
+
+static long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static struct entry **bucket(const char *name)
+{
+	unsigned h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+	return &buckets[h % DNS_BUCKETS];
+}
+
+static struct entry *find(const char *name)
+{
+	struct entry *e;
+
+	for (e = *bucket(name); e != NULL; e = e->chain)
+		if (!strcmp(e->name, name))
+			return e;
+	return NULL;
+}
+
+/* Free the names whose answers have expired */
+static void sweep(long now)
+{
+	struct entry **pp, *e;
+
+	for (int b = 0; b < DNS_BUCKETS; b++) {
+		for (pp = &buckets[b]; (e = *pp) != NULL; ) {
+			if (e->state == READY && e->blocked == 0 && e->expires >= 0 && e->expires <= now) {
+				*pp = e->chain;
+				Free(e->name);
+				Free(e);
+				count--;
+			}
+			else
+				pp = &e->chain;
+		}
+	}
+}
+
+static struct entry *add(const char *name)
+{
+	struct entry *e;
+
+	if (count >= DNS_MAX_ENTRIES)
+		sweep(now_us() / 1000);
+	e = Calloc(1, sizeof(struct entry));
+	e->name = Malloc(strlen(name) + 1);
+	strcpy(e->name, name);
+	e->chain = *bucket(name);
+	*bucket(name) = e;
+	count++;
+	return e;
+}
+
+/* Mark e pending and queue it for a helper */
+static void enqueue(struct entry *e)
+{
+	e->state = PENDING;
+	e->next_queued = NULL;
+	if (queue_tail != NULL)
+		queue_tail->next_queued = e;
+	else
+		queue_head = e;
+	queue_tail = e;
+	pthread_cond_signal(&queued);
+}
+
+/* Lower-case host into name; -1 if it cannot be a DNS name */
+static int normalize(const char *host, char *name, size_t size)
+{
+	size_t i;
+
+	for (i = 0; host[i]; i++) {
+		if (i == size - 1)
+			return -1;
+		name[i] = tolower((unsigned char)host[i]);
+	}
+	name[i] = '\0';
+	return i > 0 && i <= 253 ? 0 : -1;
+}
+
+static void put16(unsigned char *p, unsigned v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static unsigned get16(const unsigned char *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static long get32(const unsigned char *p)
+{
+	return (long)((uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+}
+
+/* An A query for name into buf; its length, or -1 if name has a bad label */
+static int build_query(unsigned char *buf, const char *name, unsigned id)
+{
+	unsigned char *p = buf + 12;
+	const char *label = name, *dot;
+	size_t len;
+
+	memset(buf, 0, 12);
+	put16(buf, id);
+	buf[2] = 0x01;		/* recursion desired */
+	put16(buf + 4, 1);	/* one question */
+	while (*label) {
+		dot = strchr(label, '.');
+		len = dot ? dot - label : strlen(label);
+		if (len == 0 || len > 63)
+			return -1;
+		*p++ = len;
+		memcpy(p, label, len);
+		p += len;
+		label += dot ? len + 1 : len;
+	}
+	*p++ = 0;
+	put16(p, 1);		/* type A */
+	put16(p + 2, 1);	/* class IN */
+	return p + 4 - buf;
+}
+
+/* The byte after the (possibly compressed) name at p, or NULL if it runs past end */
+static const unsigned char *skip_name(const unsigned char *p, const unsigned char *end)
+{
+	while (p < end) {
+		if ((*p & 0xc0) == 0xc0)
+			return p + 2 <= end ? p + 2 : NULL;
+		if (*p == 0)
+			return p + 1;
+		p += *p + 1;
+	}
+	return NULL;
+}
+
+/* The byte after the question at p if it asks for name's A record in IN, else NULL */
+static const unsigned char *match_question(const unsigned char *p, const unsigned char *end, const char *name)
+{
+	while (p < end && *p != 0) {
+		if (*p > 63 || p + 1 + *p > end)	/* a pointer, or past the end */
+			return NULL;
+		for (int i = 1; i <= *p; i++)
+			if (*name == '\0' || tolower(p[i]) != (unsigned char)*name++)
+				return NULL;
+		p += *p + 1;
+		if (p < end && *p != 0 && *name++ != '.')
+			return NULL;
+	}
+	if (p + 5 > end || *name != '\0' || get16(p + 1) != 1 || get16(p + 3) != 1)
+		return NULL;
+	return p + 5;
+}
+
+/*
+ * parse_answer - the reply to query id for name in buf: 1 with the
+ *     addresses in *a, 0 if the name has none, -1 on a server failure,
+ *     a truncated or a bad reply, NOT_OURS if it answers another query;
+ *     *ttl says for how long
+ */
+static int parse_answer(const unsigned char *buf, size_t n, unsigned id, const char *name,
+		struct dnsaddrs *a, long *ttl)
+{
+	const unsigned char *p = buf + 12, *end = buf + n, *q;
+	long rttl, min = -1, soa = -1;
+	unsigned type, rdlen, an, ns;
+	int rcode;
+
+	if (n < 12 || get16(buf) != id || !(buf[2] & 0x80) || get16(buf + 4) != 1 ||
+		(p = match_question(p, end, name)) == NULL)
+		return NOT_OURS;
+	rcode = buf[3] & 0x0f;
+	if (rcode != 0 && rcode != 3)	/* neither NOERROR nor NXDOMAIN */
+		return -1;
+	if (buf[2] & 0x02)	/* truncated: what is missing may be the addresses */
+		return -1;
+	an = get16(buf + 6);
+	ns = get16(buf + 8);
+	a->n = 0;
+	for (unsigned i = 0; i < an + ns; i++) {
+		if ((p = skip_name(p, end)) == NULL || p + 10 > end)
+			return -1;
+		type = get16(p);
+		rttl = get32(p + 4);
+		rdlen = get16(p + 8);
+		p += 10;
+		if (p + rdlen > end)
+			return -1;
+		if (i < an && (type == 1 || type == 5)) {	/* A, or a CNAME leading to it */
+			if (type == 1 && rdlen == 4 && a->n < DNS_MAX_ADDRS)
+				memcpy(&a->addr[a->n++], p, 4);
+			if (min < 0 || rttl < min)
+				min = rttl;
+		}
+		else if (i >= an && type == 6 && (q = skip_name(p, p + rdlen)) != NULL &&
+			(q = skip_name(q, p + rdlen)) != NULL && q + 20 <= p + rdlen) {
+			/* SOA: a negative answer lasts its TTL or its MINIMUM, the lesser */
+			soa = get32(q + 16) < rttl ? get32(q + 16) : rttl;
+		}
+		p += rdlen;
+	}
+	if (a->n > 0) {
+		*ttl = min;
+		return 1;
+	}
+	*ttl = soa >= 0 ? soa : DNS_NEGATIVE_TTL;
+	return 0;
+}
+
+/* Ask the server about name from a new socket; as parse_answer */
+static int query(const char *name, struct dnsaddrs *a, long *ttl)
+{
+	unsigned char q[DNS_PACKET], buf[DNS_PACKET];
+	struct pollfd pfd;
+	uint16_t id;
+	long deadline, left;
+	int fd, len, rc = NOT_OURS;
+	ssize_t n;
+
+	if (getrandom(&id, sizeof(id), 0) != sizeof(id))
+		return -1;
+	if ((len = build_query(q, name, id)) < 0) {
+		*ttl = DNS_NEGATIVE_TTL;
+		return 0;
+	}
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+		return -1;
+	if (connect(fd, (SA *)&server, sizeof(server)) < 0) {
+		close(fd);
+		return -1;
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	for (int try = 0; try < DNS_TRIES && rc == NOT_OURS; try++) {
+		if (send(fd, q, len, 0) != len)
+			continue;
+		deadline = now_us() / 1000 + DNS_TIMEOUT_MS;
+		while ((left = deadline - now_us() / 1000) > 0 && poll(&pfd, 1, left) > 0) {
+			if ((n = recv(fd, buf, sizeof(buf), 0)) < 0)
+				break;
+			if ((rc = parse_answer(buf, n, id, name, a, ttl)) != NOT_OURS)
+				break;
+		}
+	}
+	close(fd);
+	return rc == NOT_OURS ? -1 : rc;
+}
+
+static void *helper(void *vargp)
+{
+	struct waiter *w, *next;
+	struct dnsaddrs addrs;
+	struct entry *e;
+	long start, ttl;
+	int rc;
+
+	Pthread_detach(Pthread_self());
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		while (queue_head == NULL)
+			pthread_cond_wait(&queued, &lock);
+		e = queue_head;
+		if ((queue_head = e->next_queued) == NULL)
+			queue_tail = NULL;
+		pthread_mutex_unlock(&lock);
+
+		start = now_us();
+		if ((rc = query(e->name, &addrs, &ttl)) < 0)
+			ttl = DNS_FAIL_TTL;
+		else if (ttl < DNS_MIN_TTL)
+			ttl = DNS_MIN_TTL;
+		else if (ttl > DNS_MAX_TTL)
+			ttl = DNS_MAX_TTL;
+
+		pthread_mutex_lock(&lock);
+		queries++;
+		query_us += now_us() - start;
+		if (rc < 0)
+			failures++;
+		e->found = rc > 0;
+		e->addrs = addrs;
+		e->expires = now_us() / 1000 + ttl * 1000;
+		e->state = READY;
+		w = e->waiters;
+		e->waiters = NULL;
+		pthread_cond_broadcast(&resolved);
+		pthread_mutex_unlock(&lock);
+		for (; w != NULL; w = next) {
+			next = w->next;
+			w->done(w->arg);
+			Free(w);
+		}
+	}
+	return NULL;
+}
+
+/* Parse "a.b.c.d[:port]" into server; -1, leaving server be, if it is not one */
+static int parse_server(const char *s)
+{
+	char addr[INET_ADDRSTRLEN];
+	const char *colon = strchr(s, ':');
+	size_t len = colon ? colon - s : strlen(s);
+	struct sockaddr_in sa;
+
+	if (len >= sizeof(addr))
+		return -1;
+	memcpy(addr, s, len);
+	addr[len] = '\0';
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(colon ? atoi(colon + 1) : 53);
+	if (inet_pton(AF_INET, addr, &sa.sin_addr) != 1)
+		return -1;
+	server = sa;
+	return 0;
+}
+
+/* Cache the IPv4 names of /etc/hosts for good */
+static void load_hosts(void)
+{
+	char line[MAXLINE], name[MAXLINE], *tok, *save;
+	struct in_addr addr;
+	struct entry *e;
+	FILE *fp;
+
+	if ((fp = fopen("/etc/hosts", "r")) == NULL)
+		return;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if ((tok = strchr(line, '#')) != NULL)
+			*tok = '\0';
+		if ((tok = strtok_r(line, " \t\n", &save)) == NULL || inet_pton(AF_INET, tok, &addr) != 1)
+			continue;
+		while ((tok = strtok_r(NULL, " \t\n", &save)) != NULL) {
+			if (normalize(tok, name, sizeof(name)) < 0)
+				continue;
+			if ((e = find(name)) == NULL) {
+				e = add(name);
+				e->state = READY;
+				e->found = 1;
+				e->expires = -1;
+			}
+			if (e->addrs.n < DNS_MAX_ADDRS)
+				e->addrs.addr[e->addrs.n++] = addr;
+		}
+	}
+	fclose(fp);
+}
+
+int dns_init(const char *name_server, int helpers)
+{
+	char line[MAXLINE], addr[MAXLINE];
+	FILE *fp;
+	pthread_t tid;
+
+	if (name_server != NULL) {
+		if (parse_server(name_server) < 0)
+			return -1;
+	}
+	else {
+		parse_server("127.0.0.1");	/* the resolver's own default */
+		if ((fp = fopen("/etc/resolv.conf", "r")) != NULL) {
+			while (fgets(line, sizeof(line), fp) != NULL)
+				if (sscanf(line, "nameserver %s", addr) == 1 && parse_server(addr) == 0)
+					break;
+			fclose(fp);
+		}
+	}
+	pthread_mutex_lock(&lock);
+	load_hosts();
+	pthread_mutex_unlock(&lock);
+	for (int i = 0; i < helpers; i++)
+		Pthread_create(&tid, NULL, helper, NULL);
+	return 0;
+}
+
+/*
+ * start - with lock held, 0 or -1 with the answer if name's is fresh,
+ *     else DNS_PENDING with *ep the entry that a helper will fill in
+ */
+static int start(const char *name, struct dnsaddrs *a, struct entry **ep)
+{
+	struct entry *e = find(name);
+
+	lookups++;
+	if (e == NULL)
+		enqueue(e = add(name));
+	else if (e->state == PENDING)
+		waited++;
+	else if (e->expires >= 0 && e->expires <= now_us() / 1000)
+		enqueue(e);	/* expired: ask again */
+	else if (e->found) {
+		hits++;
+		*a = e->addrs;
+		return 0;
+	}
+	else {
+		negative_hits++;
+		return -1;
+	}
+	*ep = e;
+	return DNS_PENDING;
+}
+
+int dns_lookup_async(const char *host, struct dnsaddrs *a, void (*done)(void *), void *arg)
+{
+	char name[MAXLINE];
+	struct entry *e;
+	struct waiter *w;
+	int rc;
+
+	if (inet_pton(AF_INET, host, &a->addr[0]) == 1) {
+		a->n = 1;
+		return 0;
+	}
+	if (normalize(host, name, sizeof(name)) < 0)
+		return -1;
+	pthread_mutex_lock(&lock);
+	if ((rc = start(name, a, &e)) == DNS_PENDING) {
+		w = Malloc(sizeof(struct waiter));
+		w->done = done;
+		w->arg = arg;
+		w->next = e->waiters;
+		e->waiters = w;
+	}
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+int dns_lookup(const char *host, struct dnsaddrs *a)
+{
+	char name[MAXLINE];
+	struct entry *e;
+	int rc;
+
+	if (inet_pton(AF_INET, host, &a->addr[0]) == 1) {
+		a->n = 1;
+		return 0;
+	}
+	if (normalize(host, name, sizeof(name)) < 0)
+		return -1;
+	pthread_mutex_lock(&lock);
+	if ((rc = start(name, a, &e)) == DNS_PENDING) {
+		e->blocked++;
+		while (e->state == PENDING)
+			pthread_cond_wait(&resolved, &lock);
+		if ((rc = e->found ? 0 : -1) == 0)
+			*a = e->addrs;
+		e->blocked--;
+	}
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+int dns_open_clientfd(const char *host, int port)
+{
+	struct sockaddr_in addr;
+	struct dnsaddrs a;
+	int fd;
+
+	if (dns_lookup(host, &a) < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	for (int i = 0; i < a.n; i++) {
+		if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+			return -1;
+		addr.sin_addr = a.addr[i];
+		if (connect(fd, (SA *)&addr, sizeof(addr)) == 0)
+			return fd;
+		close(fd);
+	}
+	return -1;
+}
+
+void dns_report(FILE *fp)
+{
+	pthread_mutex_lock(&lock);
+	fprintf(fp, "dns: %ld lookups, %ld hits, %ld negative hits, %ld waited on a query in flight; "
+		"%ld queries, %ld failed, %.2f ms each; %d names cached\n", lookups, hits, negative_hits,
+		waited, queries, failures, queries ? query_us / 1000.0 / queries : 0.0, count);
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,55 @@
+/*
+ * dns.h - Caching, asynchronous name resolution for the proxy.
+ *
+ * Answers are cached by hostname for the TTL the name server gives
+ * (clamped to DNS_MIN_TTL..DNS_MAX_TTL), and failures are cached too:
+ * NXDOMAIN and names without an address for the TTL of the zone's SOA
+ * record (DNS_NEGATIVE_TTL without one), timeouts, server failures and
+ * truncated replies (there is no TCP fallback) for DNS_FAIL_TTL.
+ * Queries are sent over UDP by a few helper threads, never by a caller,
+ * and a name is only ever asked once at a time: all who want it while
+ * it is being resolved wait for the one answer.
+ *
+ * IP literals, and names in /etc/hosts, are answered at once without a
+ * query.
+ */
+#ifndef __DNS_H__
+#define __DNS_H__
+
+#include <stdio.h>
+#include <netinet/in.h>
+
+#define DNS_HELPERS 2		/* default helper threads */
+#define DNS_MAX_ADDRS 4		/* addresses kept per name */
+#define DNS_MIN_TTL 1
+#define DNS_MAX_TTL 3600
+#define DNS_NEGATIVE_TTL 30
+#define DNS_FAIL_TTL 5
+#define DNS_TIMEOUT_MS 1000	/* per try; a query is tried twice */
+#define DNS_PENDING 1
+
+struct dnsaddrs {
+	int n;
+	struct in_addr addr[DNS_MAX_ADDRS];
+};
+
+/*
+ * dns_init - start helper threads that ask server, "a.b.c.d[:port]"; -1
+ *     if it is not one. If server is NULL they ask the first IPv4
+ *     nameserver in /etc/resolv.conf, or 127.0.0.1 if there is none.
+ */
+int dns_init(const char *server, int helpers);
+/* Resolve host into *a, waiting for a query if need be; 0, or -1 if it has no address */
+int dns_lookup(const char *host, struct dnsaddrs *a);
+/*
+ * dns_lookup_async - as dns_lookup, but rather than wait return
+ *     DNS_PENDING and call done(arg), from a helper thread, once the
+ *     answer is cached; ask again then
+ */
+int dns_lookup_async(const char *host, struct dnsaddrs *a, void (*done)(void *), void *arg);
+/* open_clientfd_r through the cache: a connected socket to host:port, or -1 */
+int dns_open_clientfd(const char *host, int port);
+/* Print lookup, hit and query counts */
+void dns_report(FILE *fp);
+
+#endif /* __DNS_H__ */
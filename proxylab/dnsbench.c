@@ -0,0 +1,142 @@
+/*
+ * dnsbench.c - Latency of the proxy's resolver against a name server,
+ *     normally ./stubdns: lookups that miss and wait for a query, ones
+ *     the cache answers, negative ones both ways, and a herd of threads
+ *     all asking for one name at once.
+ *
+ * usage: ./dnsbench [-r <server>] [-n <names>] [-t <threads>]
+ *
+ * <server> is "a.b.c.d[:port]" (default 127.0.0.1:5353). Names are
+ * made up under .bench.test; the stub answers "nx..." ones NXDOMAIN and
+ * "ttlN-..." ones with a TTL of N seconds.
+ */
+#include "csapp.h"
+#include "dns.h"
+#include <time.h>
+
+static int names = 200, threads = 16;
+
+struct herd {
+	pthread_t tid;
+	const char *name;
+	long us;
+};
+
+static pthread_barrier_t herd_start;
+
+static long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
+
+static int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *label, long *us, int n, int failed)
+{
+	qsort(us, n, sizeof(long), cmp_long);
+	printf("%-24s %8d %10ld %10ld %10ld %8d\n", label, n, us[n / 2],
+		us[n * 99 / 100], us[n - 1], failed);
+}
+
+/* Look up "<prefix><i>.bench.test" for each i, reporting latency under label */
+static void lookups(const char *label, const char *prefix)
+{
+	long *us = Calloc(names, sizeof(long)), start;
+	char host[MAXLINE];
+	struct dnsaddrs a;
+	int failed = 0;
+
+	for (int i = 0; i < names; i++) {
+		sprintf(host, "%s%d.bench.test", prefix, i);
+		start = now_us();
+		if (dns_lookup(host, &a) < 0)
+			failed++;
+		us[i] = now_us() - start;
+	}
+	report(label, us, names, failed);
+	Free(us);
+}
+
+static void *herd_member(void *vargp)
+{
+	struct herd *h = vargp;
+	struct dnsaddrs a;
+	long start;
+
+	pthread_barrier_wait(&herd_start);
+	start = now_us();
+	dns_lookup(h->name, &a);
+	h->us = now_us() - start;
+	return NULL;
+}
+
+/* threads threads look up name together, which should take one query */
+static void herd(const char *label, const char *name)
+{
+	struct herd *h = Calloc(threads, sizeof(struct herd));
+	long *us = Calloc(threads, sizeof(long));
+
+	pthread_barrier_init(&herd_start, NULL, threads);
+	for (int i = 0; i < threads; i++) {
+		h[i].name = name;
+		Pthread_create(&h[i].tid, NULL, herd_member, &h[i]);
+	}
+	for (int i = 0; i < threads; i++) {
+		Pthread_join(h[i].tid, NULL);
+		us[i] = h[i].us;
+	}
+	pthread_barrier_destroy(&herd_start);
+	report(label, us, threads, 0);
+	Free(us);
+	Free(h);
+}
+
+static void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-r <server>] [-n <names>] [-t <threads>]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char *server = "127.0.0.1:5353";
+	int c;
+
+	while ((c = getopt(argc, argv, "r:n:t:")) != -1) {
+		switch (c) {
+		case 'r':
+			server = optarg;
+			break;
+		case 'n':
+			names = atoi(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (names <= 0 || threads <= 0 || dns_init(server, DNS_HELPERS) < 0)
+		usage(argv[0]);
+
+	printf("%-24s %8s %10s %10s %10s %8s\n", "lookups", "n", "p50 us", "p99 us", "max us", "failed");
+	lookups("miss", "host");
+	lookups("hit", "host");
+	lookups("negative miss", "nx");
+	lookups("negative hit", "nx");
+	herd("herd, one name", "herd.bench.test");
+	lookups("ttl 1s, miss", "ttl1-host");
+	sleep(2);
+	lookups("ttl 1s, expired", "ttl1-host");
+	dns_report(stdout);
+	return 0;
+}
@@ -0,0 +1,561 @@
+/*
+ * event.c - Event-driven proxy front end, see event.h
+ *
+ * Every connection is a small state machine driven by its client and
+ * upstream sockets:
+ *
+ *   READ_REQUEST  read the request head until the blank line
+ *   RESOLVE       waiting for the resolver to look up the origin
+ *   CONNECT       non-blocking connect to the origin in progress
+ *   SEND          write the rewritten request upstream
+ *   RELAY         move the response to the client, see relay()
+ *   WRITE         send a cached object or an error page, then close
+ *
+ * Both sockets are registered once, edge-triggered for input and
+ * output, and every event runs the machine until it would block, so no
+ * readiness is ever lost. Buffers are allocated only in the states that
+ * need them, which keeps an idle connection to a few hundred bytes.
+ *
+ * Response bytes never pass through user space: hits go out with
+ * sendfile from the object's memfd, and relays splice through a pipe.
+ *
+ * Origin names are looked up through dns.h without blocking the loop.
+ * A connection whose name is not cached waits on the loop's resolving
+ * list, and the resolver's helper wakes the loop through an eventfd
+ * once the answer is in; the loop then retries every waiting lookup.
+ */
+#define _GNU_SOURCE	/* accept4, splice */
+#include "csapp.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include "cache.h"
+#include "dns.h"
+#include "http.h"
+#include "event.h"
+
+#define MAX_EVENTS 256
+#define PIPE_CHUNK 65536	/* a default pipe's capacity */
+
+enum state { READ_REQUEST, RESOLVE, CONNECT, SEND, RELAY, WRITE };
+
+struct conn;
+
+struct endpoint {
+	int fd;
+	struct conn *conn;
+};
+
+struct conn {
+	struct endpoint client, server;
+	enum state state;
+	char *req;			/* request head, MAXBUF bytes while reading it */
+	size_t req_len;
+	char uri[MAXLINE];
+	char *out;			/* error page for the client */
+	size_t out_len, out_off;
+	obj *cached;			/* pinned cache hit being sent */
+	off_t cached_off;
+	int pipefd[2];			/* relay: server -> pipe -> memfd or client */
+	size_t piped;			/* bytes waiting in the pipe */
+	int memfd;			/* relay: the response so far, for the cache */
+	loff_t mem_len;
+	off_t mem_sent;
+	int caching;			/* the response still fits in the cache */
+	int server_eof;
+	int closed;
+	struct conn *next_dead;
+	struct conn *next_resolving;
+};
+
+struct loop {
+	int epfd, listenfd;
+	int wakefd;			/* eventfd the resolver signals */
+	struct conn *dead;		/* closed this round, freed after the event batch */
+	struct conn *resolving;		/* waiting for a name, see start_connect */
+};
+
+static int set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+
+	return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int watch(struct loop *lp, struct endpoint *e)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.ptr = e;
+	return epoll_ctl(lp->epfd, EPOLL_CTL_ADD, e->fd, &ev);
+}
+
+/*
+ * The batch from epoll_wait may still hold an event for the other
+ * socket of c, so c is only freed once the batch is done
+ */
+static void conn_close(struct loop *lp, struct conn *c)
+{
+	close(c->client.fd);
+	if (c->server.fd >= 0)
+		close(c->server.fd);
+	c->closed = 1;
+	c->next_dead = lp->dead;
+	lp->dead = c;
+}
+
+static void free_dead(struct loop *lp)
+{
+	struct conn *c;
+
+	while ((c = lp->dead) != NULL) {
+		lp->dead = c->next_dead;
+		free(c->req);
+		free(c->out);
+		if (c->cached != NULL)
+			cacheput(c->cached);
+		if (c->pipefd[0] >= 0) {
+			close(c->pipefd[0]);
+			close(c->pipefd[1]);
+		}
+		if (c->memfd >= 0)
+			close(c->memfd);
+		free(c);
+	}
+}
+
+/* Queue out for the client and move to WRITE; out is owned by c */
+static void respond(struct conn *c, char *out, size_t len)
+{
+	free(c->out);
+	c->out = out;
+	c->out_len = len;
+	c->out_off = 0;
+	c->state = WRITE;
+}
+
+static void respond_error(struct conn *c, const char *cause, const char *errnum,
+		const char *shortmsg, const char *longmsg)
+{
+	char *buf = Malloc(MAXBUF);
+
+	respond(c, buf, format_error(buf, MAXBUF, cause, errnum, shortmsg, longmsg));
+}
+
+/* Start a non-blocking connect to one of a's addresses; the socket, or -1 */
+static int connect_nonblock(struct dnsaddrs *a, const char *port)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(atoi(port));
+	for (int i = 0; i < a->n; i++) {
+		if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+			return -1;
+		addr.sin_addr = a->addr[i];
+		if (connect(fd, (SA *)&addr, sizeof(addr)) == 0 || errno == EINPROGRESS)
+			return fd;
+		close(fd);
+	}
+	return -1;
+}
+
+/* Called by a resolver helper once a name the loop waits on is in */
+static void wake(void *vargp)
+{
+	uint64_t one = 1;
+
+	if (write(((struct loop *)vargp)->wakefd, &one, sizeof(one)) < 0)
+		return;	/* the counter is full, so the loop is awake anyway */
+}
+
+/* Look up the origin of c and connect to it, or wait on the resolver in RESOLVE */
+static void start_connect(struct loop *lp, struct conn *c)
+{
+	char host[MAXLINE], port[MAXLINE], path[MAXLINE];
+	struct dnsaddrs a;
+	int rc;
+
+	parse_uri(c->uri, host, port, path);
+	if ((rc = dns_lookup_async(host, &a, wake, lp)) == DNS_PENDING) {
+		c->state = RESOLVE;
+		c->next_resolving = lp->resolving;
+		lp->resolving = c;
+		return;
+	}
+	if (rc < 0) {
+		respond_error(c, host, "502", "Bad Gateway", "Proxy could not resolve the server");
+		return;
+	}
+	if ((c->server.fd = connect_nonblock(&a, port)) < 0 || watch(lp, &c->server) < 0) {
+		respond_error(c, host, "502", "Bad Gateway", "Proxy could not reach the server");
+		return;
+	}
+	c->state = CONNECT;
+}
+
+/* Parse the request head and pick the next state */
+static void handle_request(struct loop *lp, struct conn *c)
+{
+	char method[MAXLINE], version[MAXLINE];
+	char host[MAXLINE], port[MAXLINE], path[MAXLINE];
+	char *hdrs, *buf;
+	obj *cached;
+	int len;
+
+	if (sscanf(c->req, "%s %s %s", method, c->uri, version) != 3) {
+		respond_error(c, "", "400", "Bad Request", "Proxy could not parse the request");
+		return;
+	}
+	if (strcasecmp(method, "GET")) {
+		respond_error(c, method, "501", "Not Implemented", "Proxy does not support this method");
+		return;
+	}
+	if (parse_uri(c->uri, host, port, path) < 0) {
+		respond_error(c, c->uri, "400", "Bad Request", "Proxy could not parse the URI");
+		return;
+	}
+
+	if ((cached = cacheget(c->uri)) != NULL) {
+		c->cached = cached;	/* sent straight from the cache, unpinned at close */
+		c->cached_off = 0;
+		c->state = WRITE;
+		return;
+	}
+
+	buf = Malloc(MAXBUF);
+	hdrs = strstr(c->req, "\r\n") + 2;
+	if ((len = build_request(buf, MAXBUF, path, host, port, hdrs, 0)) < 0) {
+		free(buf);
+		respond_error(c, c->uri, "400", "Bad Request", "Request headers are too long");
+		return;
+	}
+	free(c->req);		/* the rewritten request replaces the head */
+	c->req = buf;
+	c->req_len = len;
+	c->out_off = 0;
+	start_connect(lp, c);
+}
+
+/* Read the request head; 1 once complete, 0 for more, -1 to close */
+static int read_request(struct conn *c)
+{
+	ssize_t n;
+
+	if (c->req == NULL)
+		c->req = Malloc(MAXBUF);
+	for (;;) {
+		if (c->req_len == MAXBUF - 1)
+			return -1;
+		n = read(c->client.fd, c->req + c->req_len, MAXBUF - 1 - c->req_len);
+		if (n > 0) {
+			c->req_len += n;
+			c->req[c->req_len] = '\0';
+			if (strstr(c->req, "\r\n\r\n") != NULL)
+				return 1;
+		}
+		else if (n == 0)
+			return -1;
+		else if (errno == EAGAIN)
+			return 0;
+		else if (errno != EINTR)
+			return -1;
+	}
+}
+
+/* Write pending output to the client; 1 when drained, 0 if blocked, -1 on error */
+static int flush_out(struct conn *c)
+{
+	ssize_t n;
+
+	while (c->out_off < c->out_len) {
+		n = write(c->client.fd, c->out + c->out_off, c->out_len - c->out_off);
+		if (n > 0)
+			c->out_off += n;
+		else if (n < 0 && errno == EAGAIN)
+			return 0;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else
+			return -1;
+	}
+	return 1;
+}
+
+/* Send the pinned cache hit; 1 when sent, 0 if blocked, -1 on error */
+static int send_cached(struct conn *c)
+{
+	ssize_t n;
+
+	while (c->cached_off < c->cached->node.size) {
+		if ((n = cachesend(c->client.fd, c->cached, &c->cached_off)) > 0)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return 0;
+		if (n < 0 && errno == EINTR)
+			continue;
+		return -1;
+	}
+	return 1;
+}
+
+/*
+ * relay - move response bytes from the server to the client; 1 when
+ *     done, 0 if blocked, -1 on error
+ *
+ * The bytes go server -> pipe -> memfd with splice, and on to the
+ * client with sendfile from the memfd, which then becomes the cached
+ * object. Once the response outgrows cachemaxobject() the memfd is
+ * drained and the pipe is spliced straight to the client instead.
+ */
+static int relay(struct conn *c)
+{
+	ssize_t n;
+
+	for (;;) {
+		if (c->memfd >= 0 && c->mem_sent < c->mem_len) {
+			n = sendfile(c->client.fd, c->memfd, &c->mem_sent, c->mem_len - c->mem_sent);
+			if (n < 0 && errno == EAGAIN)
+				return 0;
+			if (n <= 0 && !(n < 0 && errno == EINTR))
+				return -1;
+			continue;
+		}
+		if (c->piped > 0) {
+			if (c->caching)
+				n = splice(c->pipefd[0], NULL, c->memfd, &c->mem_len, c->piped, SPLICE_F_MOVE);
+			else
+				n = splice(c->pipefd[0], NULL, c->client.fd, NULL, c->piped,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n < 0 && errno == EAGAIN)
+				return 0;
+			if (n <= 0 && !(n < 0 && errno == EINTR))
+				return -1;
+			if (n > 0)
+				c->piped -= n;
+			continue;
+		}
+		if (c->server_eof)
+			return 1;
+		n = splice(c->server.fd, NULL, c->pipefd[1], NULL, PIPE_CHUNK,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n > 0) {
+			c->piped = n;
+			if (c->caching && c->mem_len + n > cachemaxobject())
+				c->caching = 0;	/* too big to cache: pass the rest through */
+		}
+		else if (n == 0)
+			c->server_eof = 1;
+		else if (errno == EAGAIN)
+			return 0;
+		else if (errno != EINTR)
+			return -1;
+	}
+}
+
+/* Does the memfd hold a whole response, as long as its Content-Length says? */
+static int complete(struct conn *c)
+{
+	char head[MAXBUF], out[MAXBUF];
+	struct response r;
+	char *end;
+	ssize_t n;
+
+	if ((n = pread(c->memfd, head, sizeof(head) - 1, 0)) <= 0)
+		return 0;
+	head[n] = '\0';
+	if ((end = strstr(head, "\r\n\r\n")) == NULL)
+		return 0;
+	end[4] = '\0';
+	if (parse_response(head, &r, out, sizeof(out)) < 0 || r.length < 0)
+		return 0;
+	return c->mem_len == end + 4 - head + r.length;
+}
+
+/* Run the state machine of c until it blocks; events are those of e */
+static void advance(struct loop *lp, struct conn *c, struct endpoint *e, uint32_t events)
+{
+	int err, r;
+	socklen_t len = sizeof(err);
+	ssize_t n;
+
+	if (c->closed)
+		return;
+	for (;;) {
+		switch (c->state) {
+		case READ_REQUEST:
+			if ((r = read_request(c)) < 0)
+				goto done;
+			if (r == 0)
+				return;
+			handle_request(lp, c);
+			break;
+		case RESOLVE:
+			return;	/* resume_resolving picks c up; a client hangup waits till then */
+		case CONNECT:
+			if (e != &c->server || !(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+				return;
+			if (getsockopt(c->server.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+				respond_error(c, c->uri, "502", "Bad Gateway", "Proxy could not reach the server");
+				break;
+			}
+			c->state = SEND;
+			break;
+		case SEND:
+			while (c->out_off < c->req_len) {
+				n = write(c->server.fd, c->req + c->out_off, c->req_len - c->out_off);
+				if (n < 0 && errno == EAGAIN)
+					return;
+				if (n < 0 && errno != EINTR)
+					goto done;
+				if (n > 0)
+					c->out_off += n;
+			}
+			free(c->req);
+			c->req = NULL;
+			if (pipe2(c->pipefd, O_NONBLOCK) < 0) {
+				c->pipefd[0] = c->pipefd[1] = -1;
+				goto done;
+			}
+			c->memfd = cachememfd();
+			c->caching = c->memfd >= 0;
+			c->state = RELAY;
+			break;
+		case RELAY:
+			if ((r = relay(c)) == 0)
+				return;
+			if (r > 0 && c->caching && complete(c)) {	/* not a cut-off body */
+				cacheadopt(c->uri, c->memfd, c->mem_len);
+				c->memfd = -1;
+			}
+			goto done;
+		case WRITE:
+			if ((r = c->cached ? send_cached(c) : flush_out(c)) == 0)
+				return;
+			goto done;
+		}
+	}
+done:
+	conn_close(lp, c);
+}
+
+/* The resolver has news: retry the lookups of the connections waiting on it */
+static void resume_resolving(struct loop *lp)
+{
+	struct conn *c, *next;
+	uint64_t n;
+
+	if (read(lp->wakefd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+		return;
+	c = lp->resolving;
+	lp->resolving = NULL;
+	for (; c != NULL; c = next) {
+		next = c->next_resolving;
+		start_connect(lp, c);
+		if (c->state != RESOLVE)
+			advance(lp, c, &c->server, 0);
+	}
+}
+
+static void accept_all(struct loop *lp)
+{
+	struct conn *c;
+	int fd;
+
+	while ((fd = accept4(lp->listenfd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+		c = Calloc(1, sizeof(struct conn));
+		c->client.fd = fd;
+		c->client.conn = c;
+		c->server.fd = -1;
+		c->server.conn = c;
+		c->pipefd[0] = c->pipefd[1] = -1;
+		c->memfd = -1;
+		c->state = READ_REQUEST;
+		if (watch(lp, &c->client) < 0)
+			conn_close(lp, c);
+	}
+}
+
+/* A listening socket that shares port with the other loops */
+static int open_reuseport(int port)
+{
+	struct sockaddr_in addr;
+	int fd, one = 1;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+		goto fail;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((unsigned short)port);
+	if (bind(fd, (SA *)&addr, sizeof(addr)) < 0 || listen(fd, LISTENQ) < 0 ||
+		set_nonblocking(fd) < 0)
+		goto fail;
+	return fd;
+fail:
+	close(fd);
+	return -1;
+}
+
+static void *event_loop(void *vargp)
+{
+	struct loop *lp = vargp;
+	struct epoll_event events[MAX_EVENTS];
+	struct endpoint *e;
+	int n;
+
+	for (;;) {
+		if ((n = epoll_wait(lp->epfd, events, MAX_EVENTS, -1)) < 0) {
+			if (errno == EINTR)
+				continue;
+			unix_error("epoll_wait error");
+		}
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == NULL) {
+				accept_all(lp);
+				continue;
+			}
+			if (events[i].data.ptr == lp) {
+				resume_resolving(lp);
+				continue;
+			}
+			e = events[i].data.ptr;
+			advance(lp, e->conn, e, events[i].events);
+		}
+		free_dead(lp);
+	}
+	return NULL;
+}
+
+int event_main(int port, int loops)
+{
+	struct loop *lp = Calloc(loops, sizeof(struct loop));
+	struct epoll_event ev;
+	pthread_t tid;
+
+	for (int i = 0; i < loops; i++) {
+		if ((lp[i].listenfd = open_reuseport(port)) < 0 ||
+			(lp[i].epfd = epoll_create1(0)) < 0) {
+			fprintf(stderr, "event loop %d: cannot listen on port %d: %s\n", i, port, strerror(errno));
+			return -1;
+		}
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = NULL;	/* the listening socket */
+		if (epoll_ctl(lp[i].epfd, EPOLL_CTL_ADD, lp[i].listenfd, &ev) < 0)
+			return -1;
+		ev.data.ptr = &lp[i];	/* the resolver's eventfd */
+		if ((lp[i].wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+			epoll_ctl(lp[i].epfd, EPOLL_CTL_ADD, lp[i].wakefd, &ev) < 0)
+			return -1;
+	}
+	for (int i = 1; i < loops; i++)
+		Pthread_create(&tid, NULL, event_loop, &lp[i]);
+	event_loop(&lp[0]);
+	return 0;
+}
@@ -0,0 +1,12 @@
+/*
+ * event.h - Event-driven proxy front end: edge-triggered epoll loops
+ *     over non-blocking sockets, one loop per thread, each with its own
+ *     SO_REUSEPORT listening socket so the kernel spreads connections.
+ */
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+/* Run loops event loops serving port; returns only on a setup error */
+int event_main(int port, int loops);
+
+#endif /* __EVENT_H__ */
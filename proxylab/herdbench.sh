@@ -0,0 +1,60 @@
+#!/bin/bash
+#
+# herdbench.sh - What collapsed forwarding saves under a thundering
+#     herd: HERD clients all ask for one uncached URI at once, ROUNDS
+#     times (a fresh URI each round), from a slow origin. Prints origin
+#     fetches and client latency with coalescing off (-C 0) and on.
+#
+# A response too big for the cache cannot be shared, so the last run
+# shows followers falling back to fetching for themselves.
+#
+# usage: ./herdbench.sh [<mode>]          (thread or pool, default thread)
+#
+# Environment: ORIGIN_PORT, PROXY_PORT, HERD, ROUNDS, DELAY (origin ms), SIZE.
+#
+ORIGIN_PORT=${ORIGIN_PORT:-9000}
+PROXY_PORT=${PROXY_PORT:-9100}
+HERD=${HERD:-100}
+ROUNDS=${ROUNDS:-10}
+DELAY=${DELAY:-100}
+SIZE=${SIZE:-50000}
+MODE=${1:-thread}
+
+make -s proxy loadgen origin || exit 1
+
+./origin -d ${DELAY} ${ORIGIN_PORT} 2> /dev/null &
+origin_pid=$!
+trap "kill ${origin_pid} 2> /dev/null" EXIT
+sleep 0.5
+
+origin_requests() {
+    curl -s http://127.0.0.1:${ORIGIN_PORT}/stats | awk '{ print $2 }'
+}
+
+# run <label> <object bytes> <proxy flags>
+runs=0
+run() {
+    runs=$((runs + 1))
+    ./proxy -m ${MODE} -w $((2 * HERD)) $3 ${PROXY_PORT} 2> /dev/null &
+    proxy_pid=$!
+    sleep 0.5
+    before=`origin_requests`
+    for round in `seq ${ROUNDS}`; do
+        ./loadgen -c ${HERD} -n ${HERD} -x 127.0.0.1:${PROXY_PORT} \
+            "http://127.0.0.1:${ORIGIN_PORT}/herd/$$/${runs}/${round}?size=$2"
+    done > /tmp/herdbench.out.$$
+    after=`origin_requests`
+    kill -TERM ${proxy_pid}
+    wait ${proxy_pid} 2> /dev/null
+    awk -v label="$1" -v fetches=$((after - before - 1)) -v total=$((HERD * ROUNDS)) '
+        /^requests/ { ok += $4; errors += $6 }
+        /^latency/ { p50 += $4; p99 += $8; n++ }
+        END { printf "%-24s %8d %8d %8d %9.1f %9.1f\n", label, total, ok, fetches,
+            p50 / n, p99 / n }' /tmp/herdbench.out.$$
+    rm -f /tmp/herdbench.out.$$
+}
+
+printf "%-24s %8s %8s %8s %9s %9s\n" run requests ok fetches "p50 ms" "p99 ms"
+run "no coalescing"      ${SIZE}  "-C 0"
+run "coalescing"         ${SIZE}  "-C 1"
+run "coalescing, 500 KB" 500000   "-C 1"
@@ -0,0 +1,201 @@
+/*
+ * http.c - Request parsing and rewriting, see http.h
+ */
+#define _GNU_SOURCE	/* strcasestr */
+#include "http.h"
+
+/* You won't lose style points for including these long lines in your code */
+static const char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n";
+static const char *accept_hdr = "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n";
+static const char *accept_encoding_hdr = "Accept-Encoding: gzip, deflate\r\n";
+
+int parse_uri(const char *uri, char *host, char *port, char *path)
+{
+	const char *p, *slash, *colon;
+	size_t len;
+
+	if (strncasecmp(uri, "http://", 7))
+		return -1;
+	p = uri + 7;
+	if ((slash = strchr(p, '/')) == NULL)
+		slash = p + strlen(p);
+	if ((colon = memchr(p, ':', slash - p)) != NULL) {
+		len = slash - colon - 1;
+		if (len == 0 || len > 5)
+			return -1;
+		memcpy(port, colon + 1, len);
+		port[len] = '\0';
+	}
+	else {
+		strcpy(port, "80");
+		colon = slash;
+	}
+	if (colon == p || colon - p >= MAXLINE)
+		return -1;
+	memcpy(host, p, colon - p);
+	host[colon - p] = '\0';
+	strcpy(path, *slash ? slash : "/");
+	return 0;
+}
+
+/* Is line the header name? */
+static int is_header(const char *line, const char *name)
+{
+	size_t len = strlen(name);
+
+	return !strncasecmp(line, name, len) && line[len] == ':';
+}
+
+int build_request(char *out, size_t size, const char *path,
+		const char *host, const char *port, const char *hdrs, int keep_alive)
+{
+	const char *line, *end;
+	char hostline[MAXLINE];
+	size_t n;
+	int len;
+
+	hostline[0] = '\0';
+	len = snprintf(out, size, "GET %s HTTP/1.0\r\n", path);
+	for (line = hdrs; *line; line = end) {
+		if ((end = strstr(line, "\r\n")) == NULL || end == line)
+			break;	/* the blank line ends the head */
+		end += 2;
+		n = end - line;
+		if (is_header(line, "Host")) {
+			if (n < sizeof(hostline)) {
+				memcpy(hostline, line, n);
+				hostline[n] = '\0';
+			}
+			continue;
+		}
+		if (is_header(line, "User-Agent") || is_header(line, "Connection") ||
+			is_header(line, "Proxy-Connection") || is_header(line, "Accept") ||
+			is_header(line, "Accept-Encoding"))
+			continue;
+		if (len + n >= size)
+			return -1;
+		memcpy(out + len, line, n);
+		len += n;
+	}
+	if (hostline[0] == '\0') {
+		if (strcmp(port, "80"))
+			snprintf(hostline, sizeof(hostline), "Host: %s:%s\r\n", host, port);
+		else
+			snprintf(hostline, sizeof(hostline), "Host: %s\r\n", host);
+	}
+	len += snprintf(out + len, size > len ? size - len : 0, "%s%s%s%s%s%s\r\n",
+		hostline, user_agent_hdr, accept_hdr, accept_encoding_hdr,
+		keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n",
+		keep_alive ? "Proxy-Connection: keep-alive\r\n" : "Proxy-Connection: close\r\n");
+	return len < size ? len : -1;
+}
+
+/* Does the value of header name, in the head at hdrs, hold token? */
+static int header_has(const char *hdrs, const char *name, const char *token)
+{
+	const char *line, *end;
+
+	for (line = hdrs; *line; line = end + 2) {
+		if ((end = strstr(line, "\r\n")) == NULL || end == line)
+			break;
+		if (is_header(line, name)) {
+			char value[MAXLINE];
+			size_t n = end - line;
+
+			if (n >= sizeof(value))
+				n = sizeof(value) - 1;
+			memcpy(value, line, n);
+			value[n] = '\0';
+			if (strcasestr(value + strlen(name) + 1, token) != NULL)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+int client_keep_alive(const char *version, const char *hdrs)
+{
+	return !strcmp(version, "HTTP/1.1") && !header_has(hdrs, "Connection", "close") &&
+		!header_has(hdrs, "Proxy-Connection", "close");
+}
+
+/* The Content-Length value in s, up to the end of its line, or -1 unless all digits */
+static long long parse_length(const char *s)
+{
+	long long v;
+	char *end;
+
+	s += strspn(s, " \t");
+	if (!isdigit((unsigned char)*s))
+		return -1;
+	errno = 0;
+	v = strtoll(s, &end, 10);
+	if (errno == ERANGE)
+		return -1;
+	end += strspn(end, " \t");
+	return strncmp(end, "\r\n", 2) ? -1 : v;
+}
+
+int parse_response(const char *head, struct response *r, char *out, size_t size)
+{
+	const char *line, *end, *status;
+	long long length = -1, v;
+	int minor, len;
+	size_t n;
+
+	if (sscanf(head, "HTTP/1.%d %d", &minor, &r->status) != 2 ||
+		(end = strstr(head, "\r\n")) == NULL || (status = strchr(head, ' ')) == NULL || status > end)
+		return -1;
+	if ((r->status >= 100 && r->status < 200) || r->status == 204 || r->status == 304)
+		r->length = 0;
+	else
+		r->length = -1;
+	if (minor >= 1)
+		r->reusable = !header_has(end + 2, "Connection", "close");
+	else
+		r->reusable = header_has(end + 2, "Connection", "keep-alive");
+
+	len = snprintf(out, size, "HTTP/1.1%.*s\r\n", (int)(end - status), status);
+	for (line = end + 2; *line; line = end) {
+		if ((end = strstr(line, "\r\n")) == NULL)
+			return -1;
+		if (end == line)
+			break;	/* the blank line ends the head */
+		end += 2;
+		n = end - line;
+		if (is_header(line, "Content-Length")) {
+			if ((v = parse_length(line + 15)) < 0 || (length >= 0 && v != length))
+				return -1;	/* bad, or two that disagree */
+			length = v;
+		}
+		if (is_header(line, "Connection") || is_header(line, "Keep-Alive") ||
+			is_header(line, "Proxy-Connection"))
+			continue;
+		if (len + n >= size)
+			return -1;
+		memcpy(out + len, line, n);
+		len += n;
+	}
+	if (r->length < 0)
+		r->length = length;
+	if (r->length < 0)
+		r->reusable = 0;
+	len += snprintf(out + len, size > len ? size - len : 0, "%s\r\n",
+		r->length < 0 ? "Connection: close\r\n" : "");
+	return len < size ? len : -1;
+}
+
+int format_error(char *buf, size_t size, const char *cause,
+		const char *errnum, const char *shortmsg, const char *longmsg)
+{
+	char body[MAXBUF];
+	int len;
+
+	snprintf(body, sizeof(body), "<html><title>Proxy Error</title>"
+		"<body bgcolor=\"ffffff\">\r\n%s: %s\r\n<p>%s: %s\r\n"
+		"<hr><em>The CS:APP proxy</em>\r\n</body></html>\r\n",
+		errnum, shortmsg, longmsg, cause);
+	len = snprintf(buf, size, "HTTP/1.0 %s %s\r\nContent-type: text/html\r\n"
+		"Content-length: %d\r\n\r\n%s", errnum, shortmsg, (int)strlen(body), body);
+	return len < size ? len : size - 1;
+}
@@ -0,0 +1,53 @@
+/*
+ * http.h - Request parsing and rewriting shared by the proxy's
+ *     threaded and event-driven front ends.
+ */
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include "csapp.h"
+
+/* Split "http://host[:port]/path" into its parts; -1 if it is not one */
+int parse_uri(const char *uri, char *host, char *port, char *path);
+
+/*
+ * build_request - Write the request sent upstream for path on host to
+ *     out: an HTTP/1.0 request line, then the client's headers in hdrs
+ *     (one "Name: value\r\n" per line, up to a blank line) except
+ *     User-Agent, Accept, Accept-Encoding, Connection and
+ *     Proxy-Connection, which the proxy sets itself: "keep-alive" if
+ *     keep_alive, so the origin may leave the connection open for the
+ *     next request, else "close". Returns the length, or -1 if it does
+ *     not fit in size bytes.
+ *
+ * An HTTP/1.0 request keeps chunked bodies out of responses, so a
+ * response either has a Content-Length or ends when the origin closes.
+ */
+int build_request(char *out, size_t size, const char *path,
+		const char *host, const char *port, const char *hdrs, int keep_alive);
+
+/* May the client's connection stay open after this request? HTTP/1.1, not asked to close */
+int client_keep_alive(const char *version, const char *hdrs);
+
+struct response {
+	int status;
+	long long length;	/* of the body, or -1 if it runs until the origin closes */
+	int reusable;		/* the origin keeps the connection open afterwards */
+};
+
+/*
+ * parse_response - Parse the response head in head, up to and
+ *     including its blank line, into *r, and write the head passed on
+ *     to the client to out: an HTTP/1.1 status line, the origin's
+ *     headers less Connection, Keep-Alive and Proxy-Connection, and
+ *     "Connection: close" if the body runs until close. Returns the
+ *     length written, or -1 if head is malformed, its Content-Length is
+ *     not a number or disagrees with another one, or out is too small.
+ */
+int parse_response(const char *head, struct response *r, char *out, size_t size);
+
+/* Format an HTML error response into buf; returns its length */
+int format_error(char *buf, size_t size, const char *cause,
+		const char *errnum, const char *shortmsg, const char *longmsg);
+
+#endif /* __HTTP_H__ */
@@ -0,0 +1,198 @@
+/*
+ * inflight.c - Collapsed forwarding, see inflight.h
+ *
+ * Fetches in flight live in one hash table under one mutex, each with
+ * a condition its followers wait on for more bytes. A fetch holds a
+ * dup of the leader's memfd, so followers can keep reading it after
+ * the cache has taken the original over, or evicted it. The fetch is
+ * freed when the leader and its last follower have let go.
+ */
+#define _GNU_SOURCE
+#include "csapp.h"
+#include "inflight.h"
+#include <sys/sendfile.h>
+
+#define INFLIGHT_BUCKETS 256
+
+enum { WAITING, STREAMING, DONE, FAILED };
+
+struct fetch {
+	char *uri;
+	int state;
+	int fd;				/* the response, a dup of the memfd, or -1 */
+	size_t size, len;		/* bytes in all, and written so far */
+	int refcnt;			/* the leader until it is done, plus each follower */
+	pthread_cond_t changed;
+	struct fetch *chain;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fetch *buckets[INFLIGHT_BUCKETS];
+static int enabled = 1;
+static long led, followed, shared, alone;
+
+void inflight_init(int on)
+{
+	enabled = on;
+}
+
+static struct fetch **bucket(const char *uri)
+{
+	unsigned h = 5381;
+
+	while (*uri)
+		h = h * 33 + (unsigned char)*uri++;
+	return &buckets[h % INFLIGHT_BUCKETS];
+}
+
+/* With lock held, drop a reference to f */
+static void release(struct fetch *f)
+{
+	if (--f->refcnt > 0)
+		return;
+	if (f->fd >= 0)
+		close(f->fd);
+	pthread_cond_destroy(&f->changed);
+	Free(f->uri);
+	Free(f);
+}
+
+/* With lock held, end f as DONE or FAILED and take it out of the table */
+static void finish(struct fetch *f, int state)
+{
+	struct fetch **pp;
+
+	if (f->state == DONE || f->state == FAILED)
+		return;
+	for (pp = bucket(f->uri); *pp != f; pp = &(*pp)->chain)
+		;
+	*pp = f->chain;
+	f->state = state;
+	pthread_cond_broadcast(&f->changed);
+}
+
+struct fetch *inflight_join(const char *uri, int *leader)
+{
+	struct fetch *f;
+
+	*leader = 1;
+	if (!enabled)
+		return NULL;
+	pthread_mutex_lock(&lock);
+	for (f = *bucket(uri); f != NULL; f = f->chain) {
+		if (!strcmp(f->uri, uri)) {
+			f->refcnt++;
+			followed++;
+			*leader = 0;
+			pthread_mutex_unlock(&lock);
+			return f;
+		}
+	}
+	f = Calloc(1, sizeof(struct fetch));
+	f->uri = Malloc(strlen(uri) + 1);
+	strcpy(f->uri, uri);
+	f->state = WAITING;
+	f->fd = -1;
+	f->refcnt = 1;
+	pthread_cond_init(&f->changed, NULL);
+	f->chain = *bucket(uri);
+	*bucket(uri) = f;
+	led++;
+	pthread_mutex_unlock(&lock);
+	return f;
+}
+
+void inflight_stream(struct fetch *f, int memfd, size_t size)
+{
+	int fd;
+
+	if (f == NULL)
+		return;
+	if ((fd = dup(memfd)) < 0) {
+		inflight_fail(f);
+		return;
+	}
+	pthread_mutex_lock(&lock);
+	f->fd = fd;
+	f->size = size;
+	f->len = 0;
+	f->state = STREAMING;
+	pthread_cond_broadcast(&f->changed);
+	pthread_mutex_unlock(&lock);
+}
+
+void inflight_progress(struct fetch *f, size_t len)
+{
+	if (f == NULL)
+		return;
+	pthread_mutex_lock(&lock);
+	f->len = len;
+	if (f->refcnt > 1)
+		pthread_cond_broadcast(&f->changed);
+	pthread_mutex_unlock(&lock);
+}
+
+void inflight_fail(struct fetch *f)
+{
+	if (f == NULL)
+		return;
+	pthread_mutex_lock(&lock);
+	finish(f, FAILED);
+	pthread_mutex_unlock(&lock);
+}
+
+void inflight_done(struct fetch *f)
+{
+	if (f == NULL)
+		return;
+	pthread_mutex_lock(&lock);
+	finish(f, f->state == STREAMING && f->len == f->size ? DONE : FAILED);
+	release(f);
+	pthread_mutex_unlock(&lock);
+}
+
+int inflight_follow(struct fetch *f, int fd)
+{
+	off_t off = 0;
+	size_t avail;
+	ssize_t n;
+	int rc;
+
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (f->state == WAITING || (f->state == STREAMING && f->len == off))
+			pthread_cond_wait(&f->changed, &lock);
+		if (f->state == FAILED) {
+			rc = off == 0 ? INFLIGHT_ALONE : 0;
+			break;
+		}
+		if (off == f->size) {
+			rc = 1;
+			break;
+		}
+		avail = f->len;
+		pthread_mutex_unlock(&lock);
+		while (off < avail && ((n = sendfile(fd, f->fd, &off, avail - off)) > 0 || (n < 0 && errno == EINTR)))
+			;
+		pthread_mutex_lock(&lock);
+		if (off < avail) {
+			rc = 0;
+			break;
+		}
+	}
+	if (rc == 1)
+		shared++;
+	else if (rc == INFLIGHT_ALONE)
+		alone++;
+	release(f);
+	pthread_mutex_unlock(&lock);
+	return rc;
+}
+
+void inflight_report(FILE *fp)
+{
+	pthread_mutex_lock(&lock);
+	fprintf(fp, "inflight: %ld fetches led, %ld requests followed one: %ld served from it, "
+		"%ld fetched alone\n", led, followed, shared, alone);
+	pthread_mutex_unlock(&lock);
+}
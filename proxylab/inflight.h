@@ -0,0 +1,45 @@
+/*
+ * inflight.h - Collapsed forwarding: when several clients miss the
+ *     cache on one URI at once, only the first (the leader) fetches it
+ *     from the origin; the rest follow, sending the same response on
+ *     to their clients from the leader's memfd as the bytes arrive.
+ *
+ * Only a response the leader is writing into the cache can be shared.
+ * If it turns out not to be cacheable, or the fetch fails before a
+ * follower has sent anything, the follower fetches for itself.
+ *
+ * The f of the leader's calls may be NULL, for a fetch shared with
+ * nobody.
+ */
+#ifndef __INFLIGHT_H__
+#define __INFLIGHT_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define INFLIGHT_ALONE -1	/* inflight_follow: nothing was sent, fetch alone */
+
+struct fetch;
+
+/* Turn coalescing on (the default) or off; off, every caller leads */
+void inflight_init(int on);
+/* The fetch of uri in flight, joined, or a new one; *leader says if the caller is to fetch it */
+struct fetch *inflight_join(const char *uri, int *leader);
+/* Leader: the response, size bytes in all, is going into memfd; followers may send it */
+void inflight_stream(struct fetch *f, int memfd, size_t size);
+/* Leader: the first len bytes of the memfd are written */
+void inflight_progress(struct fetch *f, size_t len);
+/* Leader: there is nothing to share; the followers must fetch for themselves */
+void inflight_fail(struct fetch *f);
+/* Leader: the fetch is over, whole if all of it was written; f is gone */
+void inflight_done(struct fetch *f);
+/*
+ * inflight_follow - send the leader's response to fd as it arrives:
+ *     1 once all of it is sent, 0 if sending failed or the leader's
+ *     fetch did partway, or INFLIGHT_ALONE if nothing was sent; f is gone
+ */
+int inflight_follow(struct fetch *f, int fd);
+/* Print fetches led and requests that followed them */
+void inflight_report(FILE *fp);
+
+#endif /* __INFLIGHT_H__ */
@@ -0,0 +1,307 @@
+/*
+ * loadgen.c - C10K-style load generator for the proxy: keeps <conns>
+ *     requests in flight from one epoll loop and reports throughput and
+ *     latency percentiles.
+ *
+ * usage: ./loadgen [-k] [-c <conns>] [-n <requests>] [-U <urls>] [-x <host:port>] <url>
+ *
+ * Each request goes to the proxy given with -x, as an absolute URI, or
+ * straight to the host in <url> without it. -U spreads the requests
+ * over that many distinct URLs (an "id=" query is appended), so a
+ * caching proxy sees a mix of hits and misses. -k keeps connections
+ * open across requests (HTTP/1.1) instead of one connection each.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MAX_EVENTS 512
+#define RESP_HEAD 4096
+
+struct slot {
+	int fd;
+	char req[1024];
+	size_t req_len, req_off;
+	char head[RESP_HEAD];		/* response header, until the blank line */
+	size_t head_len;
+	long body_left;			/* -1 until the header is in, -2 for read-until-close */
+	int keep;			/* the server keeps the connection */
+	double start;
+};
+
+static struct sockaddr_storage target;
+static socklen_t target_len;
+static char url[1024], host[1024], path[1024];
+static int keep_alive, urls = 1, via_proxy;
+static long issued, done, errors, total;
+static double bytes, *lat;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Fill in the next request of s */
+static void make_request(struct slot *s)
+{
+	char target_uri[1200];
+	long id = issued++ % urls;
+	const char *sep = strchr(url, '?') ? "&" : "?";
+
+	if (urls > 1)
+		snprintf(target_uri, sizeof(target_uri), "%s%sid=%ld", via_proxy ? url : path, sep, id);
+	else
+		snprintf(target_uri, sizeof(target_uri), "%s", via_proxy ? url : path);
+	s->req_len = snprintf(s->req, sizeof(s->req), "GET %s HTTP/1.%d\r\nHost: %s\r\n%s\r\n",
+		target_uri, keep_alive, host, keep_alive ? "" : "Connection: close\r\n");
+	s->req_off = 0;
+	s->head_len = 0;
+	s->body_left = -1;
+	s->start = now_us();
+}
+
+static int open_conn(int epfd, struct slot *s)
+{
+	struct epoll_event ev;
+	int one = 1;
+
+	if ((s->fd = socket(target.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+		return -1;
+	setsockopt(s->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(s->fd, (struct sockaddr *)&target, target_len) < 0 && errno != EINPROGRESS) {
+		close(s->fd);
+		return -1;
+	}
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.ptr = s;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+}
+
+/* Start the next request on s, on a new connection unless it is kept; close it when all are issued */
+static void next_request(int epfd, struct slot *s, int reuse)
+{
+	if (!reuse || issued >= total) {
+		close(s->fd);
+		s->fd = -1;
+	}
+	if (issued >= total)
+		return;
+	make_request(s);
+	if (!reuse && open_conn(epfd, s) < 0) {
+		errors++;
+		done++;
+		s->fd = -1;
+	}
+}
+
+/* The header is in: find the body length and whether the connection stays open */
+static void parse_head(struct slot *s)
+{
+	char *p;
+
+	s->head[s->head_len] = '\0';
+	s->keep = keep_alive && strcasestr(s->head, "\nConnection: close") == NULL &&
+		!strncmp(s->head, "HTTP/1.1", 8);
+	if ((p = strcasestr(s->head, "\nContent-Length:")) != NULL)
+		s->body_left = strtol(p + 16, NULL, 10);
+	else {
+		s->body_left = -2;
+		s->keep = 0;
+	}
+}
+
+/* Drive s until it blocks */
+static void handle(int epfd, struct slot *s)
+{
+	char buf[65536], *end;
+	ssize_t n;
+	size_t extra;
+
+again:
+	while (s->fd >= 0) {
+		if (s->req_off < s->req_len) {
+			if ((n = write(s->fd, s->req + s->req_off, s->req_len - s->req_off)) < 0) {
+				if (errno == EAGAIN || errno == EINTR)
+					return;
+				goto fail;
+			}
+			s->req_off += n;
+			continue;
+		}
+		if ((n = read(s->fd, buf, sizeof(buf))) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return;
+			goto fail;
+		}
+		if (n == 0) {
+			if (s->body_left != -2)
+				goto fail;
+			goto complete;
+		}
+		bytes += n;
+		if (s->body_left == -1) { /* still in the header */
+			size_t old = s->head_len, copy = n;
+
+			if (copy > RESP_HEAD - 1 - old)
+				copy = RESP_HEAD - 1 - old;
+			memcpy(s->head + old, buf, copy);
+			s->head_len += copy;
+			s->head[s->head_len] = '\0';
+			if ((end = strstr(s->head, "\r\n\r\n")) == NULL) {
+				if (s->head_len == RESP_HEAD - 1)
+					goto fail;
+				continue;
+			}
+			s->head_len = end + 4 - s->head;
+			extra = n - (s->head_len - old);	/* body bytes in this read */
+			parse_head(s);
+			if (s->body_left >= 0)
+				s->body_left -= extra;
+		}
+		else if (s->body_left >= 0)
+			s->body_left -= n;
+		if (s->body_left == 0)
+			goto complete;
+	}
+	return;
+complete:
+	lat[done++] = now_us() - s->start;
+	next_request(epfd, s, s->keep);
+	if (s->keep && issued <= total && s->req_off == 0)
+		goto again;
+	return;
+fail:
+	errors++;
+	done++;
+	next_request(epfd, s, 0);
+}
+
+static void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-k] [-c <conns>] [-n <requests>] [-U <urls>] [-x <host:port>] <url>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct epoll_event events[MAX_EVENTS];
+	struct addrinfo hints, *ai;
+	struct rlimit rl;
+	struct slot *slots;
+	char proxy[1024] = "", *port, *p;
+	int conns = 100, epfd, n, opt;
+	long ok;
+	double start, secs;
+
+	total = 10000;
+	while ((opt = getopt(argc, argv, "kc:n:U:x:")) != -1) {
+		switch (opt) {
+		case 'k':
+			keep_alive = 1;
+			break;
+		case 'c':
+			conns = atoi(optarg);
+			break;
+		case 'n':
+			total = atol(optarg);
+			break;
+		case 'U':
+			urls = atoi(optarg);
+			break;
+		case 'x':
+			snprintf(proxy, sizeof(proxy), "%s", optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || conns < 1 || total < 1 || urls < 1 ||
+		strncmp(argv[optind], "http://", 7))
+		usage(argv[0]);
+	snprintf(url, sizeof(url), "%s", argv[optind]);
+	snprintf(host, sizeof(host), "%s", url + 7);
+	if ((p = strchr(host, '/')) != NULL) {
+		snprintf(path, sizeof(path), "%s", url + 7 + (p - host));
+		*p = '\0';
+	}
+	else
+		strcpy(path, "/");
+
+	/* Connect to the proxy if there is one, else to the origin */
+	via_proxy = proxy[0] != '\0';
+	if (!via_proxy)
+		snprintf(proxy, sizeof(proxy), "%s", host);
+	if ((port = strrchr(proxy, ':')) != NULL)
+		*port++ = '\0';
+	else
+		port = "80";
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(proxy, port, &hints, &ai) != 0) {
+		fprintf(stderr, "loadgen: cannot resolve %s\n", proxy);
+		return 1;
+	}
+	memcpy(&target, ai->ai_addr, ai->ai_addrlen);
+	target_len = ai->ai_addrlen;
+	freeaddrinfo(ai);
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if (conns > total)
+		conns = total;
+	slots = calloc(conns, sizeof(struct slot));
+	lat = malloc(total * sizeof(double));
+	epfd = epoll_create1(0);
+
+	start = now_us();
+	for (int i = 0; i < conns; i++) {
+		slots[i].fd = -1;
+		next_request(epfd, &slots[i], 0);
+	}
+	while (done < total) {
+		if ((n = epoll_wait(epfd, events, MAX_EVENTS, 10000)) <= 0) {
+			if (n == 0) {
+				fprintf(stderr, "loadgen: no progress for 10s, %ld of %ld done\n", done, total);
+				break;
+			}
+			continue;
+		}
+		for (int i = 0; i < n; i++)
+			handle(epfd, events[i].data.ptr);
+	}
+	secs = (now_us() - start) / 1e6;
+
+	ok = done - errors;
+	qsort(lat, done, sizeof(double), cmp_double);
+	printf("requests %ld ok %ld errors %ld conns %d%s in %.2fs: %.0f req/s %.1f MB/s\n",
+		done, ok, errors, conns, keep_alive ? " keep-alive" : "", secs, done / secs, bytes / secs / 1e6);
+	if (done > 0)
+		printf("latency ms: p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+			lat[done / 2] / 1e3, lat[done * 9 / 10] / 1e3, lat[done * 99 / 100] / 1e3, lat[done - 1] / 1e3);
+	return errors > 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * origin.c - A fast local origin server for the proxy benchmarks: one
+ *     epoll loop that answers every GET with a generated body, so the
+ *     proxy rather than the origin is what a benchmark measures.
+ *
+ * usage: ./origin [-b <bytes>] [-d <ms>] <port>
+ *
+ * The body is <bytes> long (default 1024) unless the request target
+ * holds "size=N". -d holds every response back for <ms> milliseconds,
+ * like a slow origin. HTTP/1.1 requests keep the connection open
+ * unless they ask to close it, HTTP/1.0 ones only if they ask to keep
+ * it. GET /stats returns "requests N
+ * connections M", and the same counts go to stderr on SIGINT or
+ * SIGTERM.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define HEAD_SIZE 8192
+#define MAX_EVENTS 256
+#define MAX_BODY (64 << 20)
+
+struct conn {
+	int fd;
+	char head[HEAD_SIZE];		/* request bytes not consumed yet */
+	size_t head_len;
+	char resp[256];			/* response header, or the /stats body with it */
+	size_t resp_len, body_len, off;	/* off counts header then body bytes sent */
+	int keep_alive, writing;
+	long ready_ms;			/* when a delayed response may go out */
+	struct conn *next_delayed;
+};
+
+static char *body;
+static size_t body_cap;
+static long requests, connections;
+static int delay_ms;
+static struct conn *delayed;
+static volatile sig_atomic_t stop;
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void on_signal(int sig)
+{
+	stop = 1;
+}
+
+static void conn_close(struct conn *c)
+{
+	close(c->fd);
+	free(c);
+}
+
+/* Write the pending response; 1 when sent, 0 if blocked, -1 on error */
+static int send_response(struct conn *c)
+{
+	struct iovec iov[2];
+	ssize_t n;
+	int cnt;
+
+	while (c->off < c->resp_len + c->body_len) {
+		cnt = 0;
+		if (c->off < c->resp_len) {
+			iov[cnt].iov_base = c->resp + c->off;
+			iov[cnt++].iov_len = c->resp_len - c->off;
+		}
+		if (c->body_len) {
+			size_t from = c->off > c->resp_len ? c->off - c->resp_len : 0;
+
+			iov[cnt].iov_base = body + from;
+			iov[cnt++].iov_len = c->body_len - from;
+		}
+		if ((n = writev(c->fd, iov, cnt)) < 0) {
+			if (errno == EAGAIN)
+				return 0;
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		c->off += n;
+	}
+	c->writing = 0;
+	return 1;
+}
+
+/* Take one request off the head buffer and prepare its response; 0 if incomplete */
+static int parse_request(struct conn *c)
+{
+	char *end, *p;
+	size_t size = 0, used;
+	const char *conn_hdr;
+	int http11;
+
+	c->head[c->head_len] = '\0';
+	if ((end = strstr(c->head, "\r\n\r\n")) == NULL)
+		return 0;
+	used = end + 4 - c->head;
+	*end = '\0';
+	requests++;
+	http11 = strstr(c->head, "HTTP/1.1\r\n") != NULL;
+	if (http11)
+		c->keep_alive = strcasestr(c->head, "\nConnection: close") == NULL;
+	else
+		c->keep_alive = strcasestr(c->head, "\nConnection: keep-alive") != NULL;
+	conn_hdr = !c->keep_alive ? "Connection: close\r\n" : http11 ? "" : "Connection: keep-alive\r\n";
+	if (!strncmp(c->head, "GET /stats ", 11) || strstr(c->head, "/stats HTTP/")) {
+		char text[96];
+		int len = snprintf(text, sizeof(text), "requests %ld connections %ld\n", requests, connections);
+
+		c->resp_len = snprintf(c->resp, sizeof(c->resp), "HTTP/1.%d 200 OK\r\nContent-Length: %d\r\n"
+			"Content-Type: text/plain\r\n%s\r\n%s", http11, len, conn_hdr, text);
+		c->body_len = 0;
+	}
+	else {
+		if ((p = strstr(c->head, "size=")) != NULL && p < strstr(c->head, "\r\n"))
+			size = strtoul(p + 5, NULL, 10);
+		else
+			size = body_cap;
+		if (size > MAX_BODY)
+			size = MAX_BODY;
+		if (size > body_cap) {
+			body = realloc(body, size);
+			for (size_t i = body_cap; i < size; i++)
+				body[i] = 'a' + i % 26;
+			body_cap = size;
+		}
+		c->body_len = size;
+		c->resp_len = snprintf(c->resp, sizeof(c->resp), "HTTP/1.%d 200 OK\r\nContent-Length: %zu\r\n"
+			"Content-Type: application/octet-stream\r\n%s\r\n", http11, size, conn_hdr);
+	}
+	memmove(c->head, c->head + used, c->head_len - used);
+	c->head_len -= used;
+	c->off = 0;
+	c->writing = 1;
+	return 1;
+}
+
+/* Serve c until it blocks; 0 to keep it, -1 to close it */
+static int serve(struct conn *c)
+{
+	ssize_t n;
+	int r;
+
+	for (;;) {
+		if (c->writing) {
+			if (c->ready_ms > now_ms())
+				return 0;
+			if ((r = send_response(c)) <= 0)
+				return r;
+			if (!c->keep_alive)
+				return -1;
+		}
+		if (parse_request(c)) {
+			if (delay_ms) {
+				c->ready_ms = now_ms() + delay_ms;
+				c->next_delayed = delayed;
+				delayed = c;
+				return 0;
+			}
+			continue;
+		}
+		if (c->head_len == HEAD_SIZE - 1)
+			return -1;
+		n = read(c->fd, c->head + c->head_len, HEAD_SIZE - 1 - c->head_len);
+		if (n == 0)
+			return -1;
+		if (n < 0)
+			return errno == EAGAIN ? 0 : errno == EINTR ? 0 : -1;
+		c->head_len += n;
+	}
+}
+
+/* Release the delayed responses that are due; the time to the next one, or -1 */
+static int run_delayed(void)
+{
+	struct conn **pp = &delayed, *c;
+	long now = now_ms(), next = -1;
+
+	while ((c = *pp) != NULL) {
+		if (c->ready_ms <= now) {
+			*pp = c->next_delayed;
+			c->ready_ms = 0;
+			if (serve(c) < 0)
+				conn_close(c);
+			continue;
+		}
+		if (next < 0 || c->ready_ms - now < next)
+			next = c->ready_ms - now;
+		pp = &c->next_delayed;
+	}
+	return next;
+}
+
+int main(int argc, char **argv)
+{
+	struct epoll_event ev, events[MAX_EVENTS];
+	struct sockaddr_in addr;
+	struct rlimit rl;
+	struct conn *c;
+	int listenfd, epfd, fd, n, one = 1, opt;
+
+	body_cap = 1024;
+	while ((opt = getopt(argc, argv, "b:d:")) != -1) {
+		switch (opt) {
+		case 'b':
+			body_cap = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			delay_ms = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b <bytes>] [-d <ms>] <port>\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || body_cap > MAX_BODY) {
+		fprintf(stderr, "usage: %s [-b <bytes>] [-d <ms>] <port>\n", argv[0]);
+		return 1;
+	}
+	body = malloc(body_cap + 1);
+	for (size_t i = 0; i < body_cap; i++)
+		body[i] = 'a' + i % 26;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(atoi(argv[optind]));
+	if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenfd, 4096) < 0) {
+		perror("origin: bind");
+		return 1;
+	}
+	epfd = epoll_create1(0);
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev);
+
+	while (!stop) {
+		if ((n = epoll_wait(epfd, events, MAX_EVENTS, delayed ? run_delayed() : -1)) < 0)
+			continue;
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == NULL) {
+				while ((fd = accept4(listenfd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+					setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+					c = calloc(1, sizeof(struct conn));
+					c->fd = fd;
+					connections++;
+					ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+					ev.data.ptr = c;
+					epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+				}
+				continue;
+			}
+			c = events[i].data.ptr;
+			if (c->ready_ms == 0 && serve(c) < 0)
+				conn_close(c);
+		}
+		if (delayed)
+			run_delayed();
+	}
+	fprintf(stderr, "origin: requests %ld connections %ld\n", requests, connections);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * policy.c - Cache replacement policies, see policy.h
+ */
+#include "csapp.h"
+#include "policy.h"
+
+#define SMALL 0
+#define MAIN 1
+#define FREQ_CAP 3		/* CLOCK and S3FIFO count hits up to this */
+
+static const char *names[POLICY_COUNT] = { "lru", "clock", "gdsf", "s3fifo" };
+
+int policy_parse(const char *name)
+{
+	for (int i = 0; i < POLICY_COUNT; i++)
+		if (!strcmp(name, names[i]))
+			return i;
+	return -1;
+}
+
+const char *policy_name(int kind)
+{
+	return names[kind];
+}
+
+static void q_append(struct pqueue *q, struct pnode *n)
+{
+	n->next = NULL;
+	n->prev = q->tail;
+	if (q->tail != NULL)
+		q->tail->next = n;
+	else
+		q->head = n;
+	q->tail = n;
+	q->size += n->size;
+}
+
+static void q_unlink(struct pqueue *q, struct pnode *n)
+{
+	if (n->prev != NULL)
+		n->prev->next = n->next;
+	else
+		q->head = n->next;
+	if (n->next != NULL)
+		n->next->prev = n->prev;
+	else
+		q->tail = n->prev;
+	q->size -= n->size;
+}
+
+/* GDSF heap, a min-heap on prio that keeps each node's index current */
+
+static void heap_set(struct policy *p, int i, struct pnode *n)
+{
+	p->heap[i] = n;
+	n->heap = i;
+}
+
+static void sift_up(struct policy *p, int i)
+{
+	struct pnode *n = p->heap[i];
+
+	while (i > 0 && p->heap[(i - 1) / 2]->prio > n->prio) {
+		heap_set(p, i, p->heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	heap_set(p, i, n);
+}
+
+static void sift_down(struct policy *p, int i)
+{
+	struct pnode *n = p->heap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < p->heap_len) {
+		if (child + 1 < p->heap_len && p->heap[child + 1]->prio < p->heap[child]->prio)
+			child++;
+		if (p->heap[child]->prio >= n->prio)
+			break;
+		heap_set(p, i, p->heap[child]);
+		i = child;
+	}
+	heap_set(p, i, n);
+}
+
+/* GDSF priority of n from its current hit count */
+static double gdsf_prio(struct policy *p, struct pnode *n)
+{
+	double cost = 2 + (double)n->size / 536;	/* packets to fetch it again */
+
+	return p->inflation + n->freq * cost / n->size;
+}
+
+static void ghost_add(struct policy *p, uint64_t hash)
+{
+	p->ghost[hash & p->ghost_mask] = hash;
+}
+
+static int ghost_has(struct policy *p, uint64_t hash)
+{
+	return p->ghost[hash & p->ghost_mask] == hash;
+}
+
+void policy_init(struct policy *p, int kind, size_t capacity)
+{
+	size_t slots = 1024;
+
+	memset(p, 0, sizeof(*p));
+	p->kind = kind;
+	p->capacity = capacity;
+	if (kind == POLICY_S3FIFO) {
+		/* Room for about as many victims as objects of 2 KB fit */
+		while (slots < capacity / 2048)
+			slots *= 2;
+		p->ghost = Calloc(slots, sizeof(uint64_t));
+		p->ghost_mask = slots - 1;
+	}
+}
+
+void policy_free(struct policy *p)
+{
+	free(p->heap);
+	free(p->ghost);
+	p->heap = NULL;
+	p->ghost = NULL;
+}
+
+void policy_insert(struct policy *p, struct pnode *n)
+{
+	p->size += n->size;
+	switch (p->kind) {
+	case POLICY_LRU:
+	case POLICY_CLOCK:
+		n->freq = 0;
+		q_append(&p->q[0], n);
+		break;
+	case POLICY_GDSF:
+		n->freq = n->placed = 1;
+		n->prio = gdsf_prio(p, n);
+		if (p->heap_len == p->heap_cap) {
+			p->heap_cap = p->heap_cap ? 2 * p->heap_cap : 64;
+			p->heap = Realloc(p->heap, p->heap_cap * sizeof(struct pnode *));
+		}
+		heap_set(p, p->heap_len++, n);
+		sift_up(p, n->heap);
+		break;
+	case POLICY_S3FIFO:
+		n->freq = 0;
+		n->queue = ghost_has(p, n->hash) ? MAIN : SMALL;
+		q_append(&p->q[n->queue], n);
+		break;
+	}
+}
+
+void policy_hit(struct policy *p, struct pnode *n)
+{
+	int f = __atomic_load_n(&n->freq, __ATOMIC_RELAXED);
+
+	switch (p->kind) {
+	case POLICY_LRU:
+		q_unlink(&p->q[0], n);
+		q_append(&p->q[0], n);
+		break;
+	case POLICY_GDSF:
+		__atomic_fetch_add(&n->freq, 1, __ATOMIC_RELAXED);
+		break;
+	default:
+		if (f < FREQ_CAP)	/* skip the store, and the cache line bounce, once capped */
+			__atomic_store_n(&n->freq, f + 1, __ATOMIC_RELAXED);
+		break;
+	}
+}
+
+struct pnode *policy_next(struct policy *p)
+{
+	struct pnode *n;
+	struct pqueue *smallq = &p->q[SMALL], *mainq = &p->q[MAIN];
+
+	switch (p->kind) {
+	case POLICY_LRU:
+		return p->q[0].head;
+	case POLICY_CLOCK:
+		/* Clear reference bits until one is clear; at most one round */
+		while ((n = p->q[0].head) != NULL && n->freq) {
+			n->freq = 0;
+			q_unlink(&p->q[0], n);
+			q_append(&p->q[0], n);
+		}
+		return n;
+	case POLICY_GDSF:
+		/* Hits only count; place a node by them when it comes up */
+		while (p->heap_len > 0 && p->heap[0]->freq != p->heap[0]->placed) {
+			n = p->heap[0];
+			n->placed = n->freq;
+			n->prio = gdsf_prio(p, n);
+			sift_down(p, 0);
+		}
+		return p->heap_len > 0 ? p->heap[0] : NULL;
+	case POLICY_S3FIFO:
+		for (;;) {
+			if (smallq->head != NULL && (smallq->size > p->capacity / 10 || mainq->head == NULL)) {
+				n = smallq->head;
+				if (n->freq == 0)
+					return n;
+				q_unlink(smallq, n);	/* hit while small: promote */
+				n->freq = 0;
+				n->queue = MAIN;
+				q_append(mainq, n);
+			}
+			else if ((n = mainq->head) != NULL) {
+				if (n->freq == 0)
+					return n;
+				n->freq--;
+				q_unlink(mainq, n);
+				q_append(mainq, n);
+			}
+			else
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+void policy_evict(struct policy *p, struct pnode *n)
+{
+	p->size -= n->size;
+	switch (p->kind) {
+	case POLICY_LRU:
+	case POLICY_CLOCK:
+		q_unlink(&p->q[0], n);
+		break;
+	case POLICY_GDSF:
+		p->inflation = n->prio;
+		heap_set(p, 0, p->heap[--p->heap_len]);
+		if (p->heap_len > 0)
+			sift_down(p, 0);
+		break;
+	case POLICY_S3FIFO:
+		q_unlink(&p->q[n->queue], n);
+		if (n->queue == SMALL)
+			ghost_add(p, n->hash);
+		break;
+	}
+}
@@ -0,0 +1,72 @@
+/*
+ * policy.h - Cache replacement policies over intrusive nodes, shared by
+ *     the proxy cache (one per shard) and the trace simulator.
+ *
+ * LRU     relinks on every hit, so hits need the owner's exclusive lock
+ * CLOCK   a hit sets a reference bit; eviction gives one second chance
+ * GDSF    Greedy-Dual-Size-Frequency: evicts the lowest priority
+ *         L + freq * cost / size, where L inflates to each victim's
+ *         priority and cost is the packets a refetch takes, 2 + size /
+ *         536 (GD-Size's packet cost: a round trip's setup, then the
+ *         segments), so small, frequently used objects stay longest
+ *         but a large one is not dropped for its size alone
+ * S3FIFO  a small FIFO (a tenth of the capacity) for new objects, a
+ *         main FIFO for those hit while in it, and a ghost table of
+ *         recent small-queue victims that go straight to main if seen
+ *         again; one-hit objects leave after a short stay
+ *
+ * Apart from LRU, a hit only bumps the node's freq, which may race with
+ * other readers; it is a hint, and the owner's lock covers the rest.
+ */
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum { POLICY_LRU, POLICY_CLOCK, POLICY_GDSF, POLICY_S3FIFO, POLICY_COUNT };
+
+struct pnode {
+	struct pnode *prev, *next;	/* queue links */
+	size_t size;
+	uint64_t hash;
+	int freq;			/* hits, capped except for GDSF */
+	int queue;			/* S3FIFO: SMALL or MAIN */
+	int heap;			/* GDSF: index in the heap */
+	int placed;			/* GDSF: freq when prio was last set */
+	double prio;			/* GDSF: priority */
+};
+
+struct pqueue {
+	struct pnode *head, *tail;	/* head leaves first */
+	size_t size;
+};
+
+struct policy {
+	int kind;
+	size_t capacity;		/* bytes, for the S3FIFO small queue share */
+	size_t size;			/* bytes held */
+	struct pqueue q[2];		/* LRU and CLOCK use q[0]; S3FIFO small and main */
+	struct pnode **heap;		/* GDSF min-heap on prio */
+	int heap_len, heap_cap;
+	double inflation;		/* GDSF L */
+	uint64_t *ghost;		/* S3FIFO ghost: direct-mapped recent victim hashes */
+	size_t ghost_mask;
+};
+
+/* Policy number for name ("lru", "clock", "gdsf", "s3fifo"), or -1 */
+int policy_parse(const char *name);
+const char *policy_name(int kind);
+
+void policy_init(struct policy *p, int kind, size_t capacity);
+void policy_free(struct policy *p);
+/* Take over a new node */
+void policy_insert(struct policy *p, struct pnode *n);
+/* Note a hit on n */
+void policy_hit(struct policy *p, struct pnode *n);
+/* The node the policy evicts next, or NULL if empty; may reorder the others */
+struct pnode *policy_next(struct policy *p);
+/* Remove the node that policy_next returned */
+void policy_evict(struct policy *p, struct pnode *n);
+
+#endif /* __POLICY_H__ */
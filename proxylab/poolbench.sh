@@ -0,0 +1,52 @@
+#!/bin/bash
+#
+# poolbench.sh - Compare p99 latency of the thread-per-connection proxy
+#     with the prethreaded worker pool at several client concurrencies.
+#
+# usage: ./poolbench.sh [<conns> ...]        (default: 100 1000 5000)
+#
+# Environment: ORIGIN_PORT, PROXY_PORT, REQUESTS (per run), SIZE (body
+# bytes), URLS (distinct objects), DELAY (origin delay in ms) and
+# POOLS (the pool configurations to try, "workers:queue" each).
+#
+ORIGIN_PORT=${ORIGIN_PORT:-9000}
+PROXY_PORT=${PROXY_PORT:-9100}
+REQUESTS=${REQUESTS:-20000}
+SIZE=${SIZE:-1024}
+URLS=${URLS:-1000}
+DELAY=${DELAY:-0}
+POOLS=${POOLS:-"16:64 64:256"}
+CONNS=${@:-100 1000 5000}
+
+make -s proxy loadgen origin || exit 1
+
+./origin -d ${DELAY} ${ORIGIN_PORT} 2> /dev/null &
+origin_pid=$!
+trap "kill ${origin_pid} 2> /dev/null" EXIT
+sleep 0.5
+
+# run <label> <proxy args...>: one loadgen run per concurrency level
+run() {
+    label=$1
+    shift
+    for conns in ${CONNS}; do
+        ./proxy "$@" ${PROXY_PORT} &
+        proxy_pid=$!
+        sleep 0.5
+        result=`./loadgen -c ${conns} -n ${REQUESTS} -U ${URLS} -x 127.0.0.1:${PROXY_PORT} \
+            "http://127.0.0.1:${ORIGIN_PORT}/bench?size=${SIZE}"`
+        kill ${proxy_pid}
+        wait ${proxy_pid} 2> /dev/null
+        echo "${result}" | awk -v label="${label}" -v conns=${conns} '
+            /req\/s/ { for (i = 1; i <= NF; i++) { if ($i == "errors") errors = $(i+1); if ($(i+1) == "req/s") rate = $i } }
+            /latency/ { printf "%-16s %6d %9s %9s %9s %7s\n", label, conns, rate, $4, $8, errors }'
+    done
+}
+
+printf "%-16s %6s %9s %9s %9s %7s\n" mode conns "req/s" "p50 ms" "p99 ms" errors
+run thread -m thread
+for pool in ${POOLS}; do
+    workers=${pool%:*}
+    queue=${pool#*:}
+    run "pool ${workers}/${queue}" -m pool -w ${workers} -q ${queue}
+done
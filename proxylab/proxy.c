@@ -1,89 +1,705 @@
+/*
+ * proxy.c - A concurrent caching web proxy.
+ *
+ * usage: ./proxy [-m thread|pool|event] [-n <loops>] [-w <workers>]
+ *                [-q <queue>] [-s <secs>] [-c <cache bytes>] [-o <object bytes>]
+ *                [-p lru|clock|gdsf|s3fifo] [-a 0|1] [-d <dir>] [-D <disk bytes>]
+ *                [-u <idle per origin>] [-t <idle secs>] [-r <name server>]
+ *                [-C 0|1] <port>
+ *
+ * thread (the default) serves each connection on its own detached
+ * thread with blocking I/O. pool hands accepted connections to -w
+ * prethreaded workers through a queue of -q slots; while the queue is
+ * full the proxy stops accepting, so excess load waits in the listen
+ * backlog instead of growing threads without bound. -s prints the
+ * pool's utilization and queue depth every <secs> seconds. event runs
+ * edge-triggered epoll loops, one per core unless -n says otherwise,
+ * see event.c.
+ *
+ * -c and -o set the cache's capacity and largest object, -p its
+ * replacement policy and -a whether TinyLFU admission is on, see
+ * cache.h. -d keeps a disk tier of up to -D bytes in <dir>; on SIGINT
+ * or SIGTERM the proxy then demotes its memory cache to disk before it
+ * exits, so a restart is warm. The tier's reads and writes block, so it
+ * is refused in event mode, where they would stall a whole loop.
+ *
+ * In thread and pool mode a client connection carries requests until
+ * the client closes it or leaves it idle for KEEPALIVE_TIMEOUT seconds
+ * (in pool mode it waits in an epoll set meanwhile, not on a worker),
+ * and origin connections are pooled for reuse: -u idle ones per origin
+ * (0 for none), each kept at most -t seconds, see upstream.h. On exit
+ * the proxy prints how many were reused.
+ *
+ * Origin names are resolved by a caching resolver, see dns.h, which
+ * asks -r <a.b.c.d[:port]>, or else the name server of
+ * /etc/resolv.conf.
+ *
+ * In thread and pool mode, concurrent misses on one URI are collapsed
+ * into one origin fetch whose response they all share as it arrives,
+ * see inflight.h; -C 0 turns that off.
+ */
+#define _GNU_SOURCE	/* splice */
 #include <stdio.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#include "csapp.h"
 #include "cache.h"
-#include "cache.c"
-/* Recommended max cache and object sizes */
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
+#include "http.h"
+#include "event.h"
+#include "sbuf.h"
+#include "disk.h"
+#include "upstream.h"
+#include "dns.h"
+#include "inflight.h"
 
-/* You won't lose style points for including these long lines in your code */
-static const char *user_agent_hdr = "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 Firefox/10.0.3\r\n";
-static const char *accept_hdr = "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n";
-static const char *accept_encoding_hdr = "Accept-Encoding: gzip, deflate\r\n";
+#define WORKERS 16
+#define PIPE_CHUNK 65536	/* a default pipe's capacity */
+#define QUEUE_SLOTS 64
+#define KEEPALIVE_TIMEOUT 5	/* seconds a client connection may sit idle */
+#define RELAY_RETRY -1		/* relay: the origin closed without answering */
 
 /* Function Prototypes */
 void *proxy_thread(void *vargp);
+void *pool_worker(void *vargp);
+void *pool_reporter(void *vargp);
+void *parker(void *vargp);
+void *shutdown_thread(void *vargp);
+void park(int fd);
+int doit(int fd, int may_park);
+int serve(int fd, rio_t *rio);
+int forward(int fd, char *uri, char *host, char *port, char *path, char *hdrs, struct fetch *f);
+int relay(int fd, int serverfd, char *uri, int *reuse, struct fetch *f);
+void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
+int read_requesthdrs(rio_t *rp, char *hdrs, size_t size);
 
-/* Global Variables */
+/* Thousands of connections need more descriptors than the usual soft limit */
+static void raise_fd_limit(void)
+{
+	struct rlimit rl;
 
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
 
-int main(int argc, char *argv [])
+/* Worker pool state; the counters are updated with atomic adds */
+static sbuf_t sbuf;
+static int workers = WORKERS;
+static int busy;			/* workers serving a connection */
+static long served;			/* connections served, once per stretch of requests */
+static long busy_us;			/* worker time spent serving, microseconds */
+static int disk_tier;
+
+/*
+ * Idle kept-alive connections of the pool, waiting in park_epfd to be
+ * queued again once readable, on a list oldest first for the timeout
+ */
+struct parked {
+	int fd;
+	long since;			/* microseconds */
+	struct parked *prev, *next;
+};
+
+static int park_epfd;
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct parked *park_head, *park_tail;
+
+static long now_us(void)
 {
-    printf("%s%s%s", user_agent_hdr, accept_hdr, accept_encoding_hdr);
+	struct timeval tv;
 
-    Signal(SIGPIPE, SIGIGN); // Block SIGPIPE.
-	int listenfd, *connfdp, port;
-	socklen_t clientlen = sizeof(struct sockaddr_in);
-	struct sockaddr_in clientaddr;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-m thread|pool|event] [-n <loops>] [-w <workers>] "
+		"[-q <queue>] [-s <secs>] [-c <cache bytes>] [-o <object bytes>] "
+		"[-p lru|clock|gdsf|s3fifo] [-a 0|1] [-d <dir>] [-D <disk bytes>] "
+		"[-u <idle per origin>] [-t <idle secs>] [-r <name server>] [-C 0|1] <port>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv [])
+{
+	int listenfd, connfd, *connfdp, port, c;
+	int event = 0, pool = 0, loops = sysconf(_SC_NPROCESSORS_ONLN);
+	int slots = QUEUE_SLOTS, interval = 0, idle = UPSTREAM_IDLE, idle_secs = UPSTREAM_TIMEOUT;
+	int collapse = 1;
+	struct cacheconfig config;
+	char *name_server = NULL;
 	pthread_t tid;
+	sigset_t stop;
 
-	if (argc != 2) {
-		fprintf(stderr, "usage: %s <port>\n", argv[0]);
-		exit(0);
+	cacheconfig_init(&config);
+	while ((c = getopt(argc, argv, "m:n:w:q:s:c:o:p:a:d:D:u:t:r:C:")) != -1) {
+		switch (c) {
+		case 'm':
+			if (!strcmp(optarg, "event"))
+				event = 1;
+			else if (!strcmp(optarg, "pool"))
+				pool = 1;
+			else if (strcmp(optarg, "thread"))
+				usage(argv[0]);
+			break;
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		case 'w':
+			workers = atoi(optarg);
+			break;
+		case 'q':
+			slots = atoi(optarg);
+			break;
+		case 's':
+			interval = atoi(optarg);
+			break;
+		case 'c':
+			config.max_size = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			config.max_object = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			if ((config.policy = policy_parse(optarg)) < 0)
+				usage(argv[0]);
+			break;
+		case 'a':
+			config.admission = atoi(optarg);
+			break;
+		case 'd':
+			config.disk_dir = optarg;
+			break;
+		case 'D':
+			config.disk_size = strtoul(optarg, NULL, 10);
+			break;
+		case 'u':
+			idle = atoi(optarg);
+			break;
+		case 't':
+			idle_secs = atoi(optarg);
+			break;
+		case 'r':
+			name_server = optarg;
+			break;
+		case 'C':
+			collapse = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || loops < 1 || workers < 1 || slots < 1 || idle < 0 ||
+		config.max_object > config.max_size)
+		usage(argv[0]);
+	if (event && config.disk_dir != NULL) {
+		fprintf(stderr, "%s: -d needs -m thread or pool\n", argv[0]);
+		exit(1);
 	}
-	port = atoi(argv[1]);
+	port = atoi(argv[optind]);
+
+	Signal(SIGPIPE, SIG_IGN); /* a client that goes away must not kill the proxy */
+	raise_fd_limit();
+	init_cache(&config);
+	upstream_init(idle, idle_secs);
+	inflight_init(collapse);
+	disk_tier = config.disk_dir != NULL;
+
+	/* Every thread created from here on leaves the stop signals to shutdown_thread */
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGINT);
+	sigaddset(&stop, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop, NULL);
+	Pthread_create(&tid, NULL, shutdown_thread, &stop);
+	if (dns_init(name_server, DNS_HELPERS) < 0)
+		usage(argv[0]);
+
+	if (event)
+		return event_main(port, loops) < 0;
 
 	listenfd = Open_listenfd(port);
+	if (pool) {
+		sbuf_init(&sbuf, slots);
+		if ((park_epfd = epoll_create1(0)) < 0)
+			unix_error("epoll_create1 error");
+		Pthread_create(&tid, NULL, parker, NULL);
+		for (int i = 0; i < workers; i++)
+			Pthread_create(&tid, NULL, pool_worker, NULL);
+		if (interval > 0)
+			Pthread_create(&tid, NULL, pool_reporter, (void *)(long)interval);
+		while (1) {
+			if ((connfd = accept(listenfd, NULL, NULL)) < 0)
+				continue;
+			sbuf_insert(&sbuf, connfd); /* blocks, and so stops accepting, while full */
+		}
+	}
 	while (1) {
 		connfdp = Malloc(sizeof(int));
-		*connfdp = Accept(listenfd, (SA *) &clientaddr, &clientlen);
-		Pthread_create(&tid, NULL, proxy_thread, connfdp);
+		if ((*connfdp = accept(listenfd, NULL, NULL)) < 0) {
+			Free(connfdp);
+			continue;
+		}
+		if (pthread_create(&tid, NULL, proxy_thread, connfdp) != 0) {
+			Close(*connfdp);
+			Free(connfdp);
+		}
 	}
 	return 0;
 }
 
-void *proxy_thread(void *vargp) {
+void *proxy_thread(void *vargp)
+{
 	int fd = *(int *)vargp;
-	struct stat sbuf;
-	char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-	rio_t rio;
 
 	Pthread_detach(Pthread_self());
+	Free(vargp);
+	doit(fd, 0);
+	Close(fd);
+	return NULL;
+}
+
+void *pool_worker(void *vargp)
+{
+	long start;
+	int fd;
+
+	Pthread_detach(Pthread_self());
+	while (1) {
+		fd = sbuf_remove(&sbuf);
+		__sync_fetch_and_add(&busy, 1);
+		start = now_us();
+		if (doit(fd, 1))
+			park(fd);
+		else
+			Close(fd);
+		__sync_fetch_and_add(&busy_us, now_us() - start);
+		__sync_fetch_and_add(&served, 1);
+		__sync_fetch_and_sub(&busy, 1);
+	}
+	return NULL;
+}
+
+/* With park_lock held, take p off the parked list */
+static void unlink_parked(struct parked *p)
+{
+	if (p->prev != NULL)
+		p->prev->next = p->next;
+	else
+		park_head = p->next;
+	if (p->next != NULL)
+		p->next->prev = p->prev;
+	else
+		park_tail = p->prev;
+}
+
+/* Leave the idle connection fd to the parker until the client sends more */
+void park(int fd)
+{
+	struct parked *p = Malloc(sizeof(struct parked));
+	struct epoll_event ev;
+
+	p->fd = fd;
+	p->since = now_us();
+	p->next = NULL;
+	ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	ev.data.ptr = p;
+	/* On the list before epoll can report it, so the parker finds it there */
+	pthread_mutex_lock(&park_lock);
+	p->prev = park_tail;
+	if (park_tail != NULL)
+		park_tail->next = p;
+	else
+		park_head = p;
+	park_tail = p;
+	if (epoll_ctl(park_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		unlink_parked(p);
+		Free(p);
+		Close(fd);
+	}
+	pthread_mutex_unlock(&park_lock);
+}
+
+/*
+ * parker - queue parked connections for the workers again once the
+ *     client sends something (or hangs up), and close those idle for
+ *     KEEPALIVE_TIMEOUT seconds
+ */
+void *parker(void *vargp)
+{
+	struct epoll_event ev[64];
+	int ready[64], n, wait;
+	struct parked *p;
+	long now;
+
+	Pthread_detach(Pthread_self());
+	while (1) {
+		pthread_mutex_lock(&park_lock);
+		wait = KEEPALIVE_TIMEOUT * 1000;	/* one parked from now on expires no sooner */
+		if (park_head != NULL)
+			wait = (park_head->since + KEEPALIVE_TIMEOUT * 1000000L - now_us()) / 1000 + 1;
+		pthread_mutex_unlock(&park_lock);
+		if ((n = epoll_wait(park_epfd, ev, 64, wait > 0 ? wait : 0)) < 0)
+			n = 0;	/* EINTR */
+		pthread_mutex_lock(&park_lock);
+		for (int i = 0; i < n; i++) {
+			p = ev[i].data.ptr;
+			epoll_ctl(park_epfd, EPOLL_CTL_DEL, p->fd, NULL);
+			unlink_parked(p);
+			ready[i] = p->fd;
+			Free(p);
+		}
+		now = now_us();
+		while ((p = park_head) != NULL && now - p->since >= KEEPALIVE_TIMEOUT * 1000000L) {
+			epoll_ctl(park_epfd, EPOLL_CTL_DEL, p->fd, NULL);
+			unlink_parked(p);
+			Close(p->fd);
+			Free(p);
+		}
+		pthread_mutex_unlock(&park_lock);
+		for (int i = 0; i < n; i++)
+			sbuf_insert(&sbuf, ready[i]);	/* may block while the queue is full */
+	}
+	return NULL;
+}
+
+/* Print the pool's counters every interval seconds */
+void *pool_reporter(void *vargp)
+{
+	int interval = (long)vargp, depth, max_depth;
+	long last_busy = 0, last_served = 0, last = now_us(), now, b, n, full;
+
+	Pthread_detach(Pthread_self());
+	while (1) {
+		sleep(interval);
+		now = now_us();
+		b = __sync_fetch_and_add(&busy_us, 0);
+		n = __sync_fetch_and_add(&served, 0);
+		P(&sbuf.mutex);
+		depth = sbuf.depth;
+		max_depth = sbuf.max_depth;
+		full = sbuf.full;
+		V(&sbuf.mutex);
+		fprintf(stderr, "pool: busy %d/%d, utilization %.0f%%, queue %d/%d (max %d, full %ld), "
+			"served %ld (%.0f/s)\n", __sync_fetch_and_add(&busy, 0), workers,
+			100.0 * (b - last_busy) / ((double)(now - last) * workers),
+			depth, sbuf.n, max_depth, full, n, (n - last_served) * 1e6 / (now - last));
+		upstream_report(stderr);
+		last_busy = b;
+		last_served = n;
+		last = now;
+	}
+	return NULL;
+}
 
-	Rio_readinitb(&rio, fd);
-	RIO_realineb(&rio, buf, MAXLINE);
-	sscanf(buf, "%s %s %s", method, uri, version);
+/* Wait for SIGINT or SIGTERM, then save the memory cache to the disk tier, report and exit */
+void *shutdown_thread(void *vargp)
+{
+	int sig;
 
+	Pthread_detach(Pthread_self());
+	sigwait((sigset_t *)vargp, &sig);
+	cachesync();
+	upstream_report(stderr);
+	dns_report(stderr);
+	inflight_report(stderr);
+	if (disk_tier)
+		disk_report(stderr);
+	exit(0);
+}
+
+/*
+ * doit - serve the requests on connection fd one after another while
+ *     the client keeps it open, waiting up to KEEPALIVE_TIMEOUT seconds
+ *     for each; with may_park set, stop instead once the client has sent
+ *     nothing more yet. 1 if the connection is left open, else 0.
+ */
+int doit(int fd, int may_park)
+{
+	struct timeval tv = { KEEPALIVE_TIMEOUT, 0 };
+	int one = 1;
+	rio_t rio;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	/* A response's head and body go out in separate writes; Nagle would hold the second back */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	rio_readinitb(&rio, fd);
+	while (serve(fd, &rio))
+		if (may_park && rio.rio_cnt == 0)	/* nothing pipelined behind it */
+			return 1;
+	return 0;
+}
+
+/*
+ * serve - serve one request: from the cache if it holds the URI, else
+ *     from the response another client's request is already fetching,
+ *     else from the origin over a pooled connection, keeping a copy
+ *     when it fits in the cache's largest object; 1 if the client's
+ *     connection may carry another request
+ */
+int serve(int fd, rio_t *rio)
+{
+	char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+	char host[MAXLINE], port[MAXLINE], path[MAXLINE];
+	char hdrs[MAXBUF];
+	int keep, leader, rc;
+	struct fetch *f;
+	obj *cached;
+
+	if (rio_readlineb(rio, buf, MAXLINE) <= 0)
+		return 0;
+	if (sscanf(buf, "%s %s %s", method, uri, version) != 3) {
+		clienterror(fd, buf, "400", "Bad Request", "Proxy could not parse the request");
+		return 0;
+	}
 	if (strcasecmp(method, "GET")) {
 		clienterror(fd, method, "501", "Not Implemented",
 			"Proxy does not support this method");
-		return;
-	}
-
-	read_requesthdrs(&rio);
-}
-
-
-int parse_uri(char *uri, char *filename, char *cgiargs)
-{
-	char *ptr;
-	if (!strstr(uri, "cgi-bin")) {  /* Static content */
-    	strcpy(cgiargs, "");
-    	strcpy(filename, ".");
-    	strcat(filename, uri);
-    	if (uri[strlen(uri)-1] == '/')
-      	strcat(filename, "home.html");
-   	 	return 1;
-  	}
-  	else {  /* Dynamic content */
-    	ptr = index(uri, '?');
-    	if (ptr) {
-      		strcpy(cgiargs, ptr+1);
-      		*ptr = '\0';
-    	}
-    	else
-      		strcpy(cgiargs, "");
-    	strcpy(filename, ".");
-    	strcat(filename, uri);
-    	return 0;
-  	}
+		return 0;
+	}
+	if (read_requesthdrs(rio, hdrs, sizeof(hdrs)) < 0 ||
+		parse_uri(uri, host, port, path) < 0) {
+		clienterror(fd, uri, "400", "Bad Request", "Proxy could not parse the request");
+		return 0;
+	}
+	keep = client_keep_alive(version, hdrs);
+
+	if ((cached = cacheget(uri)) != NULL) {
+		off_t off = 0;
+		ssize_t n;
+
+		while (off < cached->node.size && ((n = cachesend(fd, cached, &off)) > 0 || (n < 0 && errno == EINTR)))
+			;
+		rc = off == cached->node.size;
+		cacheput(cached);
+		return keep && rc;
+	}
+
+	f = inflight_join(uri, &leader);
+	if (!leader) {
+		if ((rc = inflight_follow(f, fd)) != INFLIGHT_ALONE)
+			return keep && rc;
+		f = NULL;	/* the leader's response could not be shared */
+	}
+	rc = forward(fd, uri, host, port, path, hdrs, f);
+	inflight_done(f);
+	return keep && rc;
+}
+
+/*
+ * forward - fetch uri from the origin for the client on fd, sharing
+ *     the response through f with any requests that follow it; 1 if
+ *     the client got all of a response with a length
+ */
+int forward(int fd, char *uri, char *host, char *port, char *path, char *hdrs, struct fetch *f)
+{
+	char request[MAXBUF];
+	int serverfd, len, reused, reuse, rc;
+
+	if ((len = build_request(request, sizeof(request), path, host, port, hdrs, 1)) < 0) {
+		clienterror(fd, host, "502", "Bad Gateway", "Proxy could not reach the server");
+		return 0;
+	}
+	/* The origin may have closed a pooled connection just as the request went out; try another */
+	while (1) {
+		if ((serverfd = upstream_get(host, port, &reused)) < 0) {
+			clienterror(fd, host, "502", "Bad Gateway", "Proxy could not reach the server");
+			return 0;
+		}
+		reuse = 0;
+		if (rio_writen(serverfd, request, len) == len)
+			rc = relay(fd, serverfd, uri, &reuse, f);
+		else
+			rc = RELAY_RETRY;
+		if (reuse)
+			upstream_put(host, port, serverfd);
+		else
+			close(serverfd);
+		if (rc != RELAY_RETRY)
+			return rc;
+		if (!reused) {
+			clienterror(fd, host, "502", "Bad Gateway", "The server closed without answering");
+			return 0;
+		}
+		upstream_failed();
+	}
+}
+
+/* Splice n bytes from the pipe in to out, at *off if out is a file; -1 on error */
+static int splice_all(int in, int out, loff_t *off, size_t n)
+{
+	ssize_t m;
+
+	while (n > 0) {
+		if ((m = splice(in, NULL, out, off, n, SPLICE_F_MOVE)) < 0 && errno == EINTR)
+			continue;
+		if (m <= 0)
+			return -1;
+		n -= m;
+	}
+	return 0;
+}
+
+/* sendfile memfd from *off up to end to fd, or unless block only what fd takes now; -1 on error */
+static int send_all(int fd, int memfd, off_t *off, off_t end, int block)
+{
+	ssize_t m;
+
+	while (*off < end) {
+		if ((m = sendfile(fd, memfd, off, end - *off)) < 0 && errno == EINTR)
+			continue;
+		if (m < 0 && errno == EAGAIN && !block)
+			return 0;
+		if (m <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * relay - pass the response to the request just sent on serverfd on
+ *     to fd. The head is read and rewritten in user space (see
+ *     parse_response); the body goes server -> pipe -> memfd by splice
+ *     and memfd -> client by sendfile, and the memfd becomes the cached
+ *     object. A body too big for the cache, or with no length (so a
+ *     cut-off one would pass for whole), is spliced from the pipe
+ *     straight to the client. Requests following f are sent the memfd
+ *     as it fills, and since they may still want it, a response being
+ *     cached is read in full even if the client goes away, and while it
+ *     is read the client only gets what its socket takes at once, so a
+ *     client that stops reading holds up no follower. Returns
+ *     RELAY_RETRY if the origin closed without answering, 1 if the
+ *     client got all of a response with a length, else 0; *reuse says
+ *     if serverfd may go back to the pool.
+ */
+int relay(int fd, int serverfd, char *uri, int *reuse, struct fetch *f)
+{
+	char head[MAXBUF], out[MAXBUF], *body;
+	int pipefd[2], memfd = -1, ok, client = 1, n, flags = 0;
+	struct response r;
+	size_t got = 0, extra;
+	long long left;
+	loff_t len = 0;
+	off_t sent = 0;
+	ssize_t m;
+
+	*reuse = 0;
+	head[0] = '\0';
+	/* Read up to the end of the head; the last read may bring the start of the body */
+	while ((body = strstr(head, "\r\n\r\n")) == NULL) {
+		if (got == sizeof(head) - 1) {
+			clienterror(fd, uri, "502", "Bad Gateway", "The server's response head is too long");
+			return 0;
+		}
+		if ((m = read(serverfd, head + got, sizeof(head) - 1 - got)) < 0 && errno == EINTR)
+			continue;
+		if (m <= 0) {
+			if (got == 0)
+				return RELAY_RETRY;
+			clienterror(fd, uri, "502", "Bad Gateway", "The server's response was cut off");
+			return 0;
+		}
+		got += m;
+		head[got] = '\0';
+	}
+	body += 4;
+	if ((n = parse_response(head, &r, out, sizeof(out))) < 0) {
+		clienterror(fd, uri, "502", "Bad Gateway", "Proxy could not parse the response");
+		return 0;
+	}
+	extra = head + got - body;
+	if (r.length >= 0 && extra > r.length) {
+		extra = r.length;	/* the origin sent more than it said; do not trust it again */
+		r.reusable = 0;
+	}
+	left = r.length >= 0 ? r.length - extra : -1;	/* -1: until the origin closes */
+
+	if (pipe(pipefd) < 0)
+		return 0;
+	if (r.length >= 0 && n + r.length <= cachemaxobject())
+		memfd = cachememfd();
+	if (memfd >= 0) {
+		ok = pwrite(memfd, out, n, 0) == n && pwrite(memfd, body, extra, n) == extra;
+		len = n + extra;
+		inflight_stream(f, memfd, n + r.length);
+		if (ok)
+			inflight_progress(f, len);
+		flags = fcntl(fd, F_GETFL);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);	/* until the origin is done */
+		client = ok && send_all(fd, memfd, &sent, len, 0) == 0;
+	}
+	else {
+		inflight_fail(f);	/* nothing to share: followers fetch for themselves */
+		if (n + extra <= sizeof(out)) { /* one write for the head and what came with it */
+			memcpy(out + n, body, extra);
+			n += extra;
+			extra = 0;
+		}
+		ok = rio_writen(fd, out, n) == n && rio_writen(fd, body, extra) == extra;
+	}
+
+	while (ok && left != 0) {
+		m = splice(serverfd, NULL, pipefd[1], NULL, left < 0 || left > PIPE_CHUNK ? PIPE_CHUNK : left,
+			SPLICE_F_MOVE);
+		if (m < 0 && errno == EINTR)
+			continue;
+		if (m <= 0) {
+			ok = m == 0 && left < 0; /* the end of a body without a length, or a cut-off one */
+			break;
+		}
+		if (left > 0)
+			left -= m;
+		if (memfd >= 0) {
+			if ((ok = splice_all(pipefd[0], memfd, &len, m) == 0))
+				inflight_progress(f, len);
+			client = client && send_all(fd, memfd, &sent, len, 0) == 0;
+		}
+		else
+			ok = splice_all(pipefd[0], fd, NULL, m) == 0;
+	}
+	close(pipefd[0]);
+	close(pipefd[1]);
+	if (memfd >= 0) {
+		fcntl(fd, F_SETFL, flags);
+		client = client && send_all(fd, memfd, &sent, len, 1) == 0;	/* what the client had no room for */
+		if (ok)
+			cacheadopt(uri, memfd, len);
+		else
+			close(memfd);
+	}
+	*reuse = ok && r.reusable && left == 0;
+	return ok && client && r.length >= 0;
+}
+
+/*
+ * read_requesthdrs - collect the request headers up to the blank line
+ *     into hdrs; -1 if they do not fit
+ */
+int read_requesthdrs(rio_t *rp, char *hdrs, size_t size)
+{
+	char buf[MAXLINE];
+	size_t len = 0, n;
+
+	hdrs[0] = '\0';
+	while (rio_readlineb(rp, buf, MAXLINE) > 0 && strcmp(buf, "\r\n")) {
+		if ((n = strlen(buf)) + len >= size)
+			return -1;
+		memcpy(hdrs + len, buf, n + 1);
+		len += n;
+	}
+	return 0;
+}
+
+void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg)
+{
+	char buf[MAXBUF];
+	int len = format_error(buf, sizeof(buf), cause, errnum, shortmsg, longmsg);
+
+	rio_writen(fd, buf, len);
 }
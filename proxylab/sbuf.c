@@ -0,0 +1,51 @@
+/*
+ * sbuf.c - Bounded buffer of connected descriptors, see sbuf.h
+ */
+#include "sbuf.h"
+
+/* Create an empty, bounded, shared FIFO buffer with n slots */
+void sbuf_init(sbuf_t *sp, int n)
+{
+	sp->buf = Calloc(n, sizeof(int));
+	sp->n = n;
+	sp->front = sp->rear = 0;
+	sp->depth = sp->max_depth = 0;
+	sp->full = 0;
+	Sem_init(&sp->mutex, 0, 1);
+	Sem_init(&sp->slots, 0, n);
+	Sem_init(&sp->items, 0, 0);
+}
+
+void sbuf_deinit(sbuf_t *sp)
+{
+	Free(sp->buf);
+}
+
+void sbuf_insert(sbuf_t *sp, int item)
+{
+	if (sem_trywait(&sp->slots) < 0) {
+		P(&sp->mutex);
+		sp->full++;
+		V(&sp->mutex);
+		P(&sp->slots);
+	}
+	P(&sp->mutex);
+	sp->buf[(++sp->rear) % (sp->n)] = item;
+	if (++sp->depth > sp->max_depth)
+		sp->max_depth = sp->depth;
+	V(&sp->mutex);
+	V(&sp->items);
+}
+
+int sbuf_remove(sbuf_t *sp)
+{
+	int item;
+
+	P(&sp->items);
+	P(&sp->mutex);
+	item = sp->buf[(++sp->front) % (sp->n)];
+	sp->depth--;
+	V(&sp->mutex);
+	V(&sp->slots);
+	return item;
+}
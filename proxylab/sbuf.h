@@ -0,0 +1,31 @@
+/*
+ * sbuf.h - Bounded producer-consumer buffer of connected descriptors,
+ *     after the one in CS:APP 12.5.4, with depth counters for the
+ *     worker pool's statistics.
+ */
+#ifndef __SBUF_H__
+#define __SBUF_H__
+
+#include "csapp.h"
+
+typedef struct {
+	int *buf;		/* Buffer array */
+	int n;			/* Maximum number of slots */
+	int front;		/* buf[(front+1)%n] is first item */
+	int rear;		/* buf[rear%n] is last item */
+	int depth;		/* Items in the buffer now */
+	int max_depth;		/* Most items ever in the buffer */
+	long full;		/* Inserts that found the buffer full */
+	sem_t mutex;		/* Protects accesses to buf and the counters */
+	sem_t slots;		/* Counts available slots */
+	sem_t items;		/* Counts available items */
+} sbuf_t;
+
+void sbuf_init(sbuf_t *sp, int n);
+void sbuf_deinit(sbuf_t *sp);
+/* Add item to the rear, blocking while the buffer is full */
+void sbuf_insert(sbuf_t *sp, int item);
+/* Remove and return the first item, blocking while the buffer is empty */
+int sbuf_remove(sbuf_t *sp);
+
+#endif /* __SBUF_H__ */
@@ -0,0 +1,200 @@
+/*
+ * stubdns.c - A stub DNS server for testing the proxy's resolver
+ *     offline: it answers every A query itself, after an optional
+ *     delay, like a recursive server would.
+ *
+ * usage: ./stubdns [-t <ttl>] [-n <negative ttl>] [-d <ms>] <port>
+ *
+ * A name whose first label starts with "nx" gets NXDOMAIN, with an SOA
+ * record giving <negative ttl> (default 30); one starting with "fail"
+ * gets SERVFAIL; one starting with "ttlN-" gets 127.0.0.1 for N
+ * seconds; any other gets 127.0.0.1 for <ttl> seconds (default 300).
+ * -d holds every answer back for <ms> milliseconds. The number of
+ * queries answered goes to stderr on SIGINT or SIGTERM.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define PACKET 512
+#define MAX_HELD 4096
+
+struct held {
+	unsigned char buf[PACKET];
+	size_t len;
+	struct sockaddr_in to;
+	long due_ms;
+};
+
+static struct held held[MAX_HELD];
+static int nheld;
+static long queries;
+static volatile sig_atomic_t stop;
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+static void on_signal(int sig)
+{
+	stop = 1;
+}
+
+static void put16(unsigned char *p, unsigned v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static void put32(unsigned char *p, unsigned long v)
+{
+	put16(p, v >> 16);
+	put16(p + 2, v);
+}
+
+/* Answer the query in q into r; the answer's length, or 0 to ignore the query */
+static size_t answer(const unsigned char *q, size_t n, unsigned char *r, long ttl, long neg_ttl)
+{
+	char label[64];
+	size_t qend = 12, len;
+	unsigned char *p;
+	int rcode = 0;
+
+	if (n < 12 || (q[2] & 0x80) || q[4] != 0 || q[5] != 1)
+		return 0;
+	while (qend < n && q[qend] != 0)
+		qend += q[qend] + 1;
+	if ((qend += 5) > n)		/* the root label, type and class */
+		return 0;
+	len = q[12] < sizeof(label) ? q[12] : sizeof(label) - 1;
+	memcpy(label, q + 13, len);
+	label[len] = '\0';
+	if (!strncmp(label, "nx", 2))
+		rcode = 3;
+	else if (!strncmp(label, "fail", 4))
+		rcode = 2;
+	else
+		sscanf(label, "ttl%ld-", &ttl);	/* else the default stands */
+
+	memcpy(r, q, qend);
+	r[2] = 0x81;			/* a response, recursion desired */
+	r[3] = 0x80 | rcode;		/* recursion available */
+	put16(r + 6, rcode == 0);	/* answers */
+	put16(r + 8, rcode == 3);	/* authority: the SOA */
+	put16(r + 10, 0);
+	p = r + qend;
+	if (rcode == 0) {
+		put16(p, 0xc00c);	/* the name in the question */
+		put16(p + 2, 1);	/* A */
+		put16(p + 4, 1);	/* IN */
+		put32(p + 6, ttl);
+		put16(p + 10, 4);
+		p[12] = 127, p[13] = 0, p[14] = 0, p[15] = 1;
+		p += 16;
+	}
+	else if (rcode == 3) {
+		put16(p, 0xc00c);
+		put16(p + 2, 6);	/* SOA */
+		put16(p + 4, 1);
+		put32(p + 6, neg_ttl);
+		put16(p + 10, 2 + 20);	/* two root names, then five counters */
+		p += 12;
+		*p++ = 0;
+		*p++ = 0;
+		put32(p, 1);		/* serial */
+		put32(p + 4, 3600);	/* refresh */
+		put32(p + 8, 600);	/* retry */
+		put32(p + 12, 86400);	/* expire */
+		put32(p + 16, neg_ttl);	/* minimum */
+		p += 20;
+	}
+	return p - r;
+}
+
+static void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-t <ttl>] [-n <negative ttl>] [-d <ms>] <port>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char q[PACKET], r[PACKET];
+	long ttl = 300, neg_ttl = 30, delay = 0, now, wait;
+	struct sockaddr_in addr, from;
+	socklen_t fromlen;
+	struct pollfd pfd;
+	size_t len;
+	ssize_t n;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "t:n:d:")) != -1) {
+		switch (c) {
+		case 't':
+			ttl = atol(optarg);
+			break;
+		case 'n':
+			neg_ttl = atol(optarg);
+			break;
+		case 'd':
+			delay = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(atoi(argv[optind]));
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("stubdns");
+		return 1;
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (!stop) {
+		/* Send what is due, then sleep until the next is, or a query comes */
+		now = now_ms();
+		while (nheld > 0 && held[0].due_ms <= now) {
+			sendto(fd, held[0].buf, held[0].len, 0, (struct sockaddr *)&held[0].to, sizeof(held[0].to));
+			memmove(held, held + 1, --nheld * sizeof(struct held));
+		}
+		wait = nheld > 0 ? held[0].due_ms - now : -1;
+		if (poll(&pfd, 1, wait) <= 0)
+			continue;
+		fromlen = sizeof(from);
+		if ((n = recvfrom(fd, q, sizeof(q), 0, (struct sockaddr *)&from, &fromlen)) <= 0)
+			continue;
+		if ((len = answer(q, n, r, ttl, neg_ttl)) == 0)
+			continue;
+		queries++;
+		if (delay == 0 || nheld == MAX_HELD) {
+			sendto(fd, r, len, 0, (struct sockaddr *)&from, fromlen);
+			continue;
+		}
+		memcpy(held[nheld].buf, r, len);	/* due in arrival order, so the queue stays sorted */
+		held[nheld].len = len;
+		held[nheld].to = from;
+		held[nheld++].due_ms = now_ms() + delay;
+	}
+	fprintf(stderr, "stubdns: %ld queries\n", queries);
+	return 0;
+}
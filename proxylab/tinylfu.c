@@ -0,0 +1,72 @@
+/*
+ * tinylfu.c - TinyLFU admission filter, see tinylfu.h
+ */
+#include "csapp.h"
+#include "tinylfu.h"
+
+#define COUNTER_MAX 15
+
+void tinylfu_init(struct tinylfu *t, size_t capacity)
+{
+	/* About four counters per object, assuming 1 KB objects */
+	t->width = 1024;
+	while (t->width < capacity / 256)
+		t->width *= 2;
+	t->counters = Calloc(TINYLFU_DEPTH * t->width, 1);
+	t->records = 0;
+	t->reset_at = 10 * t->width;
+}
+
+void tinylfu_free(struct tinylfu *t)
+{
+	free(t->counters);
+	t->counters = NULL;
+}
+
+static const uint64_t seeds[TINYLFU_DEPTH] = {
+	0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL
+};
+
+/* Counter of hash in row; each row remixes the hash with its own seed */
+static uint8_t *counter(struct tinylfu *t, uint64_t hash, int row)
+{
+	uint64_t h = (hash ^ seeds[row]) * 0x9e3779b97f4a7c15ULL;
+
+	return &t->counters[row * t->width + ((h >> 32) & (t->width - 1))];
+}
+
+/* Halve every counter, aging out old popularity */
+static void reset(struct tinylfu *t)
+{
+	for (size_t i = 0; i < TINYLFU_DEPTH * t->width; i++)
+		__atomic_store_n(&t->counters[i], __atomic_load_n(&t->counters[i], __ATOMIC_RELAXED) / 2,
+			__ATOMIC_RELAXED);
+}
+
+void tinylfu_record(struct tinylfu *t, uint64_t hash)
+{
+	uint8_t *c;
+
+	for (int row = 0; row < TINYLFU_DEPTH; row++) {
+		c = counter(t, hash, row);
+		if (__atomic_load_n(c, __ATOMIC_RELAXED) < COUNTER_MAX)
+			__atomic_fetch_add(c, 1, __ATOMIC_RELAXED);
+	}
+	if (__atomic_add_fetch(&t->records, 1, __ATOMIC_RELAXED) % t->reset_at == 0)
+		reset(t);
+}
+
+int tinylfu_estimate(struct tinylfu *t, uint64_t hash)
+{
+	int min = COUNTER_MAX, v;
+
+	for (int row = 0; row < TINYLFU_DEPTH; row++)
+		if ((v = __atomic_load_n(counter(t, hash, row), __ATOMIC_RELAXED)) < min)
+			min = v;
+	return min;
+}
+
+int tinylfu_admit(struct tinylfu *t, uint64_t candidate, uint64_t victim)
+{
+	return tinylfu_estimate(t, candidate) > tinylfu_estimate(t, victim);
+}
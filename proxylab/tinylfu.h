@@ -0,0 +1,34 @@
+/*
+ * tinylfu.h - TinyLFU admission filter: a count-min sketch of recent
+ *     access frequencies. A new object is admitted only if it has been
+ *     asked for more often than the object it would push out, so a
+ *     scan of one-hit objects cannot flush the working set.
+ *
+ * Counters saturate at 15 and all of them halve every 10 * width
+ * records, so the sketch follows the recent past. Records may come
+ * from many threads at once; each counter update is atomic, and the
+ * occasional lost increment or racing halving only blurs the estimate.
+ */
+#ifndef __TINYLFU_H__
+#define __TINYLFU_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TINYLFU_DEPTH 4
+
+struct tinylfu {
+	uint8_t *counters;	/* TINYLFU_DEPTH rows of width */
+	size_t width;		/* a power of two */
+	size_t records, reset_at;
+};
+
+/* Size the sketch for a cache of capacity bytes */
+void tinylfu_init(struct tinylfu *t, size_t capacity);
+void tinylfu_free(struct tinylfu *t);
+void tinylfu_record(struct tinylfu *t, uint64_t hash);
+int tinylfu_estimate(struct tinylfu *t, uint64_t hash);
+/* Should an object with hash candidate replace one with hash victim? */
+int tinylfu_admit(struct tinylfu *t, uint64_t candidate, uint64_t victim);
+
+#endif /* __TINYLFU_H__ */
@@ -0,0 +1,240 @@
+/*
+ * tracesim.c - Replay a proxy access log against the cache's
+ *     replacement policies, with and without TinyLFU admission, and
+ *     report object and byte hit ratios for each.
+ *
+ * usage: ./tracesim [-c <bytes>[,<bytes>...]] [-o <object bytes>] [-p <policy>[,<policy>...]] <log>
+ *
+ * The log may be in Common (or Combined) Log Format, in Squid's native
+ * access.log format, or plain "<url> <bytes>" lines. Only successful
+ * GETs are replayed. Each policy runs as one unsharded instance of
+ * policy.c, and admission works as in cache.c, so the numbers carry
+ * over to the proxy up to sharding.
+ */
+#include "csapp.h"
+#include "policy.h"
+#include "tinylfu.h"
+
+struct simobj {
+	struct pnode node;	/* first, so a node is its object */
+	int cached;
+};
+
+struct request {
+	int id;			/* index of the object */
+	size_t size;
+};
+
+/* Distinct URLs, by hash, and the requests */
+static uint64_t *hashes;
+static int *slots, nslots, nobjects;
+static struct request *requests;
+static long nrequests, cap_requests;
+
+static uint64_t hash_uri(const char *uri)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	while (*uri)
+		h = (h ^ (unsigned char)*uri++) * 1099511628211ULL;
+	return h;
+}
+
+/* The object number of hash, adding it if new (open addressing, grown at half full) */
+static int object_id(uint64_t hash)
+{
+	int i;
+
+	if (2 * (nobjects + 1) > nslots) {
+		int *old = slots, oldn = nslots;
+
+		nslots = nslots ? 2 * nslots : 1024;
+		slots = Malloc(nslots * sizeof(int));
+		memset(slots, -1, nslots * sizeof(int));
+		hashes = Realloc(hashes, nslots / 2 * sizeof(uint64_t));
+		for (int j = 0; j < oldn; j++) {
+			if (old[j] < 0)
+				continue;
+			for (i = hashes[old[j]] & (nslots - 1); slots[i] >= 0; i = (i + 1) & (nslots - 1))
+				;
+			slots[i] = old[j];
+		}
+		free(old);
+	}
+	for (i = hash & (nslots - 1); slots[i] >= 0; i = (i + 1) & (nslots - 1))
+		if (hashes[slots[i]] == hash)
+			return slots[i];
+	hashes[nobjects] = hash;
+	slots[i] = nobjects;
+	return nobjects++;
+}
+
+/* Pull the URL and size out of one log line; 0 if it is not a successful GET */
+static int parse_line(char *line, char **url, size_t *size)
+{
+	char *f[10], *q, *save;
+	int n = 0, status;
+
+	if ((q = strchr(line, '"')) != NULL) {
+		/* Common Log Format: host ident user [date] "GET url HTTP/1.x" status bytes */
+		char method[16], *end = strchr(q + 1, '"');
+
+		if (end == NULL || sscanf(q + 1, "%15s", method) != 1 || strcmp(method, "GET"))
+			return 0;
+		*end = '\0';
+		if ((*url = strchr(q + 1, ' ')) == NULL)
+			return 0;
+		*url += 1;
+		strtok_r(*url, " ", &save);
+		if (sscanf(end + 1, "%d %zu", &status, size) != 2)
+			return 0;
+		return status == 200;
+	}
+	for (char *t = strtok_r(line, " \t\n", &save); t != NULL && n < 10; t = strtok_r(NULL, " \t\n", &save))
+		f[n++] = t;
+	if (n >= 7 && (q = strchr(f[3], '/')) != NULL) {
+		/* Squid: time elapsed client action/code bytes method url ... */
+		if (strcmp(f[5], "GET") || atoi(q + 1) != 200)
+			return 0;
+		*url = f[6];
+		*size = strtoul(f[4], NULL, 10);
+		return 1;
+	}
+	if (n == 2) {
+		*url = f[0];
+		*size = strtoul(f[1], NULL, 10);
+		return 1;
+	}
+	return 0;
+}
+
+static void load(const char *path)
+{
+	char line[MAXBUF], *url;
+	size_t size;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "tracesim: cannot open %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (!parse_line(line, &url, &size) || size == 0)
+			continue;
+		if (nrequests == cap_requests) {
+			cap_requests = cap_requests ? 2 * cap_requests : 4096;
+			requests = Realloc(requests, cap_requests * sizeof(struct request));
+		}
+		requests[nrequests].id = object_id(hash_uri(url));
+		requests[nrequests++].size = size;
+	}
+	fclose(fp);
+}
+
+/* Replay the log; object and byte hit ratios into *ohr and *bhr */
+static void replay(int kind, int admission, size_t capacity, size_t max_object,
+		double *ohr, double *bhr)
+{
+	struct simobj *objs = Calloc(nobjects, sizeof(struct simobj));
+	struct policy policy;
+	struct tinylfu sketch;
+	struct pnode *victim;
+	long hits = 0;
+	double bytes = 0, hit_bytes = 0;
+	size_t used = 0;
+
+	policy_init(&policy, kind, capacity);
+	if (admission)
+		tinylfu_init(&sketch, capacity);
+	for (long r = 0; r < nrequests; r++) {
+		struct simobj *o = &objs[requests[r].id];
+		size_t size = requests[r].size;
+		uint64_t hash = hashes[requests[r].id];
+
+		bytes += size;
+		if (admission)
+			tinylfu_record(&sketch, hash);
+		if (o->cached) {
+			hits++;
+			hit_bytes += size;
+			policy_hit(&policy, &o->node);
+			continue;
+		}
+		if (size > max_object)
+			continue;
+		if (admission && used + size > capacity && (victim = policy_next(&policy)) != NULL &&
+			!tinylfu_admit(&sketch, hash, victim->hash))
+			continue;
+		o->node.size = size;
+		o->node.hash = hash;
+		o->cached = 1;
+		policy_insert(&policy, &o->node);
+		for (used += size; used > capacity; used -= victim->size) {
+			victim = policy_next(&policy);
+			policy_evict(&policy, victim);
+			((struct simobj *)victim)->cached = 0;
+		}
+	}
+	*ohr = nrequests ? (double)hits / nrequests : 0;
+	*bhr = bytes > 0 ? hit_bytes / bytes : 0;
+	policy_free(&policy);
+	if (admission)
+		tinylfu_free(&sketch);
+	free(objs);
+}
+
+static void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-c <bytes>[,<bytes>...]] [-o <object bytes>] "
+		"[-p <policy>[,<policy>...]] <log>\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char sizes_arg[MAXLINE] = "1049000", policies_arg[MAXLINE] = "lru,clock,gdsf,s3fifo";
+	char *t, *save;
+	size_t sizes[16], max_object = 102400;
+	int policies[POLICY_COUNT], nsizes = 0, npolicies = 0, c;
+	double ohr, bhr;
+
+	while ((c = getopt(argc, argv, "c:o:p:")) != -1) {
+		switch (c) {
+		case 'c':
+			snprintf(sizes_arg, sizeof(sizes_arg), "%s", optarg);
+			break;
+		case 'o':
+			max_object = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			snprintf(policies_arg, sizeof(policies_arg), "%s", optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+	for (t = strtok_r(sizes_arg, ",", &save); t != NULL && nsizes < 16; t = strtok_r(NULL, ",", &save))
+		if ((sizes[nsizes++] = strtoul(t, NULL, 10)) == 0)
+			usage(argv[0]);
+	for (t = strtok_r(policies_arg, ",", &save); t != NULL && npolicies < POLICY_COUNT;
+		t = strtok_r(NULL, ",", &save))
+		if ((policies[npolicies++] = policy_parse(t)) < 0)
+			usage(argv[0]);
+
+	load(argv[optind]);
+	printf("%ld requests, %d objects, largest cached object %zu bytes\n",
+		nrequests, nobjects, max_object);
+	printf("%-8s %-8s %12s %10s %10s\n", "policy", "admit", "cache bytes", "object hit", "byte hit");
+	for (int s = 0; s < nsizes; s++) {
+		for (int p = 0; p < npolicies; p++) {
+			for (int a = 0; a <= 1; a++) {
+				replay(policies[p], a, sizes[s], max_object, &ohr, &bhr);
+				printf("%-8s %-8s %12zu %9.2f%% %9.2f%%\n", policy_name(policies[p]),
+					a ? "tinylfu" : "all", sizes[s], 100 * ohr, 100 * bhr);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,68 @@
+#!/bin/bash
+#
+# upbench.sh - What upstream connection pooling and client keep-alive
+#     save: throughput, latency and origin connections for small,
+#     uncacheable responses, with pooling off (-u 0) and on, and with
+#     clients that close after every request and ones that keep alive.
+#
+# Two origins: ./origin, which keeps connections alive, and ./tiny,
+# which closes after every response, so nothing can be pooled there and
+# only client keep-alive helps.
+#
+# usage: ./upbench.sh [<mode>]          (thread or pool, default thread)
+#
+# In pool mode a keep-alive client holds a worker only while a request
+# is in progress and is parked between requests, so WORKERS (default
+# CONNS) is enough for every client to have a request in flight.
+#
+# Environment: ORIGIN_PORT, TINY_PORT, PROXY_PORT, CONNS, REQUESTS, WORKERS.
+#
+ORIGIN_PORT=${ORIGIN_PORT:-9000}
+TINY_PORT=${TINY_PORT:-9001}
+PROXY_PORT=${PROXY_PORT:-9100}
+CONNS=${CONNS:-20}
+REQUESTS=${REQUESTS:-20000}
+MODE=${1:-thread}
+WORKERS=${WORKERS:-${CONNS}}
+
+make -s proxy loadgen origin || exit 1
+(cd tiny && make -s) || exit 1
+
+./origin ${ORIGIN_PORT} 2> /dev/null &
+origin_pid=$!
+(cd tiny && exec ./tiny ${TINY_PORT} > /dev/null 2>&1) &
+tiny_pid=$!
+trap "kill ${origin_pid} ${tiny_pid} 2> /dev/null" EXIT
+sleep 0.5
+
+origin_connections() {
+    curl -s http://127.0.0.1:${ORIGIN_PORT}/stats | awk '{ print $4 }'
+}
+
+# run <label> <url> <loadgen flags> <proxy flags>; -o 1 keeps every response out of the cache
+run() {
+    ./proxy -m ${MODE} -w ${WORKERS} -o 1 $4 ${PROXY_PORT} 2> /tmp/upbench.err.$$ &
+    proxy_pid=$!
+    sleep 0.5
+    before=`origin_connections`
+    result=`./loadgen $3 -c ${CONNS} -n ${REQUESTS} -x 127.0.0.1:${PROXY_PORT} "$2"`
+    after=`origin_connections`
+    kill -TERM ${proxy_pid}
+    wait ${proxy_pid} 2> /dev/null
+    reused=`awk '/^upstream/ { print $6 }' /tmp/upbench.err.$$ | tr -d '(%),'`
+    rm -f /tmp/upbench.err.$$
+    case "$2" in *:${ORIGIN_PORT}/*) conns=$((after - before - 1)) ;; *) conns=- ;; esac
+    echo "${result}" | awk -v label="$1" -v conns=${conns} -v reused=${reused} '
+        /req\/s/ { for (i = 1; i <= NF; i++) if ($(i+1) == "req/s") rate = $i }
+        /^latency/ { p50 = $4; p99 = $8 }
+        END { printf "%-28s %9s %8s %8s %9s %8s%%\n", label, rate, p50, p99, conns, reused }'
+}
+
+origin="http://127.0.0.1:${ORIGIN_PORT}/up?size=512"
+tiny="http://127.0.0.1:${TINY_PORT}/home.html"
+printf "%-28s %9s %8s %8s %9s %9s\n" run "req/s" "p50 ms" "p99 ms" "upstream" "reused"
+run "origin, no pool"             ${origin} ""  "-u 0"
+run "origin, pool"                ${origin} ""  ""
+run "origin, pool + keep-alive"   ${origin} -k  ""
+run "tiny, no pool"               ${tiny}   ""  "-u 0"
+run "tiny, pool + keep-alive"     ${tiny}   -k  ""
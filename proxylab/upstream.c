@@ -0,0 +1,166 @@
+/*
+ * upstream.c - Idle origin connection pool, see upstream.h
+ *
+ * Origins live in one hash table under one mutex; the pool only pushes
+ * and pops descriptors under it, and checks a popped connection is
+ * still open with the mutex released. An origin is added when a
+ * connection to it is first pooled, and dropped by the sweep once it
+ * has none left, so the table only holds origins with idle
+ * connections, give or take a second.
+ */
+#include "csapp.h"
+#include "upstream.h"
+#include "dns.h"
+
+#define ORIGIN_BUCKETS 256
+
+struct idle {
+	int fd;
+	time_t since;
+};
+
+struct origin {
+	char *key;			/* "host:port" */
+	struct idle *idle;		/* a stack, the most recently used on top */
+	int nidle;
+	struct origin *chain;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct origin *origins[ORIGIN_BUCKETS];
+static int max_idle = UPSTREAM_IDLE, timeout = UPSTREAM_TIMEOUT;
+static time_t last_sweep;
+static long opened, reused, failed, stale, expired, overflow;
+
+void upstream_init(int idle, int secs)
+{
+	max_idle = idle;
+	timeout = secs;
+}
+
+/* The origin for host:port, added if new and add is set, else NULL */
+static struct origin *find(const char *host, const char *port, int add)
+{
+	char key[MAXLINE];
+	unsigned h = 5381;
+	struct origin *o;
+
+	snprintf(key, sizeof(key), "%s:%s", host, port);
+	for (const char *p = key; *p; p++)
+		h = h * 33 + (unsigned char)*p;
+	for (o = origins[h % ORIGIN_BUCKETS]; o != NULL; o = o->chain)
+		if (!strcmp(o->key, key))
+			return o;
+	if (!add)
+		return NULL;
+	o = Calloc(1, sizeof(struct origin));
+	o->key = Malloc(strlen(key) + 1);
+	strcpy(o->key, key);
+	o->idle = Calloc(max_idle, sizeof(struct idle));
+	o->chain = origins[h % ORIGIN_BUCKETS];
+	origins[h % ORIGIN_BUCKETS] = o;
+	return o;
+}
+
+/* Close the connections of o idle since before cutoff; they sit at the bottom */
+static void expire(struct origin *o, time_t cutoff)
+{
+	int n = 0;
+
+	while (n < o->nidle && o->idle[n].since < cutoff)
+		close(o->idle[n++].fd);
+	if (n > 0) {
+		memmove(o->idle, o->idle + n, (o->nidle - n) * sizeof(struct idle));
+		o->nidle -= n;
+		expired += n;
+	}
+}
+
+/* Has the origin closed fd, or sent something nobody asked for? */
+static int is_stale(int fd)
+{
+	char c;
+
+	return !(recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+int upstream_get(const char *host, const char *port, int *was_reused)
+{
+	struct origin *o;
+	int fd;
+
+	while (max_idle > 0) {
+		pthread_mutex_lock(&lock);
+		if ((o = find(host, port, 0)) != NULL)
+			expire(o, time(NULL) - timeout);
+		fd = o != NULL && o->nidle > 0 ? o->idle[--o->nidle].fd : -1;
+		pthread_mutex_unlock(&lock);
+		if (fd < 0)
+			break;
+		if (!is_stale(fd)) {
+			__sync_fetch_and_add(&reused, 1);
+			*was_reused = 1;
+			return fd;
+		}
+		close(fd);
+		__sync_fetch_and_add(&stale, 1);
+	}
+	*was_reused = 0;
+	if ((fd = dns_open_clientfd(host, atoi(port))) >= 0)
+		__sync_fetch_and_add(&opened, 1);
+	return fd;
+}
+
+void upstream_put(const char *host, const char *port, int fd)
+{
+	time_t now = time(NULL);
+	struct origin *o, **pp;
+
+	if (max_idle <= 0) {
+		close(fd);
+		return;
+	}
+	pthread_mutex_lock(&lock);
+	/* Now and then, close what every origin has left idle too long, and drop origins left empty */
+	if (now != last_sweep) {
+		last_sweep = now;
+		for (int b = 0; b < ORIGIN_BUCKETS; b++)
+			for (pp = &origins[b]; (o = *pp) != NULL; ) {
+				expire(o, now - timeout);
+				if (o->nidle > 0) {
+					pp = &o->chain;
+					continue;
+				}
+				*pp = o->chain;
+				Free(o->idle);
+				Free(o->key);
+				Free(o);
+			}
+	}
+	o = find(host, port, 1);
+	if (o->nidle == max_idle) {	/* full: the oldest makes way */
+		close(o->idle[0].fd);
+		memmove(o->idle, o->idle + 1, (o->nidle - 1) * sizeof(struct idle));
+		o->nidle--;
+		overflow++;
+	}
+	o->idle[o->nidle].fd = fd;
+	o->idle[o->nidle++].since = now;
+	pthread_mutex_unlock(&lock);
+}
+
+void upstream_failed(void)
+{
+	__sync_fetch_and_add(&failed, 1);
+}
+
+void upstream_report(FILE *fp)
+{
+	long o = __sync_fetch_and_add(&opened, 0), r = __sync_fetch_and_add(&reused, 0);
+
+	pthread_mutex_lock(&lock);
+	fprintf(fp, "upstream: %ld opened, %ld reused (%.1f%%), %ld failed on reuse; "
+		"idle closed: %ld stale, %ld expired, %ld over the limit\n", o, r,
+		o + r > 0 ? 100.0 * r / (o + r) : 0.0, failed, stale, expired, overflow);
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,32 @@
+/*
+ * upstream.h - Pool of idle connections to origin servers, so that a
+ *     request to an origin the proxy has talked to recently skips the
+ *     name lookup and TCP handshake.
+ *
+ * Each origin (host and port) keeps up to max_idle idle connections,
+ * the most recently used handed out first. A connection idle longer
+ * than the timeout, or one the origin has closed meanwhile, is closed
+ * instead of reused. The origin may still close a connection just as
+ * a request goes out on it, so a caller that gets no response on a
+ * reused connection should retry on another.
+ */
+#ifndef __UPSTREAM_H__
+#define __UPSTREAM_H__
+
+#include <stdio.h>
+
+#define UPSTREAM_IDLE 32	/* default idle connections kept per origin */
+#define UPSTREAM_TIMEOUT 30	/* default seconds a connection may stay idle */
+
+/* max_idle 0 turns pooling off: every request gets a new connection */
+void upstream_init(int max_idle, int timeout);
+/* A connection to host:port, *reused saying if it came from the pool; -1 on error */
+int upstream_get(const char *host, const char *port, int *reused);
+/* Return fd, which has just finished a response in full, to the pool of host:port */
+void upstream_put(const char *host, const char *port, int fd);
+/* Count a reused connection that failed before answering */
+void upstream_failed(void);
+/* Print connections opened and reused, and why idle ones were closed */
+void upstream_report(FILE *fp);
+
+#endif /* __UPSTREAM_H__ */
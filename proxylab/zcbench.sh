@@ -0,0 +1,52 @@
+#!/bin/bash
+#
+# zcbench.sh - Proxy CPU time per GB served, for cache hits (objects
+#     just under MAX_OBJECT_SIZE) and for relayed misses (objects too
+#     big to cache), in each front end.
+#
+# usage: ./zcbench.sh [<mode> ...]          (default: thread event)
+#
+# Environment: ORIGIN_PORT, PROXY_PORT, CONNS, REQUESTS (per run).
+#
+ORIGIN_PORT=${ORIGIN_PORT:-9000}
+PROXY_PORT=${PROXY_PORT:-9100}
+CONNS=${CONNS:-50}
+REQUESTS=${REQUESTS:-20000}
+MODES=${@:-thread event}
+HZ=`getconf CLK_TCK`
+
+make -s proxy loadgen origin || exit 1
+
+./origin ${ORIGIN_PORT} 2> /dev/null &
+origin_pid=$!
+trap "kill ${origin_pid} 2> /dev/null" EXIT
+sleep 0.5
+
+# Clock ticks of user plus system time used by process $1
+cpu_ticks() {
+    awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+# run <mode> <label> <size> <urls> <requests>
+run() {
+    ./proxy -m $1 ${PROXY_PORT} &
+    proxy_pid=$!
+    sleep 0.5
+    url="http://127.0.0.1:${ORIGIN_PORT}/zc?size=$3"
+    # Warm the cache so the measured run sees only hits, or only misses
+    ./loadgen -c 1 -n $4 -U $4 -x 127.0.0.1:${PROXY_PORT} "${url}" > /dev/null
+    before=`cpu_ticks ${proxy_pid}`
+    result=`./loadgen -c ${CONNS} -n $5 -U $4 -x 127.0.0.1:${PROXY_PORT} "${url}"`
+    after=`cpu_ticks ${proxy_pid}`
+    kill ${proxy_pid}
+    wait ${proxy_pid} 2> /dev/null
+    echo "${result}" | awk -v mode=$1 -v label=$2 -v ticks=$((after - before)) -v hz=${HZ} '
+        /req\/s/ { for (i = 1; i <= NF; i++) { if ($i == "in") secs = $(i+1) + 0; if ($(i+1) == "MB/s") mbs = $i } }
+        END { gb = mbs * secs / 1000; printf "%-8s %-6s %8.2f %9.2f %12.2f\n", mode, label, gb, mbs, (gb > 0 ? ticks / hz / gb : 0) }'
+}
+
+printf "%-8s %-6s %8s %9s %12s\n" mode load GB "MB/s" "cpu s/GB"
+for mode in ${MODES}; do
+    run ${mode} hit 100000 8 ${REQUESTS}
+    run ${mode} miss 1000000 1 $((REQUESTS / 10))
+done